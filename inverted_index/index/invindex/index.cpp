@@ -22,6 +22,7 @@
 #include <regex>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -42,7 +43,7 @@ class InvertedIndexImpl : public IInvertedIndex {
         doc_block_count_ = (config_.doc_count - 1) / config_.doc_block_size + 1;
     }
 
-    void Put(const IndexKey& index_key, const PostingList& posting_list) { lsm_->Put(index_key, posting_list); }
+    void Put(IndexKey&& index_key, PostingList&& posting_list) { lsm_->Put(std::move(index_key), std::move(posting_list)); }
 
     PostingList GetDocId(IndexKey index_key) const override {
         auto posting_list = lsm_->Get(index_key);
@@ -78,7 +79,7 @@ class InvertedIndexBuilderImpl : public IInvertedIndexBuilder {
    public:
     InvertedIndexBuilderImpl(const IndexConfig& config) { index_ = std::make_shared<InvertedIndexImpl>(config); }
 
-    void Put(IndexKey index_key, PostingList posting_list) { index_->Put(index_key, posting_list); }
+    void Put(IndexKey index_key, PostingList posting_list) { index_->Put(std::move(index_key), std::move(posting_list)); }
 
     std::shared_ptr<const IInvertedIndex> GetInvertedIndex() const { return index_; }
 
@@ -194,8 +195,7 @@ class CrawlerImpl : public ICrawler {
         auto scan = word_set->Scan(std::nullopt, std::nullopt);
         auto object = scan->Next();
         while (object.has_value()) {
-            auto word = object->first;
-            word_dictionary_->Put(word, SerializeUint32(feature_id++));
+            word_dictionary_->Put(std::move(object->first), SerializeUint32(feature_id++));
             object = scan->Next();
         }
     }
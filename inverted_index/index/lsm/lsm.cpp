@@ -105,8 +105,10 @@ class DefaultLSMImpl : public ILSM<DefaultValue> {
         buffer_pool_ = storage::MakeReadBufferPool(options_.buffer_pool_size, options_.frame_size);
     }
 
-    void Put(const UserKey& user_key, const DefaultValue& value) override {
-        mem_table_->Add(user_key, value);
+    void Put(const UserKey& user_key, const DefaultValue& value) override { Put(UserKey(user_key), DefaultValue(value)); }
+
+    void Put(UserKey&& user_key, DefaultValue&& value) override {
+        mem_table_->Add(std::move(user_key), std::move(value));
         CheckMemTable();
     }
 
@@ -415,8 +417,10 @@ class IndexLSMImpl : public ILSM<IndexValue> {
         buffer_pool_ = storage::MakeReadBufferPool(options_.buffer_pool_size, options_.frame_size);
     }
 
-    void Put(const UserKey& user_key, const IndexValue& value) override {
-        mem_table_->Add(user_key, value);
+    void Put(const UserKey& user_key, const IndexValue& value) override { Put(UserKey(user_key), IndexValue(value)); }
+
+    void Put(UserKey&& user_key, IndexValue&& value) override {
+        mem_table_->Add(std::move(user_key), std::move(value));
         CheckMemTable();
     }
 
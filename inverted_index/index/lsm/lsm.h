@@ -28,6 +28,8 @@ class ILSM {
     // Insert or overwrite the value for user_key. Subsequent Get should observe this
     // value unless a newer Delete/Put overrides it.
     virtual void Put(const UserKey& user_key, const Value& value) = 0;
+    // Moves the key and the value on into the memtable, for callers that build them only to hand them over
+    virtual void Put(UserKey&& user_key, Value&& value) = 0;
 
     // Write a deletion tombstone for user_key. Subsequent Get should return std::nullopt
     // until a newer Put for the same key appears.
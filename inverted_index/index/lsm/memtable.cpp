@@ -25,10 +25,12 @@ class DefaultMemTableImpl : public IMemTable<DefaultValue> {
         random_generator_.seed(device());
     }
 
-    void Add(const UserKey& user_key, const DefaultValue& value) override {
+    void Add(const UserKey& user_key, const DefaultValue& value) override { Add(UserKey(user_key), DefaultValue(value)); }
+
+    void Add(UserKey&& user_key, DefaultValue&& value) override {
         auto node = std::make_shared<Node>();
-        node->key = {user_key};
-        node->value = value;
+        node->key = {std::move(user_key)};
+        node->value = std::move(value);
         InsertNode(node);
     }
 
@@ -159,22 +161,10 @@ class IndexMemTableImpl : public IMemTable<IndexValue> {
         random_generator_.seed(device());
     }
 
+    // A posting list of a key already in the memtable is merged into the one there, only a new key copies it
     void Add(const UserKey& user_key, const IndexValue& value) override {
-        InternalKey key = {user_key};
-        uint64_t level = max_level_;
-        std::shared_ptr<Node> cur = head_;
-        while (level) {
-            if (cur->links[level - 1] && cur->links[level - 1]->key < key) {
-                cur = cur->links[level - 1];
-            } else {
-                --level;
-            }
-        }
-        if (cur->links[0] && cur->links[0]->key.user_key == user_key) {
-            amu_ -= cur->links[0]->value.getSizeInBytes();
-            cur->links[0]->value |= value;
-            cur->links[0]->value.runOptimize();
-            amu_ += cur->links[0]->value.getSizeInBytes();
+        if (auto node = FindNode(user_key)) {
+            Merge(*node, value);
             return;
         }
         auto node = std::make_shared<Node>();
@@ -183,6 +173,17 @@ class IndexMemTableImpl : public IMemTable<IndexValue> {
         InsertNode(node);
     }
 
+    void Add(UserKey&& user_key, IndexValue&& value) override {
+        if (auto node = FindNode(user_key)) {
+            Merge(*node, value);
+            return;
+        }
+        auto node = std::make_shared<Node>();
+        node->key = {std::move(user_key)};
+        node->value = std::move(value);
+        InsertNode(node);
+    }
+
     GetKind Get(const UserKey& user_key, IndexValue& out_value) const override {
         out_value = {};
         InternalKey key = {user_key};
@@ -273,6 +274,30 @@ class IndexMemTableImpl : public IMemTable<IndexValue> {
         std::shared_ptr<Node> cur_;
     };
 
+    // Null when the memtable doesn't hold the key
+    std::shared_ptr<Node> FindNode(const UserKey& user_key) const {
+        uint64_t level = max_level_;
+        std::shared_ptr<Node> cur = head_;
+        while (level) {
+            if (cur->links[level - 1] && cur->links[level - 1]->key.user_key < user_key) {
+                cur = cur->links[level - 1];
+            } else {
+                --level;
+            }
+        }
+        if (cur->links[0] && cur->links[0]->key.user_key == user_key) {
+            return cur->links[0];
+        }
+        return nullptr;
+    }
+
+    void Merge(Node& node, const IndexValue& value) {
+        amu_ -= node.value.getSizeInBytes();
+        node.value |= value;
+        node.value.runOptimize();
+        amu_ += node.value.getSizeInBytes();
+    }
+
     void InsertNode(const std::shared_ptr<Node>& node) {
         std::uniform_int_distribution<int> hit(0, 1);
         do {
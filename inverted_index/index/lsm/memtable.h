@@ -19,6 +19,8 @@ class IMemTable {
     // If Add is called without monotonically increasing sequence_number, behavior is undefined.
     // It is recommended to throw an exception/assert to simplify debugging.
     virtual void Add(const UserKey& user_key, const Value& value) = 0;
+    // Moves the key and the value into the memtable instead of copying them
+    virtual void Add(UserKey&& user_key, Value&& value) = 0;
 
     // Write a tombstone for user_key at the given sequence_number.
     // Tombstones are visible in scans (as internal-key entries) and affect Get semantics.
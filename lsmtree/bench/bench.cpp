@@ -2,6 +2,7 @@
 
 #include <lsm/lsm.h>
 #include <lsm/utils/lsm_utils.h>
+#include "ycsb.h"
 #include <sys/types.h>
 #include <cstdint>
 #include <memory>
@@ -493,6 +494,60 @@ BENCHMARK(HardScanWithoutFilter)
     ->Unit(benchmark::kMillisecond)
     ;
 
+// Args: workload (0..5 = A..F), LSM (0 = simple, 1 = granular, 2 = leveled), key distribution
+// (-1 = the workload's own, 0 = uniform, 1 = zipfian, 2 = latest), threads. The LSM is loaded
+// with kYcsbRecords records of 100 bytes outside of the measurement. Scans walk every level from
+// its first table in range, so workload E runs fewer operations.
+constexpr uint64_t kYcsbRecords = 20000;
+constexpr uint64_t kYcsbOperations = 20000;
+constexpr uint64_t kYcsbScanOperations = 1000;
+
+void Ycsb(benchmark::State& state) {
+    auto workload = ycsb::kWorkloads[state.range(0)];
+    if (state.range(2) >= 0) {
+        workload.distribution = static_cast<ycsb::Distribution>(state.range(2));
+    }
+    state.SetLabel(workload.name);
+    LsmOptions simple_options;
+    simple_options.memtable_bytes = 64 * 1024;
+    GranularLsmOptions options;
+    options.memtable_bytes = 64 * 1024;
+    options.max_sstable_size = 256 * 1024;
+    options.buffer_pool_size = 1024 * 1024;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        ycsb::Database db;
+        ycsb::Open(db, static_cast<ycsb::Variant>(state.range(1)), simple_options, options);
+        ycsb::Load(db, kYcsbRecords);
+        state.ResumeTiming();
+
+        auto result = ycsb::Run(db, workload, workload.scan > 0 ? kYcsbScanOperations : kYcsbOperations, state.range(3));
+
+        state.PauseTiming();
+        state.counters["ops/s"] = benchmark::Counter(result.operations / result.seconds);
+        state.counters["p50(us)"] = benchmark::Counter(result.latency.Percentile(0.5) / 1e3);
+        state.counters["p99(us)"] = benchmark::Counter(result.latency.Percentile(0.99) / 1e3);
+        state.counters["p999(us)"] = benchmark::Counter(result.latency.Percentile(0.999) / 1e3);
+        state.counters["WA"] = benchmark::Counter(ycsb::WriteAmplification(db));
+        state.counters["RA"] = benchmark::Counter(ycsb::ReadAmplification(db));
+        state.counters["SA"] = benchmark::Counter(ycsb::SpaceAmplification(db));
+        db.lsm.reset();
+        state.ResumeTiming();
+    }
+}
+
+BENCHMARK(Ycsb)
+    ->UseRealTime()
+    ->Iterations(1)
+    ->ArgsProduct({{0, 1, 2, 3, 4, 5}, {0, 1, 2}, {-1}, {1}})
+    ->Args({0, 2, 0, 1})
+    ->Args({2, 2, 0, 1})
+    ->Args({0, 2, -1, 4})
+    ->Args({2, 2, -1, 4})
+    ->Unit(benchmark::kMillisecond)
+    ;
+
 // const auto kBigTableGeneration = GenerateLSM(
 //     {
 //         30, 40, 200'000, 400'000,
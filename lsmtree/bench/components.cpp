@@ -0,0 +1,409 @@
+#include </home/lim/HSE/Projects/IBIS/contrib/benchmark/include/benchmark/benchmark.h>
+
+#include <lsm/bloom_filter/bloom_filter.h>
+#include <lsm/common/merge.h>
+#include <lsm/memtable.h>
+#include <lsm/sstable.h>
+#include <lsm/storage/buffer_pool.h>
+#include <lsm/storage/file.h>
+#include <lsm/utils/lsm_utils.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Component benchmarks: every case runs one of the LSM's building blocks on its own, so that a
+// regression in the end-to-end benchmarks of bench.cpp can be pinned to a component.
+
+namespace lsm {
+
+namespace {
+
+const std::string kBenchDir = "bench_components";
+
+std::vector<std::pair<UserKey, Value>> MakeEntries(size_t count, uint32_t seed = 42) {
+    std::mt19937 rng(seed);
+    std::vector<std::pair<UserKey, Value>> entries;
+    for (size_t ind = 0; ind < count; ++ind) {
+        entries.emplace_back(GenerateRandomKey(rng, 16, 24), GenerateRandomKey(rng, 64, 128));
+    }
+    return entries;
+}
+
+std::shared_ptr<IFilterBuilder> MakeBenchFilterBuilder(int filter_type, size_t hash_count, size_t keys_count) {
+    switch (filter_type) {
+        case 0:
+            return MakeFilterBuilder(keys_count * 10, hash_count);
+        case 1:
+            return MakeBlockedFilterBuilder(keys_count * 10, hash_count);
+        default:
+            return MakeFuseFilterBuilder();
+    }
+}
+
+std::unique_ptr<IFilterDeserializer> MakeBenchFilterDeserializer(int filter_type) {
+    switch (filter_type) {
+        case 0:
+            return MakeFilterDeserializer();
+        case 1:
+            return MakeBlockedFilterDeserializer();
+        default:
+            return MakeFuseFilterDeserializer();
+    }
+}
+
+}  // namespace
+
+// Args: skip list max level, entries. Inserts into a fresh memtable.
+void MemTableAdd(benchmark::State& state) {
+    auto entries = MakeEntries(state.range(1));
+    for (auto _ : state) {
+        auto mem_table = MakeMemTable(state.range(0));
+        for (size_t ind = 0; ind < entries.size(); ++ind) {
+            mem_table->Add(ind, entries[ind].first, entries[ind].second);
+        }
+        benchmark::DoNotOptimize(mem_table);
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+// Args: skip list max level, entries. Looks up present keys in random order.
+void MemTableGet(benchmark::State& state) {
+    auto entries = MakeEntries(state.range(1));
+    auto mem_table = MakeMemTable(state.range(0));
+    for (size_t ind = 0; ind < entries.size(); ++ind) {
+        mem_table->Add(ind, entries[ind].first, entries[ind].second);
+    }
+    std::shuffle(entries.begin(), entries.end(), std::mt19937(1));
+    size_t lookups = 0;
+    Value value;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mem_table->Get(entries[lookups++ % entries.size()].first, &value));
+    }
+    state.SetItemsProcessed(lookups);
+}
+
+// Args: skip list max level, entries. Reads the whole memtable in batches.
+void MemTableScan(benchmark::State& state) {
+    auto entries = MakeEntries(state.range(1));
+    auto mem_table = MakeMemTable(state.range(0));
+    for (size_t ind = 0; ind < entries.size(); ++ind) {
+        mem_table->Add(ind, entries[ind].first, entries[ind].second);
+    }
+    std::vector<std::pair<InternalKey, Value>> batch;
+    for (auto _ : state) {
+        auto scan = mem_table->MakeScan();
+        while (scan->NextBatch(batch, kStreamBatchSize)) {
+            benchmark::DoNotOptimize(batch);
+            batch.clear();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+// Four levels are enough for a small memtable only, it degrades to a list at 100k entries
+BENCHMARK(MemTableAdd)->ArgsProduct({{4, 12, 20}, {1'000}})->ArgsProduct({{12, 20}, {100'000}})->Unit(benchmark::kMillisecond);
+BENCHMARK(MemTableGet)->ArgsProduct({{4, 12, 20}, {1'000}})->ArgsProduct({{12, 20}, {100'000}});
+BENCHMARK(MemTableScan)->ArgsProduct({{12}, {1'000, 100'000}})->Unit(benchmark::kMillisecond);
+
+// Tables are written through the same file kinds the LSM uses:
+// 0 = in memory, 1 = mmap, 2 = read through a buffer pool larger than the table
+class TableEnv {
+   public:
+    TableEnv(int file_type, size_t entries_count) : entries_(MakeEntries(entries_count)) {
+        std::filesystem::create_directories(kBenchDir);
+        std::sort(entries_.begin(), entries_.end());
+        if (file_type == 0) {
+            file_ = std::make_shared<storage::TestMemoryFile>();
+        } else if (file_type == 1) {
+            file_ = std::make_shared<storage::MmapFile>(kBenchDir + "/sstable_0", &read_bytes_);
+        } else {
+            buffer_pool_ = storage::MakeReadBufferPool(kBenchDir, 256ull * 1024 * 1024, 4096, &read_bytes_);
+            file_ = std::make_shared<storage::BufferedMemoryFile>(kBenchDir, 0, buffer_pool_);
+        }
+    }
+
+    void Build() {
+        auto builder = factory_->NewFileBuilder(file_);
+        for (size_t ind = 0; ind < entries_.size(); ++ind) {
+            builder->Add(InternalKey{entries_[ind].first, ind, ValueType::kValue}, entries_[ind].second);
+        }
+        builder->Finish();
+    }
+
+    std::shared_ptr<ISSTableReader> Open() const { return factory_->FromFile(file_); }
+
+    const std::vector<std::pair<UserKey, Value>>& Entries() const { return entries_; }
+
+    uint64_t ReadBytes() const { return read_bytes_; }
+
+   private:
+    std::vector<std::pair<UserKey, Value>> entries_;
+    std::shared_ptr<ISSTableSerializer> factory_ = MakeSSTableFileFactory();
+    uint64_t read_bytes_ = 0;
+    std::shared_ptr<storage::IReadBufferPool> buffer_pool_;
+    std::shared_ptr<storage::IFile> file_;
+};
+
+// Args: file, entries
+void TableBuild(benchmark::State& state) {
+    TableEnv env(state.range(0), state.range(1));
+    for (auto _ : state) {
+        env.Build();
+    }
+    state.SetItemsProcessed(state.iterations() * env.Entries().size());
+}
+
+// Args: file, entries. Looks up present keys in random order in an opened table.
+void TableGet(benchmark::State& state) {
+    TableEnv env(state.range(0), state.range(1));
+    env.Build();
+    auto table = env.Open();
+    auto keys = env.Entries();
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+    size_t lookups = 0;
+    Value value;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(table->Get(keys[lookups++ % keys.size()].first, &value));
+    }
+    state.SetItemsProcessed(lookups);
+    state.counters["B/op"] = benchmark::Counter(static_cast<double>(env.ReadBytes()) / std::max<size_t>(lookups, 1));
+}
+
+// Args: file, entries. Opens the table and reads it in batches.
+void TableScan(benchmark::State& state) {
+    TableEnv env(state.range(0), state.range(1));
+    env.Build();
+    std::vector<std::pair<InternalKey, Value>> batch;
+    for (auto _ : state) {
+        auto scan = env.Open()->MakeScan();
+        while (scan->NextBatch(batch, kStreamBatchSize)) {
+            benchmark::DoNotOptimize(batch);
+            batch.clear();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * env.Entries().size());
+}
+
+BENCHMARK(TableBuild)->ArgsProduct({{0, 1, 2}, {10'000}})->Unit(benchmark::kMillisecond);
+BENCHMARK(TableGet)->ArgsProduct({{0, 1, 2}, {10'000}});
+BENCHMARK(TableScan)->ArgsProduct({{0, 1, 2}, {10'000}})->Unit(benchmark::kMillisecond);
+
+// Args: filter (0 = polynomial bloom, 1 = blocked bloom, 2 = binary fuse), hash count, keys in the filter
+void FilterBuild(benchmark::State& state) {
+    int filter_type = state.range(0);
+    size_t hash_count = state.range(1);
+    std::mt19937 rng(42);
+    std::vector<UserKey> keys;
+    for (int64_t ind = 0; ind < state.range(2); ++ind) {
+        keys.push_back(GenerateRandomKey(rng, 16, 16));
+    }
+    std::sort(keys.begin(), keys.end());
+    size_t filter_size = 0;
+    for (auto _ : state) {
+        auto builder = MakeBenchFilterBuilder(filter_type, hash_count, keys.size());
+        for (const auto& key : keys) {
+            builder->Add(key);
+        }
+        filter_size = builder->Serialize().size();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+    state.counters["bits/key"] = benchmark::Counter(8.0 * filter_size / keys.size());
+}
+
+BENCHMARK(FilterBuild)
+    ->Args({0, 7, 100'000})
+    ->Args({1, 7, 100'000})
+    ->Args({2, 3, 100'000})
+    ->Unit(benchmark::kMillisecond)
+    ;
+
+// Args: filter (0 = polynomial bloom, 1 = blocked bloom, 2 = binary fuse), hash count, keys in the filter.
+// Bloom filters get 10 bits per key, lookups are for absent keys so every probe runs to the end.
+void FilterMayContain(benchmark::State& state) {
+    int filter_type = state.range(0);
+    size_t hash_count = state.range(1);
+    size_t keys_count = state.range(2);
+    std::mt19937 rng(42);
+    auto builder = MakeBenchFilterBuilder(filter_type, hash_count, keys_count);
+    for (size_t ind = 0; ind < keys_count; ++ind) {
+        builder->Add(GenerateRandomKey(rng, 16, 16));
+    }
+    auto filter = MakeBenchFilterDeserializer(filter_type)->Deserialize(builder->Serialize());
+
+    std::vector<UserKey> absent;
+    for (size_t ind = 0; ind < 4096; ++ind) {
+        absent.push_back(GenerateRandomKey(rng, 17, 17));
+    }
+    uint64_t lookups = 0, positives = 0;
+    for (auto _ : state) {
+        positives += filter->MayContain(absent[lookups++ % absent.size()]);
+    }
+    state.counters["fpr"] = benchmark::Counter(static_cast<double>(positives) / lookups);
+}
+
+BENCHMARK(FilterMayContain)
+    ->Args({0, 23, 1'000'000})
+    ->Args({0, 7, 1'000'000})
+    ->Args({1, 7, 1'000'000})
+    ->Args({2, 3, 1'000'000})
+    ->Args({0, 7, 10'000})
+    ->Args({1, 7, 10'000})
+    ->Args({2, 3, 10'000})
+    ;
+
+// The multiset merger MakeMerger used before the loser tree, kept here as a baseline
+class MultisetMerger : public IStream<std::pair<InternalKey, Value>> {
+   public:
+    using Element = std::pair<InternalKey, Value>;
+
+    explicit MultisetMerger(std::vector<std::shared_ptr<IStream<Element>>> sources) : sources_(std::move(sources)) {
+        for (size_t ind = 0; ind < sources_.size(); ++ind) {
+            auto value = sources_[ind]->Next();
+            if (value.has_value()) {
+                heap_.insert({*value, ind});
+            }
+        }
+    }
+
+    std::optional<Element> Next() {
+        if (heap_.empty()) {
+            return std::nullopt;
+        }
+        auto result = *heap_.begin();
+        heap_.erase(heap_.begin());
+        auto new_value = sources_[result.second]->Next();
+        if (new_value.has_value()) {
+            heap_.insert({*new_value, result.second});
+        }
+        return result.first;
+    }
+
+   private:
+    struct BigCompare {
+        bool operator()(const std::pair<Element, size_t> f, const std::pair<Element, size_t> s) const { return f.first < s.first; }
+    };
+
+    std::multiset<std::pair<Element, size_t>, BigCompare> heap_;
+    std::vector<std::shared_ptr<IStream<Element>>> sources_;
+};
+
+class VectorStream : public IStream<std::pair<InternalKey, Value>> {
+   public:
+    explicit VectorStream(const std::vector<std::pair<InternalKey, Value>>* data) : data_(data) {}
+
+    std::optional<std::pair<InternalKey, Value>> Next() {
+        if (ind_ == data_->size()) {
+            return std::nullopt;
+        }
+        return (*data_)[ind_++];
+    }
+
+    size_t NextBatch(std::vector<std::pair<InternalKey, Value>>& out, size_t max) {
+        size_t count = std::min(max, data_->size() - ind_);
+        out.insert(out.end(), data_->begin() + ind_, data_->begin() + ind_ + count);
+        ind_ += count;
+        return count;
+    }
+
+   private:
+    const std::vector<std::pair<InternalKey, Value>>* data_;
+    size_t ind_ = 0;
+};
+
+// Args: merger (0 = multiset, 1 = loser tree, 2 = loser tree read with NextBatch), sources.
+// Merges 200k entries split over the sources, as a flush or compaction of that many sorted runs would.
+void MergeSources(benchmark::State& state) {
+    int merger_type = state.range(0);
+    size_t sources_count = state.range(1);
+    const size_t entries = 200'000;
+    std::mt19937 rng(42);
+    std::vector<std::vector<std::pair<InternalKey, Value>>> runs(sources_count);
+    for (size_t ind = 0; ind < entries; ++ind) {
+        runs[ind % sources_count].push_back({InternalKey{GenerateRandomKey(rng, 16, 24), ind, ValueType::kValue}, GenerateRandomKey(rng, 64, 128)});
+    }
+    for (auto& run : runs) {
+        std::sort(run.begin(), run.end());
+    }
+
+    for (auto _ : state) {
+        std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources;
+        for (const auto& run : runs) {
+            sources.push_back(std::make_shared<VectorStream>(&run));
+        }
+        std::shared_ptr<IStream<std::pair<InternalKey, Value>>> merger;
+        if (merger_type) {
+            merger = MakeMerger(sources);
+        } else {
+            merger = std::make_shared<MultisetMerger>(sources);
+        }
+        size_t merged = 0;
+        if (merger_type == 2) {
+            std::vector<std::pair<InternalKey, Value>> batch;
+            while (size_t count = merger->NextBatch(batch, kStreamBatchSize)) {
+                benchmark::DoNotOptimize(batch);
+                merged += count;
+                batch.clear();
+            }
+        } else {
+            while (auto value = merger->Next()) {
+                benchmark::DoNotOptimize(value);
+                ++merged;
+            }
+        }
+        benchmark::DoNotOptimize(merged);
+    }
+    state.SetItemsProcessed(state.iterations() * entries);
+}
+
+BENCHMARK(MergeSources)
+    ->ArgsProduct({{0, 1, 2}, {2, 4, 10, 30, 100, 300}})
+    ->Unit(benchmark::kMillisecond)
+    ;
+
+// Args: frames in the pool, frames read, shards (0 = picked from the pool size). Frames are read
+// in random order, with a working set larger than the pool every read is a miss that evicts.
+void BufferPoolGetFrame(benchmark::State& state) {
+    const uint64_t frame_size = 4096;
+    uint64_t pool_frames = state.range(0);
+    uint64_t table_frames = state.range(1);
+    std::filesystem::create_directories(kBenchDir);
+    storage::ReadBufferPoolOptions options;
+    options.pool_size = pool_frames * frame_size;
+    options.frame_size = frame_size;
+    options.shards = state.range(2);
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool(kBenchDir, options, &read_bytes);
+    {
+        storage::BufferedMemoryFile file(kBenchDir, 0, buffer_pool, frame_size);
+        std::vector<uint8_t> data(table_frames * frame_size, 1);
+        file.Write(data.data(), data.size());
+
+        std::mt19937 rng(42);
+        std::vector<uint32_t> pages(1 << 16);
+        for (auto& page : pages) {
+            page = rng() % table_frames;
+        }
+        size_t reads = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(buffer_pool->GetFrame({0, pages[reads++ % pages.size()]}));
+        }
+        state.SetItemsProcessed(reads);
+        state.counters["miss"] = benchmark::Counter(static_cast<double>(read_bytes) / frame_size / std::max<size_t>(reads, 1));
+    }
+    std::filesystem::remove_all(kBenchDir);
+}
+
+BENCHMARK(BufferPoolGetFrame)
+    ->Args({1024, 256, 0})
+    ->Args({1024, 256, 1})
+    ->Args({1024, 4096, 0})
+    ->Args({1024, 4096, 1})
+    ;
+
+}  // namespace lsm
@@ -0,0 +1,401 @@
+#pragma once
+
+#include <lsm/common/hash.h>
+#include <lsm/lsm.h>
+#include <lsm/utils/lsm_utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lsm::ycsb {
+
+// YCSB core workloads (Cooper et al., "Benchmarking Cloud Serving Systems with YCSB")
+enum class Distribution { kUniform, kZipfian, kLatest };
+
+struct Workload {
+    const char* name;
+    double read = 0;
+    double update = 0;
+    double insert = 0;
+    double scan = 0;
+    double read_modify_write = 0;
+    Distribution distribution = Distribution::kZipfian;
+    // Scan lengths are uniform in [1, max_scan_length]
+    uint32_t max_scan_length = 100;
+};
+
+inline const Workload kWorkloads[] = {
+    {.name = "A", .read = 0.5, .update = 0.5},
+    {.name = "B", .read = 0.95, .update = 0.05},
+    {.name = "C", .read = 1},
+    {.name = "D", .read = 0.95, .insert = 0.05, .distribution = Distribution::kLatest},
+    {.name = "E", .insert = 0.05, .scan = 0.95},
+    {.name = "F", .read = 0.5, .read_modify_write = 0.5},
+};
+
+// Zipfian over [0, items) with the item count allowed to grow (Gray et al., as in YCSB's ZipfianGenerator):
+// zeta is extended incrementally instead of recomputed.
+class ZipfianGenerator {
+   public:
+    explicit ZipfianGenerator(uint64_t items, double theta = 0.99) : theta_(theta), alpha_(1 / (1 - theta)), zeta2_(1 + std::pow(0.5, theta)) { Resize(items); }
+
+    uint64_t Next(std::mt19937_64& rng) {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zetan_;
+        if (uz < 1) {
+            return 0;
+        }
+        if (uz < zeta2_) {
+            return 1;
+        }
+        return std::min<uint64_t>(items_ * std::pow(eta_ * u - eta_ + 1, alpha_), items_ - 1);
+    }
+
+    void Resize(uint64_t items) {
+        for (; items_ < items; ++items_) {
+            zetan_ += 1 / std::pow(static_cast<double>(items_ + 1), theta_);
+        }
+        eta_ = (1 - std::pow(2.0 / items_, 1 - theta_)) / (1 - zeta2_ / zetan_);
+    }
+
+   private:
+    double theta_;
+    double alpha_;
+    double zeta2_;
+    uint64_t items_ = 0;
+    double zetan_ = 0;
+    double eta_ = 0;
+};
+
+// Key of the i-th record: "user" and a hash of i, so that inserts land all over the key space.
+// With a size range the key is cut or padded to a size picked by the hash, so a record keeps
+// its key; keys cut below the natural 24 bytes may collide.
+inline UserKey RecordKey(uint64_t record, uint32_t min_size = 0, uint32_t max_size = 0) {
+    uint64_t hash = Hash64(reinterpret_cast<const uint8_t*>(&record), sizeof(record));
+    std::string key = "user" + std::to_string(hash);
+    if (max_size > 0) {
+        key.resize(min_size + hash % (max_size - min_size + 1), 'x');
+    }
+    return UserKey(key.begin(), key.end());
+}
+
+// Picks records among the first record_count ones
+class KeyChooser {
+   public:
+    KeyChooser(Distribution distribution, uint64_t record_count) : distribution_(distribution), zipfian_(std::max<uint64_t>(record_count, 1)) {}
+
+    uint64_t Next(std::mt19937_64& rng, uint64_t record_count) {
+        switch (distribution_) {
+            case Distribution::kUniform:
+                return rng() % record_count;
+            case Distribution::kZipfian: {
+                // Popular records are scattered over the key space, as with YCSB's scrambled zipfian
+                uint64_t rank = zipfian_.Next(rng);
+                return Hash64(reinterpret_cast<const uint8_t*>(&rank), sizeof(rank)) % record_count;
+            }
+            case Distribution::kLatest:
+                zipfian_.Resize(record_count);
+                return record_count - 1 - std::min(zipfian_.Next(rng), record_count - 1);
+        }
+        return 0;
+    }
+
+   private:
+    Distribution distribution_;
+    ZipfianGenerator zipfian_;
+};
+
+// Log-linear latency histogram in nanoseconds: 32 buckets per power of two, within 3% of the true percentile
+class LatencyHistogram {
+   public:
+    static constexpr int kSubBuckets = 32;
+
+    LatencyHistogram() : buckets_(64 * kSubBuckets) {}
+
+    void Record(uint64_t nanoseconds) {
+        ++buckets_[Bucket(nanoseconds)];
+        ++count_;
+        max_ = std::max(max_, nanoseconds);
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (size_t ind = 0; ind < buckets_.size(); ++ind) {
+            buckets_[ind] += other.buckets_[ind];
+        }
+        count_ += other.count_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    // Upper bound of the bucket holding the q-quantile, q in [0, 1]
+    uint64_t Percentile(double q) const {
+        uint64_t rank = std::ceil(q * count_), seen = 0;
+        for (size_t ind = 0; ind < buckets_.size(); ++ind) {
+            seen += buckets_[ind];
+            if (seen >= std::max<uint64_t>(rank, 1)) {
+                return std::min(UpperBound(ind), max_);
+            }
+        }
+        return max_;
+    }
+
+    uint64_t Count() const { return count_; }
+
+    void Reset() {
+        std::fill(buckets_.begin(), buckets_.end(), 0);
+        count_ = max_ = 0;
+    }
+
+   private:
+    static size_t Bucket(uint64_t value) {
+        if (value < kSubBuckets) {
+            return value;
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        uint64_t mantissa = (value >> (exponent - 5)) & (kSubBuckets - 1);
+        return (exponent - 4) * kSubBuckets + mantissa;
+    }
+
+    static uint64_t UpperBound(size_t bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        int exponent = bucket / kSubBuckets + 4;
+        uint64_t mantissa = bucket % kSubBuckets;
+        return ((kSubBuckets + mantissa + 1) << (exponent - 5)) - 1;
+    }
+
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+// ILSM is not thread-safe: every call is made under the mutex and latencies include waiting for it
+struct Database {
+    std::shared_ptr<ILSM> lsm;
+    std::shared_ptr<TestLevelsProvider> levels_provider;
+    std::mutex mutex;
+    // Records 0..record_count-1 exist, inserts take the next index
+    std::atomic<uint64_t> record_count = 0;
+    std::atomic<uint64_t> logical_bytes_written = 0;
+    std::atomic<uint64_t> logical_bytes_read = 0;
+    // Passed to the LSM, counts bytes read from table files
+    uint64_t read_bytes = 0;
+    // Sizes are uniform in the ranges, a key size range of 0 keeps natural keys
+    uint32_t min_key_size = 0;
+    uint32_t max_key_size = 0;
+    uint32_t min_value_size = 100;
+    uint32_t max_value_size = 100;
+
+    UserKey Key(uint64_t record) const { return RecordKey(record, min_key_size, max_key_size); }
+
+    Value MakeValue(std::mt19937_64& rng) const {
+        Value value(std::uniform_int_distribution<uint32_t>(min_value_size, max_value_size)(rng));
+        for (auto& byte : value) {
+            byte = rng();
+        }
+        return value;
+    }
+};
+
+enum class Variant { kSimple, kGranular, kLeveled };
+
+inline void Open(Database& db, Variant variant, const LsmOptions& simple_options, const GranularLsmOptions& options) {
+    db.levels_provider = std::make_shared<TestLevelsProvider>();
+    auto sstable_factory = MakeSSTableFileFactory();
+    switch (variant) {
+        case Variant::kSimple:
+            db.lsm = MakeLsm(simple_options, db.levels_provider, sstable_factory, &db.read_bytes);
+            break;
+        case Variant::kGranular:
+            db.lsm = MakeGranularLsm(options, db.levels_provider, sstable_factory, &db.read_bytes);
+            break;
+        case Variant::kLeveled:
+            db.lsm = MakeLeveledLsm(options, db.levels_provider, sstable_factory, &db.read_bytes);
+            break;
+    }
+}
+
+struct RunResult {
+    uint64_t operations = 0;
+    double seconds = 0;
+    LatencyHistogram latency;
+};
+
+// Inserts records until there are record_count of them
+inline void Load(Database& db, uint64_t record_count, uint64_t seed = 1) {
+    std::mt19937_64 rng(seed);
+    for (uint64_t record = db.record_count; record < record_count; ++record) {
+        auto key = db.Key(record);
+        auto value = db.MakeValue(rng);
+        db.logical_bytes_written += key.size() + value.size();
+        db.lsm->Put(std::move(key), std::move(value));
+    }
+    db.record_count = std::max<uint64_t>(db.record_count, record_count);
+}
+
+// Runs one operation of the workload, returns its latency in nanoseconds
+inline uint64_t RunOperation(Database& db, const Workload& workload, KeyChooser& chooser, std::mt19937_64& rng) {
+    double dice = std::uniform_real_distribution<double>(0, 1)(rng);
+    auto start = std::chrono::steady_clock::now();
+    uint64_t read_bytes = 0, written_bytes = 0;
+    if (dice < workload.insert) {
+        auto key = db.Key(db.record_count.fetch_add(1));
+        auto value = db.MakeValue(rng);
+        written_bytes = key.size() + value.size();
+        std::lock_guard lock(db.mutex);
+        db.lsm->Put(std::move(key), std::move(value));
+    } else {
+        auto key = db.Key(chooser.Next(rng, db.record_count));
+        dice -= workload.insert;
+        if (dice < workload.read) {
+            std::lock_guard lock(db.mutex);
+            auto value = db.lsm->Get(key);
+            read_bytes = key.size() + (value ? value->size() : 0);
+        } else if ((dice -= workload.read) < workload.update) {
+            auto value = db.MakeValue(rng);
+            written_bytes = key.size() + value.size();
+            std::lock_guard lock(db.mutex);
+            db.lsm->Put(std::move(key), std::move(value));
+        } else if ((dice -= workload.update) < workload.scan) {
+            uint32_t length = std::uniform_int_distribution<uint32_t>(1, workload.max_scan_length)(rng);
+            std::lock_guard lock(db.mutex);
+            auto scan = db.lsm->Scan(key, std::nullopt);
+            for (uint32_t ind = 0; ind < length; ++ind) {
+                auto row = scan->Next();
+                if (!row.has_value()) {
+                    break;
+                }
+                read_bytes += row->first.size() + row->second.size();
+            }
+        } else {
+            auto new_value = db.MakeValue(rng);
+            written_bytes = key.size() + new_value.size();
+            std::lock_guard lock(db.mutex);
+            auto value = db.lsm->Get(key);
+            read_bytes = key.size() + (value ? value->size() : 0);
+            db.lsm->Put(std::move(key), std::move(new_value));
+        }
+    }
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    db.logical_bytes_read += read_bytes;
+    db.logical_bytes_written += written_bytes;
+    return latency;
+}
+
+// Runs operations spread over threads, each thread with its own generators
+inline RunResult Run(Database& db, const Workload& workload, uint64_t operations, uint32_t threads, uint64_t seed = 2) {
+    threads = std::max<uint32_t>(threads, 1);
+    std::vector<LatencyHistogram> latencies(threads);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t thread = 0; thread < threads; ++thread) {
+        workers.emplace_back([&, thread] {
+            std::mt19937_64 rng(seed + thread);
+            KeyChooser chooser(workload.distribution, db.record_count);
+            for (uint64_t op = thread; op < operations; op += threads) {
+                latencies[thread].Record(RunOperation(db, workload, chooser, rng));
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    RunResult result;
+    result.operations = operations;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const auto& latency : latencies) {
+        result.latency.Merge(latency);
+    }
+    return result;
+}
+
+// Runs the workload on threads until duration passes. Every interval, report gets the operations
+// and latencies of that interval alone; the returned result covers the whole run.
+inline RunResult RunFor(Database& db, const Workload& workload, std::chrono::duration<double> duration, uint32_t threads, std::chrono::duration<double> interval,
+                        const std::function<void(const RunResult&)>& report, uint64_t seed = 2) {
+    struct Worker {
+        std::mutex mutex;
+        uint64_t operations = 0;
+        LatencyHistogram latency;
+    };
+    threads = std::max<uint32_t>(threads, 1);
+    std::vector<Worker> states(threads);
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> workers;
+    for (uint32_t thread = 0; thread < threads; ++thread) {
+        workers.emplace_back([&, thread] {
+            std::mt19937_64 rng(seed + thread);
+            KeyChooser chooser(workload.distribution, db.record_count);
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto latency = RunOperation(db, workload, chooser, rng);
+                std::lock_guard lock(states[thread].mutex);
+                ++states[thread].operations;
+                states[thread].latency.Record(latency);
+            }
+        });
+    }
+
+    RunResult total;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration);
+    auto last = start;
+    while (true) {
+        auto tick = std::min(last + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval), end);
+        std::this_thread::sleep_until(tick);
+        if (tick == end) {
+            stop = true;
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+        RunResult current;
+        for (auto& state : states) {
+            std::lock_guard lock(state.mutex);
+            current.operations += state.operations;
+            current.latency.Merge(state.latency);
+            state.operations = 0;
+            state.latency.Reset();
+        }
+        auto now = std::chrono::steady_clock::now();
+        current.seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+        total.operations += current.operations;
+        total.latency.Merge(current.latency);
+        report(current);
+        if (tick == end) {
+            break;
+        }
+    }
+    total.seconds = std::chrono::duration<double>(last - start).count();
+    return total;
+}
+
+inline double WriteAmplification(const Database& db) { return static_cast<double>(db.levels_provider->TotalBytesInserted()) / std::max<uint64_t>(db.logical_bytes_written, 1); }
+
+inline double ReadAmplification(const Database& db) { return static_cast<double>(db.read_bytes) / std::max<uint64_t>(db.logical_bytes_read, 1); }
+
+// Bytes of live tables over the bytes of the latest version of every record
+inline double SpaceAmplification(const Database& db) {
+    uint64_t table_bytes = 0;
+    for (size_t level = 0; level < db.levels_provider->NumLevels(); ++level) {
+        for (size_t table = 0; table < db.levels_provider->NumTables(level); ++table) {
+            auto meta = db.levels_provider->GetTableMetadata(level, table);
+            table_bytes += meta.has_value() ? meta->file_size : 0;
+        }
+    }
+    double key_size = db.max_key_size > 0 ? (db.min_key_size + db.max_key_size) / 2.0 : RecordKey(0).size();
+    double live_bytes = db.record_count * (key_size + (db.min_value_size + db.max_value_size) / 2.0);
+    return table_bytes / std::max(live_bytes, 1.0);
+}
+
+}  // namespace lsm::ycsb
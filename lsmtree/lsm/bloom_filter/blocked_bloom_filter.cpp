@@ -0,0 +1,164 @@
+#include "lsm/bloom_filter/bloom_filter.h"
+
+#include <lsm/common/hash.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace lsm {
+
+namespace {
+
+constexpr uint64_t kBlockBits = 512;
+constexpr uint64_t kBlockWords = kBlockBits / 64;
+
+struct alignas(64) Block {
+    uint64_t words[kBlockWords] = {};
+};
+static_assert(sizeof(Block) == 64);
+
+// Serialized as block count and hash count followed by the blocks
+constexpr size_t kHeaderSize = 2 * sizeof(uint64_t);
+
+}  // namespace
+
+class BlockedFilterImpl : public IFilter {
+   public:
+    BlockedFilterImpl(size_t bit_count, size_t hash_count)
+        : blocks_(std::max<size_t>((bit_count + kBlockBits - 1) / kBlockBits, 1)), hash_count_(std::clamp<uint64_t>(hash_count, 1, kBlockBits)) {}
+
+    explicit BlockedFilterImpl(const std::vector<uint8_t>& data) {
+        if (data.size() < kHeaderSize) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": filter of " + std::to_string(data.size()) + " bytes is too short");
+        }
+        uint64_t block_count;
+        std::memcpy(&block_count, data.data(), sizeof(uint64_t));
+        std::memcpy(&hash_count_, data.data() + sizeof(uint64_t), sizeof(uint64_t));
+        if (block_count == 0 || hash_count_ == 0 || hash_count_ > kBlockBits || (data.size() - kHeaderSize) / sizeof(Block) < block_count) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": malformed filter of " + std::to_string(data.size()) + " bytes");
+        }
+        blocks_.resize(block_count);
+        std::memcpy(blocks_.data(), data.data() + kHeaderSize, block_count * sizeof(Block));
+    }
+
+    void Add(const UserKey& key) { AddHash(Hash64(key.data(), key.size())); }
+
+    void AddHash(uint64_t hash) {
+        uint64_t mask[kBlockWords] = {};
+        auto& block = blocks_[Locate(hash, mask)];
+        for (uint64_t ind = 0; ind < kBlockWords; ++ind) {
+            block.words[ind] |= mask[ind];
+        }
+    }
+
+    bool MayContain(const UserKey& key) const {
+        uint64_t mask[kBlockWords] = {};
+        const auto& block = blocks_[Locate(Hash64(key.data(), key.size()), mask)];
+        uint64_t missing = 0;
+        for (uint64_t ind = 0; ind < kBlockWords; ++ind) {
+            missing |= mask[ind] & ~block.words[ind];
+        }
+        return missing == 0;
+    }
+
+    std::vector<uint8_t> Serialize() const {
+        std::vector<uint8_t> buffer(kHeaderSize + blocks_.size() * sizeof(Block));
+        uint64_t block_count = blocks_.size();
+        std::memcpy(buffer.data(), &block_count, sizeof(uint64_t));
+        std::memcpy(buffer.data() + sizeof(uint64_t), &hash_count_, sizeof(uint64_t));
+        std::memcpy(buffer.data() + kHeaderSize, blocks_.data(), blocks_.size() * sizeof(Block));
+        return buffer;
+    }
+
+    virtual ~BlockedFilterImpl() = default;
+
+   private:
+    // Picks the block from the high bits of the hash and fills mask with the probed bits,
+    // probe i is bit (h1 + i * h2) mod 512 of the block
+    size_t Locate(uint64_t hash, uint64_t* mask) const {
+        uint32_t h1 = static_cast<uint32_t>(hash);
+        uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+        for (uint64_t ind = 0; ind < hash_count_; ++ind) {
+            uint32_t bit = (h1 + ind * h2) % kBlockBits;
+            mask[bit / 64] |= 1ull << (bit % 64);
+        }
+        return static_cast<size_t>((static_cast<__uint128_t>(hash) * blocks_.size()) >> 64);
+    }
+
+    std::vector<Block> blocks_;
+    uint64_t hash_count_;
+};
+
+class BlockedFilterBuilderImpl : public IFilterBuilder {
+   public:
+    BlockedFilterBuilderImpl(size_t bit_count, size_t hash_count) : filter_(bit_count, hash_count) {}
+
+    void Add(const UserKey& key) { filter_.Add(key); }
+
+    std::vector<uint8_t> Serialize() { return filter_.Serialize(); }
+
+    virtual ~BlockedFilterBuilderImpl() = default;
+
+   private:
+    BlockedFilterImpl filter_;
+};
+
+// Keeps only key hashes and builds the filter on Serialize, once the number of keys is known
+class SizedBlockedFilterBuilderImpl : public IFilterBuilder {
+   public:
+    SizedBlockedFilterBuilderImpl(double bits_per_key, size_t hash_count, size_t max_bit_count) : bits_per_key_(bits_per_key), hash_count_(hash_count), max_bit_count_(max_bit_count) {
+        if (hash_count_ == 0) {
+            // k = ln(2) * bits per key minimizes the false positive rate
+            hash_count_ = std::clamp<size_t>(std::lround(bits_per_key * 0.69), 1, 30);
+        }
+    }
+
+    // Versions of one key arrive next to each other and are counted once
+    void Add(const UserKey& key) {
+        uint64_t hash = Hash64(key.data(), key.size());
+        if (hashes_.empty() || hashes_.back() != hash) {
+            hashes_.push_back(hash);
+        }
+    }
+
+    std::vector<uint8_t> Serialize() {
+        auto bit_count = static_cast<size_t>(std::ceil(bits_per_key_ * std::max<size_t>(hashes_.size(), 1)));
+        BlockedFilterImpl filter(std::min(bit_count, max_bit_count_), hash_count_);
+        for (auto hash : hashes_) {
+            filter.AddHash(hash);
+        }
+        return filter.Serialize();
+    }
+
+    virtual ~SizedBlockedFilterBuilderImpl() = default;
+
+   private:
+    double bits_per_key_;
+    size_t hash_count_;
+    size_t max_bit_count_;
+    std::vector<uint64_t> hashes_;
+};
+
+class BlockedFilterDeserializerImpl : public IFilterDeserializer {
+   public:
+    std::unique_ptr<IFilter> Deserialize(const std::vector<uint8_t>& data) const { return std::make_unique<BlockedFilterImpl>(data); }
+
+    virtual ~BlockedFilterDeserializerImpl() = default;
+};
+
+std::shared_ptr<IFilterBuilder> MakeBlockedFilterBuilder(size_t bit_count, size_t hash_count) { return std::make_shared<BlockedFilterBuilderImpl>(bit_count, hash_count); }
+
+std::shared_ptr<IFilterBuilder> MakeBlockedFilterBuilderByBitsPerKey(double bits_per_key, size_t hash_count, size_t max_bit_count) {
+    return std::make_shared<SizedBlockedFilterBuilderImpl>(bits_per_key, hash_count, max_bit_count);
+}
+
+std::unique_ptr<IFilterDeserializer> MakeBlockedFilterDeserializer() { return std::make_unique<BlockedFilterDeserializerImpl>(); }
+
+}  // namespace lsm
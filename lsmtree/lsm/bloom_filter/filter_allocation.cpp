@@ -0,0 +1,61 @@
+#include "lsm/bloom_filter/filter_allocation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace lsm {
+
+namespace {
+
+// ln(2)^2: a bloom filter with b bits per key has a false positive rate of exp(-b * ln(2)^2)
+constexpr double kLn2Squared = 0.4804530139182014;
+// Levels holding next to nothing would otherwise be given unbounded bits per key
+constexpr double kMaxBitsPerKey = 64;
+
+// Bits per key of every level when level i gets the false positive rate min(1, exp(log_lambda) * keys_i)
+std::vector<double> BitsPerKey(const std::vector<double>& level_keys, double log_lambda) {
+    std::vector<double> result;
+    result.reserve(level_keys.size());
+    for (double keys : level_keys) {
+        double log_rate = keys > 0 ? std::min(0.0, log_lambda + std::log(keys)) : -kMaxBitsPerKey * kLn2Squared;
+        result.push_back(std::min(kMaxBitsPerKey, -log_rate / kLn2Squared));
+    }
+    return result;
+}
+
+double TotalBits(const std::vector<double>& level_keys, const std::vector<double>& bits_per_key) {
+    return std::inner_product(level_keys.begin(), level_keys.end(), bits_per_key.begin(), 0.0);
+}
+
+}  // namespace
+
+std::vector<double> AllocateFilterBitsPerKey(const std::vector<double>& level_keys, double average_bits_per_key) {
+    double total_keys = std::accumulate(level_keys.begin(), level_keys.end(), 0.0);
+    if (total_keys <= 0 || average_bits_per_key <= 0) {
+        return std::vector<double>(level_keys.size(), std::max(average_bits_per_key, 0.0));
+    }
+    double budget = std::min(average_bits_per_key, kMaxBitsPerKey) * total_keys;
+    double min_keys = total_keys, max_keys = 0;
+    for (double keys : level_keys) {
+        if (keys > 0) {
+            min_keys = std::min(min_keys, keys);
+            max_keys = std::max(max_keys, keys);
+        }
+    }
+    // Total bits only decrease as lambda grows: at low every level gets the most bits per key,
+    // at high none. Bisect on log(lambda) until the budget is spent.
+    double low = -std::log(max_keys) - kMaxBitsPerKey * kLn2Squared, high = -std::log(min_keys);
+    for (int iteration = 0; iteration < 100; ++iteration) {
+        double middle = (low + high) / 2;
+        if (TotalBits(level_keys, BitsPerKey(level_keys, middle)) > budget) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return BitsPerKey(level_keys, high);
+}
+
+}  // namespace lsm
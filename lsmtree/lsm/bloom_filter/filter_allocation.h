@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+namespace lsm {
+
+// Monkey (Dayan et al., SIGMOD 2017): splits a filter memory budget of average_bits_per_key bits
+// for every key across levels so that the sum of false positive rates, the expected number of
+// wasted table reads per lookup, is minimal. Optimal rates are proportional to level sizes, so
+// small upper levels get more bits per key and the largest level gets fewer.
+// level_keys may be any measure proportional to the number of keys on a level.
+std::vector<double> AllocateFilterBitsPerKey(const std::vector<double>& level_keys, double average_bits_per_key);
+
+}  // namespace lsm
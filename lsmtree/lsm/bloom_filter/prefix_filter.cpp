@@ -0,0 +1,62 @@
+#include "lsm/bloom_filter/bloom_filter.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace lsm {
+
+// Adds every key and its prefix to the wrapped builder, one filter answers both point and
+// prefix queries. Keys come sorted, so repeated keys and prefixes are dropped before the
+// wrapped builder sees them.
+class PrefixFilterBuilderImpl : public IFilterBuilder {
+   public:
+    PrefixFilterBuilderImpl(std::shared_ptr<IFilterBuilder> builder, size_t prefix_length) : builder_(builder), prefix_length_(prefix_length) {
+        if (prefix_length_ == 0) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": prefix length must be positive");
+        }
+    }
+
+    void Add(const UserKey& key) {
+        if (!last_key_.has_value() || *last_key_ != key) {
+            builder_->Add(key);
+            last_key_ = key;
+        }
+        UserKey prefix(key.begin(), key.begin() + std::min(key.size(), prefix_length_));
+        if (!last_prefix_.has_value() || *last_prefix_ != prefix) {
+            builder_->Add(prefix);
+            last_prefix_ = std::move(prefix);
+        }
+    }
+
+    std::vector<uint8_t> Serialize() { return builder_->Serialize(); }
+
+    virtual ~PrefixFilterBuilderImpl() = default;
+
+   private:
+    std::shared_ptr<IFilterBuilder> builder_;
+    size_t prefix_length_;
+    std::optional<UserKey> last_key_;
+    std::optional<UserKey> last_prefix_;
+};
+
+std::shared_ptr<IFilterBuilder> MakePrefixFilterBuilder(std::shared_ptr<IFilterBuilder> builder, size_t prefix_length) {
+    return std::make_shared<PrefixFilterBuilderImpl>(builder, prefix_length);
+}
+
+std::optional<UserKey> RangePrefix(const std::optional<UserKey>& start_key, const std::optional<UserKey>& end_key, size_t prefix_length) {
+    if (prefix_length == 0 || !start_key.has_value() || !end_key.has_value() || start_key->size() < prefix_length || end_key->size() < prefix_length) {
+        return std::nullopt;
+    }
+    // Every key in [start_key, end_key) starts with the prefix shared by both bounds
+    if (!std::equal(start_key->begin(), start_key->begin() + prefix_length, end_key->begin())) {
+        return std::nullopt;
+    }
+    return UserKey(start_key->begin(), start_key->begin() + prefix_length);
+}
+
+}  // namespace lsm
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace lsm {
+
+namespace hash_internal {
+
+constexpr uint64_t kSecret[4] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull};
+
+inline void Mum(uint64_t& a, uint64_t& b) {
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    a = static_cast<uint64_t>(product);
+    b = static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t Mix(uint64_t a, uint64_t b) {
+    Mum(a, b);
+    return a ^ b;
+}
+
+inline uint64_t Read64(const uint8_t* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline uint64_t Read32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+}  // namespace hash_internal
+
+// 64-bit wyhash (final version 4), a few multiplies per 16 bytes of input.
+// Little-endian byte order is assumed, hashes are not portable across architectures.
+inline uint64_t Hash64(const uint8_t* data, size_t size, uint64_t seed = 0) {
+    using namespace hash_internal;
+    seed ^= Mix(seed ^ kSecret[0], kSecret[1]);
+    uint64_t a, b;
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (Read32(data) << 32) | Read32(data + ((size >> 3) << 2));
+            b = (Read32(data + size - 4) << 32) | Read32(data + size - 4 - ((size >> 3) << 2));
+        } else if (size > 0) {
+            a = (static_cast<uint64_t>(data[0]) << 16) | (static_cast<uint64_t>(data[size >> 1]) << 8) | data[size - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t left = size;
+        const uint8_t* position = data;
+        if (left > 48) {
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed = Mix(Read64(position) ^ kSecret[1], Read64(position + 8) ^ seed);
+                seed1 = Mix(Read64(position + 16) ^ kSecret[2], Read64(position + 24) ^ seed1);
+                seed2 = Mix(Read64(position + 32) ^ kSecret[3], Read64(position + 40) ^ seed2);
+                position += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (left > 16) {
+            seed = Mix(Read64(position) ^ kSecret[1], Read64(position + 8) ^ seed);
+            position += 16;
+            left -= 16;
+        }
+        a = Read64(position + left - 16);
+        b = Read64(position + left - 8);
+    }
+    a ^= kSecret[1];
+    b ^= seed;
+    Mum(a, b);
+    return Mix(a ^ kSecret[0] ^ size, b ^ kSecret[1]);
+}
+
+}  // namespace lsm
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lsm {
+
+// Background jobs of an LSM-tree on two pools of worker threads. Flushes have a pool of their own and
+// run in submission order, so a full memtable never waits behind a long compaction. Compaction threads
+// run at a lower OS priority and take the queued compaction with the highest score first.
+// Destruction drops the queued jobs and waits for the running ones.
+class JobScheduler {
+   public:
+    JobScheduler(size_t flush_threads, size_t compaction_threads) {
+        for (size_t ind = 0; ind < flush_threads; ++ind) {
+            workers_.emplace_back([this] { Work(flushes_); });
+        }
+        for (size_t ind = 0; ind < compaction_threads; ++ind) {
+            workers_.emplace_back([this] {
+                setpriority(PRIO_PROCESS, gettid(), kCompactionNice);
+                Work(compactions_);
+            });
+        }
+    }
+
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    void ScheduleFlush(std::function<void()> job) { Push(flushes_, 0, std::move(job)); }
+
+    void ScheduleCompaction(double score, std::function<void()> job) { Push(compactions_, score, std::move(job)); }
+
+    // Estimate of the bytes waiting for a compaction, kept up to date by the LSM-tree. Writes stall on it.
+    void AddPendingCompactionBytes(uint64_t bytes) { pending_compaction_bytes_ += bytes; }
+
+    void RemovePendingCompactionBytes(uint64_t bytes) { pending_compaction_bytes_ -= bytes; }
+
+    uint64_t PendingCompactionBytes() const { return pending_compaction_bytes_; }
+
+    ~JobScheduler() {
+        for (auto* pool : {&flushes_, &compactions_}) {
+            std::lock_guard lock(pool->mutex);
+            pool->stopped = true;
+            pool->jobs = {};
+            pool->cv.notify_all();
+        }
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+   private:
+    static constexpr int kCompactionNice = 10;
+
+    struct Job {
+        double score;
+        uint64_t order;
+        std::function<void()> run;
+
+        // Highest score on top of the queue, the oldest job among equal scores
+        bool operator<(const Job& other) const { return score != other.score ? score < other.score : order > other.order; }
+    };
+
+    struct Pool {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::priority_queue<Job> jobs;
+        uint64_t submitted = 0;
+        bool stopped = false;
+    };
+
+    void Push(Pool& pool, double score, std::function<void()> job) {
+        {
+            std::lock_guard lock(pool.mutex);
+            pool.jobs.push({score, pool.submitted++, std::move(job)});
+        }
+        pool.cv.notify_one();
+    }
+
+    void Work(Pool& pool) {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(pool.mutex);
+                pool.cv.wait(lock, [&pool] { return pool.stopped || !pool.jobs.empty(); });
+                if (pool.stopped) {
+                    return;
+                }
+                job = std::move(const_cast<Job&>(pool.jobs.top()).run);
+                pool.jobs.pop();
+            }
+            job();
+        }
+    }
+
+    Pool flushes_;
+    Pool compactions_;
+    std::atomic<uint64_t> pending_compaction_bytes_ = 0;
+    std::vector<std::thread> workers_;
+};
+
+}  // namespace lsm
@@ -1,10 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <functional>
 #include <memory>
 #include <optional>
-#include <set>
 #include <utility>
 #include <vector>
 
@@ -13,22 +13,25 @@
 namespace lsm {
 
 // K-way merger that merges multiple sorted streams into one sorted stream
-// using a min-heap (priority queue).
+// using a loser tree (tournament tree).
 //
 // Template parameters:
 //   T: element type
 //   Compare: comparison function (default: std::less<T> for ascending order)
 //
 // Algorithm:
-//   1. Initialize heap with first element from each stream
-//   2. Extract minimum element from heap
-//   3. Advance the stream that produced the minimum
-//   4. Insert next element from that stream into heap
-//   5. Repeat until all streams are exhausted
+//   1. Take the first element of each stream and play a tournament between them:
+//      every inner node of the tree keeps the loser of its match, the root the winner
+//   2. Return the winner and advance the stream that produced it
+//   3. Replay only the matches on the path from that stream's leaf to the root
+//   4. Repeat until all streams are exhausted
+//   Equal elements come out in the order of their streams.
 //
 // Complexity:
-//   Time: O(N log K), where N = total elements, K = number of streams
-//   Space: O(K) for the heap
+//   Time: O(N log K), where N = total elements, K = number of streams,
+//         exactly ceil(log K) comparisons per element
+//   Space: O(K), elements are compared in place and only the winner is moved
+//   NextBatch reads every source in batches of up to kStreamBatchSize, O(K * kStreamBatchSize) space.
 //
 // Example:
 //   auto s1 = MakeStream({1, 3, 5});
@@ -52,36 +55,98 @@ namespace internal {
 template <typename T, typename Compare>
 class KWayMerger final : public IMerger<T, Compare> {
    public:
-    explicit KWayMerger(std::vector<std::shared_ptr<IStream<T>>> sources, Compare comp) : sources_(std::move(sources)), comp_(comp) {
+    explicit KWayMerger(std::vector<std::shared_ptr<IStream<T>>> sources, Compare comp)
+        : sources_(std::move(sources)), buffers_(sources_.size()), positions_(sources_.size()), comp_(comp) {
         for (size_t ind = 0; ind < sources_.size(); ++ind) {
-            auto value = sources_[ind]->Next();
-            if (value.has_value()) {
-                heap_.insert({*value, ind});
-            }
+            Refill(ind, 1);
+        }
+        if (!sources_.empty()) {
+            losers_.resize(sources_.size());
+            losers_[0] = Play(1);
         }
     }
 
+    // Pulls sources one element at a time, so a partly read merger has not read ahead
     std::optional<T> Next() override {
-        if (heap_.empty()) {
+        if (sources_.empty() || !HasHead(losers_[0])) {
             return std::nullopt;
         }
-        auto result = *heap_.begin();
-        heap_.erase(heap_.begin());
-        auto new_value = sources_[result.second]->Next();
-        if (new_value.has_value()) {
-            heap_.insert({*new_value, result.second});
+        return PopWinner(1);
+    }
+
+    // Pulls sources in batches of up to max rows, comparing and moving rows without a virtual call per row
+    size_t NextBatch(std::vector<T>& out, size_t max) override {
+        size_t count = 0, batch_size = std::min(max, kStreamBatchSize);
+        for (; count < max && !sources_.empty() && HasHead(losers_[0]); ++count) {
+            out.push_back(PopWinner(batch_size));
         }
-        return result.first;
+        return count;
     }
 
    private:
-    class BigCompare {
-       public:
-        bool operator()(const std::pair<T, size_t> f, const std::pair<T, size_t> s) const { return Compare()(f.first, s.first); }
-    };
+    bool HasHead(size_t source) const { return positions_[source] < buffers_[source].size(); }
+
+    const T& Head(size_t source) const { return buffers_[source][positions_[source]]; }
+
+    void Refill(size_t source, size_t batch_size) {
+        buffers_[source].clear();
+        positions_[source] = 0;
+        if (batch_size == 1) {
+            auto value = sources_[source]->Next();
+            if (value.has_value()) {
+                buffers_[source].push_back(std::move(*value));
+            }
+        } else {
+            sources_[source]->NextBatch(buffers_[source], batch_size);
+        }
+    }
+
+    T PopWinner(size_t batch_size) {
+        size_t winner = losers_[0];
+        T result = std::move(buffers_[winner][positions_[winner]++]);
+        if (!HasHead(winner)) {
+            Refill(winner, batch_size);
+        }
+        // Leaves sit at nodes K..2K-1, inner node i plays the winners of nodes 2i and 2i+1
+        for (size_t node = (winner + sources_.size()) / 2; node > 0; node /= 2) {
+            if (Beats(losers_[node], winner)) {
+                std::swap(losers_[node], winner);
+            }
+        }
+        losers_[0] = winner;
+        return result;
+    }
+
+    // Plays the matches below the node, returns the winning source
+    size_t Play(size_t node) {
+        if (node >= sources_.size()) {
+            return node - sources_.size();
+        }
+        size_t left = Play(2 * node), right = Play(2 * node + 1);
+        if (Beats(right, left)) {
+            std::swap(left, right);
+        }
+        losers_[node] = right;
+        return left;
+    }
+
+    // Exhausted sources lose to everything, ties go to the lower source index
+    bool Beats(size_t first, size_t second) const {
+        if (!HasHead(first) || !HasHead(second)) {
+            return HasHead(first) || (!HasHead(second) && first < second);
+        }
+        if (comp_(Head(first), Head(second))) {
+            return true;
+        }
+        return !comp_(Head(second), Head(first)) && first < second;
+    }
 
-    std::multiset<std::pair<T, size_t>, BigCompare> heap_;
     std::vector<std::shared_ptr<IStream<T>>> sources_;
+    // Rows read from every source and not merged yet, empty once the source is exhausted
+    std::vector<std::vector<T>> buffers_;
+    std::vector<size_t> positions_;
+    // losers_[0] is the overall winner, losers_[i] the loser of the match at inner node i
+    std::vector<size_t> losers_;
     Compare comp_;
 };
 
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace lsm {
+
+// Where the work of the Get and Scan calls a thread makes goes, for logging the slow ones:
+//
+//     SetPerfContextEnabled(true);
+//     GetPerfContext().Reset();
+//     auto value = lsm->Get(key);
+//     if (slow) log(GetPerfContext().ToString());
+//
+// Counters add up until Reset. Only the calling thread's work is counted: background compactions
+// are not, compactions a Put runs inline are. While disabled nothing is recorded and no clock is read.
+struct PerfContext {
+    // Memtables looked into, the active one and those waiting for a flush
+    uint64_t memtables_probed = 0;
+    // Levels with a table that may hold the key, or with tables in range for a scan
+    uint64_t levels_probed = 0;
+    // Filter checks, the ones that let the table be read and the positives whose table did not hold the key
+    uint64_t filter_checks = 0;
+    uint64_t filter_positives = 0;
+    uint64_t filter_false_positives = 0;
+    uint64_t tables_opened = 0;
+    // Buffer pool frames found in memory (or in flight from a prefetch) and read from disk
+    uint64_t frame_hits = 0;
+    uint64_t frame_misses = 0;
+    // Bytes of table rows and offsets read, wherever they came from
+    uint64_t bytes_read = 0;
+
+    uint64_t memtable_nanos = 0;
+    // Reading and probing filters
+    uint64_t filter_nanos = 0;
+    // Searching tables for a key, including the frame reads
+    uint64_t table_nanos = 0;
+    // Reading missed frames from disk
+    uint64_t frame_read_nanos = 0;
+    // Picking the tables of a scan and opening its streams, then producing its rows
+    uint64_t scan_setup_nanos = 0;
+    uint64_t scan_next_nanos = 0;
+
+    void Reset() { *this = PerfContext(); }
+
+    std::string ToString() const {
+        std::string result;
+        auto add = [&result](const char* name, uint64_t value) {
+            result += (result.empty() ? "" : ", ") + std::string(name) + " = " + std::to_string(value);
+        };
+        add("memtables_probed", memtables_probed);
+        add("levels_probed", levels_probed);
+        add("filter_checks", filter_checks);
+        add("filter_positives", filter_positives);
+        add("filter_false_positives", filter_false_positives);
+        add("tables_opened", tables_opened);
+        add("frame_hits", frame_hits);
+        add("frame_misses", frame_misses);
+        add("bytes_read", bytes_read);
+        add("memtable_nanos", memtable_nanos);
+        add("filter_nanos", filter_nanos);
+        add("table_nanos", table_nanos);
+        add("frame_read_nanos", frame_read_nanos);
+        add("scan_setup_nanos", scan_setup_nanos);
+        add("scan_next_nanos", scan_next_nanos);
+        return result;
+    }
+};
+
+inline thread_local PerfContext perf_context;
+inline thread_local bool perf_context_enabled = false;
+
+// The calling thread's context
+inline PerfContext& GetPerfContext() { return perf_context; }
+
+inline void SetPerfContextEnabled(bool enabled) { perf_context_enabled = enabled; }
+
+inline bool PerfContextEnabled() { return perf_context_enabled; }
+
+inline void PerfCount(uint64_t PerfContext::*counter, uint64_t value = 1) {
+    if (perf_context_enabled) {
+        perf_context.*counter += value;
+    }
+}
+
+// Adds the time from construction to destruction to a field of the calling thread's context
+class PerfTimer {
+   public:
+    explicit PerfTimer(uint64_t PerfContext::*field) : field_(perf_context_enabled ? field : nullptr) {
+        if (field_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    PerfTimer(const PerfTimer&) = delete;
+    PerfTimer& operator=(const PerfTimer&) = delete;
+
+    ~PerfTimer() {
+        if (field_) {
+            perf_context.*field_ += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+        }
+    }
+
+   private:
+    uint64_t PerfContext::*field_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace lsm
@@ -1,14 +1,34 @@
 #pragma once
 
+#include <cstddef>
 #include <optional>
+#include <vector>
 
 namespace lsm {
 
+// Batch size bulk consumers (flushes, compactions, scans) ask their streams for
+inline constexpr size_t kStreamBatchSize = 256;
+
 template <typename T>
 class IStream {
    public:
     virtual std::optional<T> Next() = 0;
 
+    // Appends up to max elements to out and returns how many were appended, 0 once the
+    // stream is exhausted. Streams override it to hand out rows without a virtual call
+    // and an optional per row; Next and NextBatch calls may be interleaved.
+    virtual size_t NextBatch(std::vector<T>& out, size_t max) {
+        size_t count = 0;
+        for (; count < max; ++count) {
+            auto value = Next();
+            if (!value.has_value()) {
+                break;
+            }
+            out.push_back(std::move(*value));
+        }
+        return count;
+    }
+
     virtual ~IStream() = default;
 };
 
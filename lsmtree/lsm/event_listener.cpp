@@ -0,0 +1,114 @@
+#include <lsm/event_listener.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace lsm {
+
+namespace {
+
+// Keys are arbitrary bytes: printable ASCII is kept, the rest is escaped
+std::string JsonString(const UserKey& key) {
+    std::string result = "\"";
+    for (uint8_t byte : key) {
+        if (byte == '"' || byte == '\\') {
+            result += '\\';
+            result += static_cast<char>(byte);
+        } else if (byte >= 0x20 && byte < 0x7f) {
+            result += static_cast<char>(byte);
+        } else {
+            char escaped[7];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+            result += escaped;
+        }
+    }
+    return result + "\"";
+}
+
+std::string TableArgs(const TableInfo& info) {
+    return "{\"level\": " + std::to_string(info.level) + ", \"file_size\": " + std::to_string(info.metadata.file_size) + ", \"min_key\": " + JsonString(info.metadata.min_key) +
+           ", \"max_key\": " + JsonString(info.metadata.max_key) + "}";
+}
+
+std::string JobArgs(const CompactionJobInfo& info) {
+    auto tables = [](const std::vector<TableInfo>& tables) {
+        std::string result = "[";
+        for (const auto& table : tables) {
+            result += (result.size() == 1 ? "" : ", ") + TableArgs(table);
+        }
+        return result + "]";
+    };
+    return "{\"job_id\": " + std::to_string(info.job_id) + ", \"output_level\": " + std::to_string(info.output_level) + ", \"memtable_bytes\": " + std::to_string(info.memtable_bytes) +
+           ", \"bytes_read\": " + std::to_string(info.bytes_read) + ", \"bytes_written\": " + std::to_string(info.bytes_written) + ", \"input_tables\": " + tables(info.input_tables) +
+           ", \"output_tables\": " + tables(info.output_tables) + "}";
+}
+
+// Spans are written as complete events when they end, so events of different threads never need to nest.
+// Timestamps are microseconds since the listener was made.
+class ChromeTraceListener : public IEventListener {
+   public:
+    explicit ChromeTraceListener(const std::string& path) : file_(path, std::ios::trunc), start_(std::chrono::steady_clock::now()) {
+        if (!file_) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": can not open " + path);
+        }
+        file_ << "[";
+    }
+
+    void OnFlushCompleted(const CompactionJobInfo& info) override { Span("flush", info.duration_micros, JobArgs(info)); }
+
+    void OnCompactionCompleted(const CompactionJobInfo& info) override { Span("compaction L" + std::to_string(info.output_level), info.duration_micros, JobArgs(info)); }
+
+    void OnTableCreated(const TableInfo& info) override { Instant("table created", TableArgs(info)); }
+
+    void OnTableDeleted(const TableInfo& info) override { Instant("table deleted", TableArgs(info)); }
+
+    void OnWriteStallEnd(const WriteStallInfo& info) override {
+        Span(info.cause == WriteStallCause::kImmutableMemTables ? "write stall: immutable memtables" : "write stall: pending compaction bytes", info.duration_micros, "{}");
+    }
+
+    ~ChromeTraceListener() { file_ << "\n]\n"; }
+
+   private:
+    void Span(const std::string& name, uint64_t duration_micros, const std::string& args) {
+        std::lock_guard lock(mutex_);
+        uint64_t now = Now();
+        Write("{\"name\": \"" + name + "\", \"ph\": \"X\", \"ts\": " + std::to_string(now - std::min(now, duration_micros)) + ", \"dur\": " + std::to_string(duration_micros) +
+              ", \"pid\": 1, \"tid\": " + std::to_string(ThreadId()) + ", \"args\": " + args + "}");
+    }
+
+    void Instant(const std::string& name, const std::string& args) {
+        std::lock_guard lock(mutex_);
+        Write("{\"name\": \"" + name + "\", \"ph\": \"i\", \"s\": \"t\", \"ts\": " + std::to_string(Now()) + ", \"pid\": 1, \"tid\": " + std::to_string(ThreadId()) + ", \"args\": " + args + "}");
+    }
+
+    void Write(const std::string& event) {
+        file_ << (events_++ ? ",\n" : "\n") << event;
+        file_.flush();
+    }
+
+    uint64_t Now() const { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count(); }
+
+    // Threads are numbered in the order they first report an event
+    uint64_t ThreadId() { return thread_ids_.try_emplace(std::this_thread::get_id(), thread_ids_.size() + 1).first->second; }
+
+    std::mutex mutex_;
+    std::ofstream file_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t events_ = 0;
+    std::map<std::thread::id, uint64_t> thread_ids_;
+};
+
+}  // namespace
+
+std::shared_ptr<IEventListener> MakeChromeTraceListener(const std::string& path) { return std::make_shared<ChromeTraceListener>(path); }
+
+}  // namespace lsm
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <lsm/lsm.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lsm {
+
+struct TableInfo {
+    // Level the table is on, or is being pushed down to
+    size_t level = 0;
+    SSTableMetadata metadata;
+};
+
+// A flush merges a memtable into the first level with room for it, L0 as a rule, a compaction merges tables pushed
+// down from the level above into theirs. Outputs that do not fit on output_level are pushed on down and show up as
+// inputs of a later compaction.
+struct CompactionJobInfo {
+    uint64_t job_id = 0;
+    size_t output_level = 0;
+    // Bytes of the memtable a flush merges, 0 for compactions
+    uint64_t memtable_bytes = 0;
+    // Filled in on completion
+    std::vector<TableInfo> input_tables;
+    std::vector<TableInfo> output_tables;
+    // The memtable and the input tables, the output tables
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint64_t duration_micros = 0;
+};
+
+enum class WriteStallCause { kImmutableMemTables, kPendingCompactionBytes };
+
+struct WriteStallInfo {
+    WriteStallCause cause = WriteStallCause::kImmutableMemTables;
+    // Filled in when the stall ends
+    uint64_t duration_micros = 0;
+};
+
+// Callbacks on the flushes and compactions of an LSM-tree, made on the thread doing the work: the writer
+// when compactions run inline, a background thread otherwise. They may come from several threads at once
+// and with internal locks held, so they should be quick and must not call back into the LSM-tree.
+// Tables are created while a job runs and deleted once it completes, which is when reads find its outputs
+// in place of its inputs. Moving a table down is neither.
+class IEventListener {
+   public:
+    virtual void OnFlushBegin(const CompactionJobInfo& info) {}
+    virtual void OnFlushCompleted(const CompactionJobInfo& info) {}
+    virtual void OnCompactionBegin(const CompactionJobInfo& info) {}
+    virtual void OnCompactionCompleted(const CompactionJobInfo& info) {}
+    virtual void OnTableCreated(const TableInfo& info) {}
+    virtual void OnTableDeleted(const TableInfo& info) {}
+    // Put and Delete wait for the background jobs to catch up
+    virtual void OnWriteStallBegin(const WriteStallInfo& info) {}
+    virtual void OnWriteStallEnd(const WriteStallInfo& info) {}
+
+    virtual ~IEventListener() = default;
+};
+
+// Writes the events to path in the Chrome trace event format, for chrome://tracing or Perfetto: jobs
+// and stalls as spans on the threads that ran them, table creations and deletions as instants.
+// The file is complete once the listener is destroyed.
+std::shared_ptr<IEventListener> MakeChromeTraceListener(const std::string& path);
+
+}  // namespace lsm
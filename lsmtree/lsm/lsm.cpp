@@ -1,9 +1,17 @@
 #include "lsm/lsm.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <exception>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <utility>
@@ -12,35 +20,462 @@
 
 #include <lsm/storage/buffer_pool.h>
 #include <lsm/bloom_filter/bloom_filter.h>
+#include <lsm/bloom_filter/filter_allocation.h>
+#include <lsm/common/job_scheduler.h>
 #include <lsm/common/merge.h>
+#include <lsm/common/perf_context.h>
+#include <lsm/event_listener.h>
 #include <lsm/memtable.h>
 
 namespace lsm {
 
+template <typename Options>
+std::shared_ptr<storage::IFile> MakeTableFile(const Options& options, const std::string& dir, uint64_t table_id, const std::shared_ptr<storage::IReadBufferPool>& buffer_pool,
+                                              uint64_t* read_bytes) {
+    if (options.use_mmap) {
+        return std::make_shared<storage::MmapFile>(dir + "/sstable_" + std::to_string(table_id), read_bytes);
+    }
+    return std::make_shared<storage::BufferedMemoryFile>(dir, table_id, buffer_pool, options.frame_size, options.direct_io);
+}
+
+template <typename Options>
+storage::ReadBufferPoolOptions MakeBufferPoolOptions(const Options& options) {
+    storage::ReadBufferPoolOptions result;
+    result.pool_size = options.buffer_pool_size;
+    result.frame_size = options.frame_size;
+    result.max_open_files = options.max_open_files;
+    result.io_threads = options.io_threads;
+    result.readahead_frames = options.readahead_frames;
+    result.direct_io = options.direct_io;
+    result.shards = options.buffer_pool_shards;
+    result.huge_pages = options.huge_pages;
+    result.compressed_cache_size = options.compressed_cache_size;
+    return result;
+}
+
+// L0 is written by flushes, deeper levels by compactions
+storage::IoSource IoSourceOf(size_t level) { return level == 0 ? storage::IoSource::kFlush : storage::IoSource::kCompaction; }
+
+// A table as a flush or compaction reads or writes it: through the rate limiter, if there is one
+template <typename File>
+std::shared_ptr<File> RateLimited(std::shared_ptr<File> file, const std::shared_ptr<storage::IRateLimiter>& rate_limiter, storage::IoSource source) {
+    if (!rate_limiter) {
+        return file;
+    }
+    return std::make_shared<storage::RateLimitedFile>(std::move(file), rate_limiter, source);
+}
+
+template <typename Method, typename Info>
+void Notify(const std::vector<std::shared_ptr<IEventListener>>& listeners, Method method, const Info& info) {
+    for (const auto& listener : listeners) {
+        (listener.get()->*method)(info);
+    }
+}
+
+// A flush or compaction as the listeners see it: begun on construction, its inputs reported deleted once it finishes
+class CompactionJob {
+   public:
+    CompactionJob(const std::vector<std::shared_ptr<IEventListener>>& listeners, uint64_t job_id, size_t output_level, uint64_t memtable_bytes)
+        : listeners_(listeners), start_(std::chrono::steady_clock::now()) {
+        info_.job_id = job_id;
+        info_.output_level = output_level;
+        info_.memtable_bytes = memtable_bytes;
+        Notify(listeners_, IsFlush() ? &IEventListener::OnFlushBegin : &IEventListener::OnCompactionBegin, info_);
+    }
+
+    void AddInput(size_t level, const SSTableMetadata& meta) { info_.input_tables.push_back({level, meta}); }
+
+    void AddOutput(size_t level, const SSTableMetadata& meta) {
+        info_.output_tables.push_back({level, meta});
+        Notify(listeners_, &IEventListener::OnTableCreated, info_.output_tables.back());
+    }
+
+    void Finish() {
+        info_.bytes_read = info_.memtable_bytes;
+        for (const auto& table : info_.input_tables) {
+            info_.bytes_read += table.metadata.file_size;
+        }
+        for (const auto& table : info_.output_tables) {
+            info_.bytes_written += table.metadata.file_size;
+        }
+        info_.duration_micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+        Notify(listeners_, IsFlush() ? &IEventListener::OnFlushCompleted : &IEventListener::OnCompactionCompleted, info_);
+        for (const auto& table : info_.input_tables) {
+            Notify(listeners_, &IEventListener::OnTableDeleted, table);
+        }
+    }
+
+   private:
+    bool IsFlush() const { return info_.memtable_bytes != 0; }
+
+    const std::vector<std::shared_ptr<IEventListener>>& listeners_;
+    std::chrono::steady_clock::time_point start_;
+    CompactionJobInfo info_;
+};
+
+// Adds the entries and tombstones of rows written to a table to its metadata
+void CountEntries(const std::vector<std::pair<InternalKey, Value>>& objects, SSTableMetadata& meta) {
+    meta.entries += objects.size();
+    for (const auto& object : objects) {
+        meta.deletions += object.first.type == ValueType::kDeletion;
+    }
+}
+
+// Bytes a flush or compaction holds in memory before writing them out, counted into a total for as long as it holds them
+class TrackedBytes {
+   public:
+    explicit TrackedBytes(std::atomic<uint64_t>& total) : total_(total) {}
+
+    TrackedBytes(const TrackedBytes&) = delete;
+    TrackedBytes& operator=(const TrackedBytes&) = delete;
+
+    void Set(uint64_t bytes) {
+        total_ += bytes - bytes_;
+        bytes_ = bytes;
+    }
+
+    ~TrackedBytes() { total_ -= bytes_; }
+
+   private:
+    std::atomic<uint64_t>& total_;
+    uint64_t bytes_ = 0;
+};
+
+// Adds up LsmStats over memtables and tables, the live keys are estimated in Finish
+class StatsCollector {
+   public:
+    StatsCollector(storage::IReadBufferPool& buffer_pool, uint64_t builder_bytes) {
+        auto memory = buffer_pool.GetMemoryUsage();
+        stats_.buffer_pool_frame_bytes = memory.resident_bytes;
+        stats_.buffer_pool_capacity_bytes = memory.capacity_bytes;
+        stats_.compressed_cache_bytes = buffer_pool.GetCompressedCacheStats().bytes;
+        stats_.builder_bytes = builder_bytes;
+    }
+
+    void AddMemTable(const IMemTable& mem_table) {
+        stats_.memtable_bytes += mem_table.ApproximateMemoryUsage();
+        entries_ += mem_table.NumEntries();
+        deletions_ += mem_table.NumDeletions();
+    }
+
+    void AddTable(const SSTableMetadata& meta) {
+        stats_.table_metadata_bytes += sizeof(SSTableMetadata) + meta.min_key.size() + meta.max_key.size();
+        entries_ += meta.entries;
+        deletions_ += meta.deletions;
+    }
+
+    void AddLevels(const ILevelsProvider& levels) {
+        stats_.levels.resize(std::max(stats_.levels.size(), levels.NumLevels()));
+        for (size_t lvl = 0; lvl < levels.NumLevels(); ++lvl) {
+            for (size_t ind = 0; ind < levels.NumTables(lvl); ++ind) {
+                auto meta = levels.GetTableMetadata(lvl, ind);
+                ++stats_.levels[lvl].tables;
+                stats_.levels[lvl].bytes += meta.has_value() ? meta->file_size : levels.GetTableFile(lvl, ind)->Size();
+                if (meta.has_value()) {
+                    AddTable(*meta);
+                }
+                if (auto filter = levels.GetTableBloomFilter(lvl, ind)) {
+                    stats_.filter_file_bytes += filter->Size();
+                }
+            }
+        }
+    }
+
+    LsmStats Finish() {
+        stats_.estimated_live_keys = entries_ > 2 * deletions_ ? entries_ - 2 * deletions_ : 0;
+        return std::move(stats_);
+    }
+
+   private:
+    LsmStats stats_;
+    uint64_t entries_ = 0;
+    uint64_t deletions_ = 0;
+};
+
+// Bits per key for the filters of new tables on the level. With monkey_filters the average of
+// bloom_bits_per_key is split across the nominal level capacities, down to the deepest level in use.
+template <typename Options>
+double FilterBitsPerKey(const Options& options, size_t level, size_t levels) {
+    if (!options.monkey_filters) {
+        return options.bloom_bits_per_key;
+    }
+    std::vector<double> level_tables;
+    for (size_t lvl = 0, capacity = options.l0_capacity; lvl < std::max(levels, level + 1); ++lvl, capacity *= options.level_size_multiplier) {
+        level_tables.push_back(capacity);
+    }
+    return AllocateFilterBitsPerKey(level_tables, options.bloom_bits_per_key)[level];
+}
+
+// Filter builder for a new table on the level: fuse filters from fuse_filter_min_level down, bloom above
+template <typename Options>
+std::shared_ptr<IFilterBuilder> MakeTableFilterBuilder(const Options& options, size_t level, size_t levels) {
+    std::shared_ptr<IFilterBuilder> builder;
+    if (level >= options.fuse_filter_min_level) {
+        builder = MakeFuseFilterBuilder();
+    } else {
+        builder = MakeBlockedFilterBuilderByBitsPerKey(FilterBitsPerKey(options, level, levels), options.bloom_filter_hash_count, 8ull * options.bloom_filter_size);
+    }
+    if (options.range_filter_prefix_length != 0) {
+        return MakePrefixFilterBuilder(builder, options.range_filter_prefix_length);
+    }
+    return builder;
+}
+
+// How MakeTableFilterBuilder builds the filters of the level, a table moved to a level with the same spec keeps its filter
+struct FilterSpec {
+    bool fuse = false;
+    double bits_per_key = 0;
+
+    bool operator==(const FilterSpec&) const = default;
+};
+
+template <typename Options>
+FilterSpec TableFilterSpec(const Options& options, size_t level, size_t levels) {
+    if (level >= options.fuse_filter_min_level) {
+        return {true, 0};
+    }
+    return {false, FilterBitsPerKey(options, level, levels)};
+}
+
+// A table on its way down the levels with the filter it was built with, null when filters are disabled
+struct PushedTable {
+    std::shared_ptr<storage::IFile> file;
+    SSTableMetadata meta;
+    std::shared_ptr<storage::MemoryFile> filter;
+    FilterSpec filter_spec;
+};
+
+// Tables a compaction pushes on to the next level: the ones passing through the full level and the merge
+// outputs that did not fit on it. Neither run has overlapping tables, but their key ranges may interleave.
+struct PushedRuns {
+    std::vector<PushedTable> passing;
+    std::vector<PushedTable> merged;
+};
+
+// Lookups of Get and Scan, counted in the calling thread's PerfContext
+IMemTable::GetKind GetFromMemTable(const IMemTable& mem_table, const UserKey& user_key, Value* value, uint64_t sequence_number) {
+    PerfCount(&PerfContext::memtables_probed);
+    PerfTimer timer(&PerfContext::memtable_nanos);
+    return mem_table.Get(user_key, value, sequence_number);
+}
+
+bool TableFilterMayContain(const IFilterDeserializer& filter_deserializer, const storage::IFile& filter_file, const UserKey& key) {
+    PerfCount(&PerfContext::filter_checks);
+    PerfTimer timer(&PerfContext::filter_nanos);
+    if (!filter_deserializer.Deserialize(filter_file.Read(0, filter_file.Size()))->MayContain(key)) {
+        return false;
+    }
+    PerfCount(&PerfContext::filter_positives);
+    return true;
+}
+
+ISSTableReader::GetKind GetFromTable(const ISSTableSerializer& sstable_factory, const std::shared_ptr<const storage::IFile>& file, const UserKey& user_key, Value* value,
+                                     uint64_t sequence_number) {
+    PerfCount(&PerfContext::tables_opened);
+    PerfTimer timer(&PerfContext::table_nanos);
+    return sstable_factory.FromFile(file)->Get(user_key, value, sequence_number);
+}
+
+// Files of the level's tables that may hold keys in [start_key, end_key): tables whose key range
+// misses the bounds are dropped, then those whose filter rejects the prefix both bounds share
+std::vector<std::shared_ptr<const storage::IFile>> TableFilesInRange(const ILevelsProvider& levels_provider, size_t level, const std::optional<UserKey>& start_key,
+                                                                     const std::optional<UserKey>& end_key, const std::optional<UserKey>& prefix,
+                                                                     const IFilterDeserializer& filter_deserializer) {
+    std::vector<std::shared_ptr<const storage::IFile>> files;
+    for (size_t ind = 0; ind < levels_provider.NumTables(level); ++ind) {
+        auto meta = levels_provider.GetTableMetadata(level, ind);
+        if (meta.has_value() && ((start_key.has_value() && meta->max_key < *start_key) || (end_key.has_value() && meta->min_key >= *end_key))) {
+            continue;
+        }
+        if (prefix.has_value()) {
+            auto filter_file = levels_provider.GetTableBloomFilter(level, ind);
+            if (filter_file && !TableFilterMayContain(filter_deserializer, *filter_file, *prefix)) {
+                continue;
+            }
+        }
+        files.push_back(levels_provider.GetTableFile(level, ind));
+    }
+    return files;
+}
+
+// Position a table starting at key takes on the level: the first table whose max_key is not below key
+size_t TablePosition(const ILevelsProvider& levels_provider, size_t level, const UserKey& key) {
+    size_t l = 0, r = levels_provider.NumTables(level);
+    while (l < r) {
+        size_t ind = (l + r) / 2;
+        auto meta = levels_provider.GetTableMetadata(level, ind);
+        if (meta.has_value() && meta->max_key < key) {
+            l = ind + 1;
+        } else {
+            r = ind;
+        }
+    }
+    return l;
+}
+
+// Whether a table with the metadata can be put on the level as it is, overlapping no table there
+bool OverlapsNoTable(const ILevelsProvider& levels_provider, size_t level, const SSTableMetadata& meta) {
+    size_t position = TablePosition(levels_provider, level, meta.min_key);
+    if (position == levels_provider.NumTables(level)) {
+        return true;
+    }
+    auto next = levels_provider.GetTableMetadata(level, position);
+    return next.has_value() && meta.max_key < next->min_key;
+}
+
+// Bytes of the grandparent level (two levels below the outputs) an output table overlaps, counted
+// over the grandparent tables its keys have passed, as RocksDB does for max_grandparent_overlap_bytes
+class GrandparentOverlap {
+   public:
+    GrandparentOverlap(const ILevelsProvider& levels_provider, size_t level, uint64_t max_bytes) : max_bytes_(max_bytes) {
+        if (max_bytes_ == 0 || level + 2 >= levels_provider.NumLevels()) {
+            return;
+        }
+        for (size_t ind = 0; ind < levels_provider.NumTables(level + 2); ++ind) {
+            if (auto meta = levels_provider.GetTableMetadata(level + 2, ind); meta.has_value()) {
+                tables_.push_back(std::move(*meta));
+            }
+        }
+    }
+
+    // Whether the output should end before key, keys come in ascending order
+    bool ShouldStopBefore(const UserKey& key) {
+        while (ind_ < tables_.size() && tables_[ind_].max_key < key) {
+            if (seen_key_) {
+                overlapped_bytes_ += tables_[ind_].file_size;
+            }
+            ++ind_;
+        }
+        seen_key_ = true;
+        return max_bytes_ != 0 && overlapped_bytes_ > max_bytes_;
+    }
+
+    // A new output starts
+    void Reset() { overlapped_bytes_ = 0; }
+
+   private:
+    uint64_t max_bytes_;
+    std::vector<SSTableMetadata> tables_;
+    size_t ind_ = 0;
+    bool seen_key_ = false;
+    uint64_t overlapped_bytes_ = 0;
+};
+
+// Copy of one level that a background compaction works on without holding the LSM lock, along with the
+// metadata of the level two below for GrandparentOverlap. Changes to the level are recorded and replayed
+// on the levels provider by Apply: the compaction of a level is the only one changing it.
+class LevelEdit final : public ILevelsProvider {
+   public:
+    LevelEdit(const ILevelsProvider& levels_provider, size_t level) : level_(level), num_levels_(levels_provider.NumLevels()) {
+        for (size_t ind = 0; ind < levels_provider.NumTables(level); ++ind) {
+            files_.push_back(levels_provider.GetTableFile(level, ind));
+            filters_.push_back(levels_provider.GetTableBloomFilter(level, ind));
+            metadata_.push_back(levels_provider.GetTableMetadata(level, ind));
+        }
+        for (size_t ind = 0; ind < levels_provider.NumTables(level + 2); ++ind) {
+            grandparents_.push_back(levels_provider.GetTableMetadata(level + 2, ind));
+        }
+    }
+
+    size_t NumLevels() const override { return num_levels_; }
+
+    size_t NumTables(size_t level_index) const override { return level_index == level_ + 2 ? grandparents_.size() : Tables(level_index).size(); }
+
+    std::shared_ptr<const storage::IFile> GetTableFile(size_t level_index, size_t table_index) const override { return Tables(level_index).at(table_index); }
+
+    void InsertTableFile(size_t level_index, size_t table_index, std::shared_ptr<const storage::IFile> file, std::shared_ptr<const storage::IFile> bloom_filter,
+                         std::optional<SSTableMetadata> metadata = std::nullopt) override {
+        Tables(level_index);
+        files_.insert(files_.begin() + table_index, file);
+        filters_.insert(filters_.begin() + table_index, bloom_filter);
+        metadata_.insert(metadata_.begin() + table_index, metadata);
+        num_levels_ = std::max(num_levels_, level_ + 1);
+        changes_.push_back({table_index, std::move(file), std::move(bloom_filter), std::move(metadata)});
+    }
+
+    void EraseTable(size_t level_index, size_t table_index) override {
+        Tables(level_index);
+        files_.erase(files_.begin() + table_index);
+        filters_.erase(filters_.begin() + table_index);
+        metadata_.erase(metadata_.begin() + table_index);
+        changes_.push_back({table_index, nullptr, nullptr, std::nullopt});
+    }
+
+    std::optional<SSTableMetadata> GetTableMetadata(size_t level_index, size_t table_index) const override {
+        if (level_index == level_ + 2) {
+            return grandparents_.at(table_index);
+        }
+        return Tables(level_index).size() > table_index ? metadata_[table_index] : std::nullopt;
+    }
+
+    std::shared_ptr<const storage::IFile> GetTableBloomFilter(size_t level_index, size_t table_index) const override {
+        Tables(level_index);
+        return filters_.at(table_index);
+    }
+
+    void Apply(ILevelsProvider& levels_provider) const {
+        for (const auto& change : changes_) {
+            if (change.file) {
+                levels_provider.InsertTableFile(level_, change.table_index, change.file, change.bloom_filter, change.metadata);
+            } else {
+                levels_provider.EraseTable(level_, change.table_index);
+            }
+        }
+    }
+
+   private:
+    // An erasure when file is null
+    struct Change {
+        size_t table_index;
+        std::shared_ptr<const storage::IFile> file;
+        std::shared_ptr<const storage::IFile> bloom_filter;
+        std::optional<SSTableMetadata> metadata;
+    };
+
+    const std::vector<std::shared_ptr<const storage::IFile>>& Tables(size_t level_index) const {
+        if (level_index != level_) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": level " + std::to_string(level_index) + " is not copied, only level " + std::to_string(level_) + " is");
+        }
+        return files_;
+    }
+
+    size_t level_;
+    size_t num_levels_;
+    std::vector<std::shared_ptr<const storage::IFile>> files_;
+    std::vector<std::shared_ptr<const storage::IFile>> filters_;
+    std::vector<std::optional<SSTableMetadata>> metadata_;
+    std::vector<std::optional<SSTableMetadata>> grandparents_;
+    std::vector<Change> changes_;
+};
+
 class SimpleLSMImpl : public ILSM {
 
    public:
     SimpleLSMImpl(const LsmOptions& options, std::shared_ptr<ILevelsProvider> levels_provider, std::shared_ptr<ISSTableSerializer> sstable_factory, uint64_t* read_bytes)
-        : options_(options), levels_provider_(levels_provider), sstable_factory_(sstable_factory) {
+        : options_(options), levels_provider_(levels_provider), sstable_factory_(sstable_factory), read_bytes_(read_bytes) {
         mem_table_ = MakeMemTable(options_.max_level_skip_list);
         std::filesystem::create_directory(dir_);
-        buffer_pool_ = storage::MakeReadBufferPool(dir_, options_.buffer_pool_size, options_.frame_size, read_bytes);
+        buffer_pool_ = storage::MakeReadBufferPool(dir_, MakeBufferPoolOptions(options_), read_bytes);
     }
 
-    void Put(const UserKey& user_key, const Value& value) {
-        mem_table_->Add(++sequence_number_, user_key, value);
+    void Put(const UserKey& user_key, const Value& value) { Put(UserKey(user_key), Value(value)); }
+
+    void Put(UserKey&& user_key, Value&& value) {
+        mem_table_->Add(++sequence_number_, std::move(user_key), std::move(value));
         CheckMemTable();
     }
 
-    void Delete(const UserKey& user_key) {
-        mem_table_->Delete(++sequence_number_, user_key);
+    void Delete(const UserKey& user_key) { Delete(UserKey(user_key)); }
+
+    void Delete(UserKey&& user_key) {
+        mem_table_->Delete(++sequence_number_, std::move(user_key));
         CheckMemTable();
     }
 
     void CheckMemTable() {
         if (mem_table_->ApproximateMemoryUsage() > options_.memtable_bytes) {
-            std::shared_ptr<storage::IFile> file = std::make_shared<storage::BufferedMemoryFile>(dir_, sstable_sequence_number_++, buffer_pool_, options_.frame_size);
-            auto sstable_builder = sstable_factory_->NewFileBuilder(file);
+            std::shared_ptr<storage::IFile> file = MakeTableFile(options_, dir_, sstable_sequence_number_++, buffer_pool_, read_bytes_);
+            auto sstable_builder = sstable_factory_->NewFileBuilder(RateLimited(file, options_.rate_limiter, storage::IoSource::kFlush));
             auto scan = mem_table_->MakeScan();
             auto object = scan->Next();
             std::optional<SSTableMetadata> meta = std::nullopt;
@@ -49,10 +484,17 @@ class SimpleLSMImpl : public ILSM {
                 meta->min_key = object->first.user_key;
             }
 
-            while (object.has_value()) {
+            if (object.has_value()) {
                 sstable_builder->Add(object->first, object->second);
                 meta->max_key = object->first.user_key;
-                object = scan->Next();
+                CountEntries({*object}, *meta);
+            }
+            std::vector<std::pair<InternalKey, Value>> batch;
+            while (scan->NextBatch(batch, kStreamBatchSize)) {
+                sstable_builder->AddBatch(batch);
+                meta->max_key = batch.back().first.user_key;
+                CountEntries(batch, *meta);
+                batch.clear();
             }
             sstable_builder->Finish();
             if (meta.has_value()) {
@@ -77,7 +519,7 @@ class SimpleLSMImpl : public ILSM {
 
     std::pair<std::shared_ptr<storage::IFile>, std::optional<SSTableMetadata>> MergeSSTables(const std::shared_ptr<const storage::IFile>& file1, const std::optional<SSTableMetadata>& meta1,
                                                                                              const std::shared_ptr<const storage::IFile>& file2, const std::optional<SSTableMetadata>& meta2) {
-        auto file = std::make_shared<storage::BufferedMemoryFile>(dir_, sstable_sequence_number_++, buffer_pool_, options_.frame_size);
+        auto file = MakeTableFile(options_, dir_, sstable_sequence_number_++, buffer_pool_, read_bytes_);
         std::optional<SSTableMetadata> meta = std::nullopt;
         if (meta1.has_value() && meta2.has_value()) {
             meta = SSTableMetadata();
@@ -88,21 +530,25 @@ class SimpleLSMImpl : public ILSM {
         } else if (meta2.has_value()) {
             meta = meta2;
         }
+        SSTableMetadata counts;
 
-        auto reader1 = sstable_factory_->FromFile(file1)->MakeScan();
-        auto reader2 = sstable_factory_->FromFile(file2)->MakeScan();
+        auto reader1 = sstable_factory_->FromFile(RateLimited(file1, options_.rate_limiter, storage::IoSource::kCompaction))->MakeScan();
+        auto reader2 = sstable_factory_->FromFile(RateLimited(file2, options_.rate_limiter, storage::IoSource::kCompaction))->MakeScan();
 
         auto merge_scan = MakeMerger<std::pair<InternalKey, Value>>({reader1, reader2});
-        auto builder = sstable_factory_->NewFileBuilder(file);
-        auto object = merge_scan->Next();
-        while (object.has_value()) {
-            builder->Add(object->first, object->second);
-            object = merge_scan->Next();
+        auto builder = sstable_factory_->NewFileBuilder(RateLimited(file, options_.rate_limiter, storage::IoSource::kCompaction));
+        std::vector<std::pair<InternalKey, Value>> batch;
+        while (merge_scan->NextBatch(batch, kStreamBatchSize)) {
+            builder->AddBatch(batch);
+            CountEntries(batch, counts);
+            batch.clear();
         }
         builder->Finish();
 
         if (meta.has_value()) {
             meta->file_size = file->Size();
+            meta->entries = counts.entries;
+            meta->deletions = counts.deletions;
         }
 
         return {file, meta};
@@ -110,7 +556,7 @@ class SimpleLSMImpl : public ILSM {
 
     std::optional<Value> Get(const UserKey& user_key, uint64_t sequence_number = std::numeric_limits<uint64_t>::max()) const {
         Value value;
-        auto type = mem_table_->Get(user_key, &value, sequence_number);
+        auto type = GetFromMemTable(*mem_table_, user_key, &value, sequence_number);
         if (type == IMemTable::GetKind::kFound) {
             return value;
         } else if (type == IMemTable::GetKind::kDeletion) {
@@ -124,9 +570,9 @@ class SimpleLSMImpl : public ILSM {
                 if (!meta.has_value() || meta->max_key < user_key || user_key < meta->min_key) {
                     continue;
                 }
-                auto sstable_reader = sstable_factory_->FromFile(levels_provider_->GetTableFile(lvl, 0));
+                PerfCount(&PerfContext::levels_probed);
                 Value value;
-                auto type = sstable_reader->Get(user_key, &value, sequence_number);
+                auto type = GetFromTable(*sstable_factory_, levels_provider_->GetTableFile(lvl, 0), user_key, &value, sequence_number);
                 if (type == ISSTableReader::GetKind::kFound) {
                     return value;
                 } else if (type == ISSTableReader::GetKind::kDeletion) {
@@ -139,11 +585,19 @@ class SimpleLSMImpl : public ILSM {
 
     std::shared_ptr<IStream<std::pair<UserKey, Value>>> Scan(const std::optional<UserKey>& start_key, const std::optional<UserKey>& end_key,
                                                              uint64_t sequence_number = std::numeric_limits<uint64_t>::max()) const {
+        PerfTimer timer(&PerfContext::scan_setup_nanos);
         return std::make_shared<SimpleLSMStream>(mem_table_, levels_provider_, sstable_factory_, start_key, end_key, sequence_number);
     }
 
     virtual uint64_t GetCurrentSequenceNumber() const { return sequence_number_; }
 
+    LsmStats GetStats() const {
+        StatsCollector stats(*buffer_pool_, 0);
+        stats.AddMemTable(*mem_table_);
+        stats.AddLevels(*levels_provider_);
+        return stats.Finish();
+    }
+
     virtual ~SimpleLSMImpl() {
         std::filesystem::remove_all(dir_);
     }
@@ -155,6 +609,7 @@ class SimpleLSMImpl : public ILSM {
                         const std::optional<UserKey>& start_key, const std::optional<UserKey>& end_key, uint64_t sequence_number)
             : sequence_number_(sequence_number), start_key_(start_key), end_key_(end_key) {
             std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources;
+            PerfCount(&PerfContext::memtables_probed);
             sources.push_back(mem_table->MakeScan());
             for (size_t lvl = 0; lvl < levels_provider->NumLevels(); ++lvl) {
                 if (levels_provider->NumTables(lvl)) {
@@ -165,6 +620,8 @@ class SimpleLSMImpl : public ILSM {
                     auto start_key = start_key_.has_value() ? *start_key_ : meta->min_key;
                     auto end_key = end_key_.has_value() ? *end_key_ : meta->max_key;
                     if (meta->Overlaps(start_key, end_key)) {
+                        PerfCount(&PerfContext::levels_probed);
+                        PerfCount(&PerfContext::tables_opened);
                         sources.push_back(sstable_factory->FromFile(levels_provider->GetTableFile(lvl, 0))->MakeScan());
                     }
                 }
@@ -173,13 +630,14 @@ class SimpleLSMImpl : public ILSM {
         }
 
         std::optional<std::pair<UserKey, Value>> Next() {
+            PerfTimer timer(&PerfContext::scan_next_nanos);
             std::optional<std::pair<InternalKey, Value>> object;
             do {
                 do {
-                    object = merge_scan_->Next();
+                    object = NextMerged();
                     if (start_key_.has_value()) {
                         while (object.has_value() && object->first.user_key < *start_key_) {
-                            object = merge_scan_->Next();
+                            object = NextMerged();
                         }
                     }
                     if (!object.has_value() || (end_key_.has_value() && object->first.user_key >= *end_key_)) {
@@ -195,7 +653,23 @@ class SimpleLSMImpl : public ILSM {
         }
 
        private:
+        // Rows come from the merger in batches that grow from 16 rows, so short scans read little ahead
+        std::optional<std::pair<InternalKey, Value>> NextMerged() {
+            if (batch_position_ == batch_.size()) {
+                batch_.clear();
+                batch_position_ = 0;
+                if (merge_scan_->NextBatch(batch_, batch_size_) == 0) {
+                    return std::nullopt;
+                }
+                batch_size_ = std::min(2 * batch_size_, kStreamBatchSize);
+            }
+            return std::move(batch_[batch_position_++]);
+        }
+
         UserKey used_ = {};
+        std::vector<std::pair<InternalKey, Value>> batch_;
+        size_t batch_position_ = 0;
+        size_t batch_size_ = 16;
         std::shared_ptr<IMerger<std::pair<InternalKey, Value>>> merge_scan_;
         uint64_t sequence_number_;
         std::optional<UserKey> start_key_;
@@ -211,132 +685,344 @@ class SimpleLSMImpl : public ILSM {
     std::shared_ptr<ILevelsProvider> levels_provider_;
     std::shared_ptr<ISSTableSerializer> sstable_factory_;
     std::shared_ptr<storage::IReadBufferPool> buffer_pool_;
+    uint64_t* read_bytes_;
 };
 
 class GranularLSMImpl : public ILSM {
    public:
     GranularLSMImpl(const GranularLsmOptions& options, std::shared_ptr<ILevelsProvider> levels_provider, std::shared_ptr<ISSTableSerializer> sstable_factory, uint64_t* read_bytes)
-        : options_(options), levels_provider_(levels_provider), sstable_factory_(sstable_factory) {
+        : options_(options), levels_provider_(levels_provider), sstable_factory_(sstable_factory), read_bytes_(read_bytes) {
         mem_table_ = MakeMemTable(options_.max_level_skip_list);
         std::filesystem::create_directory(dir_);
-        buffer_pool_ = storage::MakeReadBufferPool(dir_, options_.buffer_pool_size, options_.frame_size, read_bytes);
+        buffer_pool_ = storage::MakeReadBufferPool(dir_, MakeBufferPoolOptions(options_), read_bytes);
+        if (options_.compaction_threads != 0) {
+            scheduler_ = std::make_unique<JobScheduler>(1, options_.compaction_threads);
+        }
     }
 
-    void Put(const UserKey& user_key, const Value& value) {
-        mem_table_->Add(++sequence_number_, user_key, value);
+    void Put(const UserKey& user_key, const Value& value) { Put(UserKey(user_key), Value(value)); }
+
+    void Put(UserKey&& user_key, Value&& value) {
+        mem_table_->Add(++sequence_number_, std::move(user_key), std::move(value));
         CheckMemTable();
     }
 
-    void Delete(const UserKey& user_key) {
-        mem_table_->Delete(++sequence_number_, user_key);
+    void Delete(const UserKey& user_key) { Delete(UserKey(user_key)); }
+
+    void Delete(UserKey&& user_key) {
+        mem_table_->Delete(++sequence_number_, std::move(user_key));
         CheckMemTable();
     }
 
     void CheckMemTable() {
         if (mem_table_->ApproximateMemoryUsage() > options_.memtable_bytes) {
+            if (scheduler_) {
+                std::unique_lock lock(mutex_);
+                if (auto cause = StallCause(); cause.has_value() && !background_error_) {
+                    WriteStallInfo stall = {*cause};
+                    Notify(options_.listeners, &IEventListener::OnWriteStallBegin, stall);
+                    auto start = std::chrono::steady_clock::now();
+                    cv_.wait(lock, [this] { return background_error_ || !StallCause().has_value(); });
+                    stall.duration_micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+                    Notify(options_.listeners, &IEventListener::OnWriteStallEnd, stall);
+                }
+                if (background_error_) {
+                    std::rethrow_exception(background_error_);
+                }
+                inputs_[0].push_back({mem_table_, {}, mem_table_->ApproximateMemoryUsage()});
+                mem_table_ = MakeMemTable(options_.max_level_skip_list);
+                ScheduleCompactions();
+                return;
+            }
             std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources(1, mem_table_->MakeScan());
+            uint64_t memtable_bytes = mem_table_->ApproximateMemoryUsage();
+            // Tables pushed down from the level above, no two of them hold the same key
+            std::vector<PushedTable> pushed;
             mem_table_ = MakeMemTable(options_.max_level_skip_list);
-            for (size_t lvl = 0, max_tables = options_.l0_capacity; !sources.empty(); ++lvl, max_tables *= options_.level_size_multiplier) {
-                auto main_scan = MakeMerger(sources);
-                sources.resize(0);
-                if (levels_provider_->NumTables(lvl)) {
-                    size_t ind = 0;
-                    auto object = main_scan->Next();
-                    while (ind < levels_provider_->NumTables(lvl)) {
-                        std::optional<UserKey> end_key = std::nullopt;
-                        if (ind + 1 < levels_provider_->NumTables(lvl)) {
-                            end_key = levels_provider_->GetTableMetadata(lvl, ind)->max_key;
-                        }
+            for (size_t lvl = 0; !sources.empty() || !pushed.empty(); ++lvl) {
+                std::optional<CompactionJob> job;
+                auto runs = CompactLevel(*levels_provider_, lvl, std::move(sources), std::move(pushed), memtable_bytes, job);
+                if (job) {
+                    job->Finish();
+                }
+                pushed = std::move(runs.passing);
+                pushed.insert(pushed.end(), std::make_move_iterator(runs.merged.begin()), std::make_move_iterator(runs.merged.end()));
+                sources.clear();
+                memtable_bytes = 0;
+            }
+        }
+    }
 
-                        std::vector<std::pair<InternalKey, Value>> merge_objects;
-                        while (object.has_value() && (!end_key.has_value() || object->first.user_key <= *end_key)) {
-                            merge_objects.push_back(*object);
-                            object = main_scan->Next();
-                        }
+    void WaitForCompactions() {
+        if (!scheduler_) {
+            return;
+        }
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return background_error_ || std::all_of(inputs_.begin(), inputs_.end(), [](const auto& inputs) { return inputs.empty(); }); });
+        if (background_error_) {
+            std::rethrow_exception(background_error_);
+        }
+    }
 
-                        if (merge_objects.empty()) {
-                            if (!object.has_value()) {
-                                break;
-                            }
-                            ++ind;
-                            continue;
-                        }
-                        auto vector_scan = std::make_shared<StreamFromVector>(merge_objects);
-
-                        auto sstable_scan = sstable_factory_->FromFile(levels_provider_->GetTableFile(lvl, ind))->MakeScan();
-
-                        levels_provider_->EraseTable(lvl, ind);
-
-                        auto files = GetFilesSplitByKeys(MakeMerger<std::pair<InternalKey, Value>>({vector_scan, sstable_scan}), max_tables - 1);
-                        for (auto [sf_files, meta] : files) {
-                            auto [file, filter_builder] = sf_files;
-                            if (levels_provider_->NumTables(lvl) + 1 == max_tables) {
-                                sources.push_back(sstable_factory_->FromFile(file)->MakeScan());
-                                continue;
-                            }
-                            if (options_.bloom_filter_size != 0) {
-                                auto filter_file = std::make_shared<storage::MemoryFile>(dir_ + "/filter_" + std::to_string(filter_sequence_number_++));
-                                auto serialized_filter = filter_builder->Serialize();
-                                filter_file->Write(serialized_filter.data(), serialized_filter.size());
-                                levels_provider_->InsertTableFile(lvl, ind++, file, filter_file, meta);
-                            } else {
-                                levels_provider_->InsertTableFile(lvl, ind++, file, nullptr, meta);
-                            }
-                        }
-                    }
-                } else {
-                    size_t ind = 0;
-                    auto files = GetFilesSplitByKeys(main_scan, max_tables - 1);
-                    for (auto [sf_files, meta] : files) {
-                        auto [file, filter_builder] = sf_files;
-                        if (levels_provider_->NumTables(lvl) + 1 == max_tables) {
-                            sources.push_back(sstable_factory_->FromFile(file)->MakeScan());
-                            continue;
-                        }
-                        if (options_.bloom_filter_size != 0) {
-                            auto filter_file = std::make_shared<storage::MemoryFile>(dir_ + "/filter_" + std::to_string(filter_sequence_number_++));
-                            auto serialized_filter = filter_builder->Serialize();
-                            filter_file->Write(serialized_filter.data(), serialized_filter.size());
-                            levels_provider_->InsertTableFile(lvl, ind++, file, filter_file, meta);
-                        } else {
-                            levels_provider_->InsertTableFile(lvl, ind++, file, nullptr, meta);
-                        }
-                    }
+    // Why writes have to wait for the background jobs, if they do. Called under mutex_.
+    std::optional<WriteStallCause> StallCause() const {
+        if (inputs_[0].size() >= std::max<uint32_t>(options_.max_immutable_memtables, 1)) {
+            return WriteStallCause::kImmutableMemTables;
+        }
+        if (options_.pending_compaction_bytes_limit != 0 && scheduler_->PendingCompactionBytes() >= options_.pending_compaction_bytes_limit) {
+            return WriteStallCause::kPendingCompactionBytes;
+        }
+        return std::nullopt;
+    }
+
+    // Maximum number of tables on the level
+    size_t LevelCapacity(size_t level) const {
+        size_t max_tables = options_.l0_capacity;
+        for (size_t lvl = 0; lvl < level; ++lvl) {
+            max_tables *= options_.level_size_multiplier;
+        }
+        return max_tables;
+    }
+
+    // Merges the sources and the tables pushed from the level above into the level, returns the tables pushed on to the next one.
+    // Sources are the memtable of a flush, memtable_bytes its size. Sets job unless tables were only moved, the caller
+    // finishes it once the levels it reads from hold the outputs.
+    PushedRuns CompactLevel(ILevelsProvider& levels, size_t lvl, std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources, std::vector<PushedTable> pushed,
+                            uint64_t memtable_bytes, std::optional<CompactionJob>& job) {
+        size_t max_tables = LevelCapacity(lvl);
+        // A pushed table overlapping no table of the level is moved there as it is (trivial move).
+        // If the level is full it goes on down: the level holds none of its keys.
+        // Remainders under half a table are merged instead, so that moves do not fragment the level.
+        std::vector<PushedTable> passing;
+        std::vector<SSTableMetadata> merged;
+        for (auto& table : pushed) {
+            if (2 * table.meta.file_size < options_.max_sstable_size || !OverlapsNoTable(levels, lvl, table.meta)) {
+                sources.push_back(sstable_factory_->FromFile(RateLimited(table.file, options_.rate_limiter, IoSourceOf(lvl)))->MakeScan());
+                merged.push_back(table.meta);
+            } else if (levels.NumTables(lvl) + 1 < max_tables) {
+                levels.InsertTableFile(lvl, TablePosition(levels, lvl, table.meta.min_key), table.file, MakeMovedTableFilter(levels, table, lvl), table.meta);
+            } else {
+                passing.push_back(std::move(table));
+            }
+        }
+        PushedRuns runs = {std::move(passing), {}};
+        if (sources.empty()) {
+            return runs;
+        }
+
+        job.emplace(options_.listeners, next_job_id_++, lvl, memtable_bytes);
+        for (const auto& meta : merged) {
+            job->AddInput(lvl, meta);
+        }
+        auto main_scan = MakeMerger(sources);
+        size_t ind = 0;
+        auto object = main_scan->Next();
+        while (object.has_value()) {
+            if (ind == levels.NumTables(lvl)) {
+                // Keys past the last table become new tables without rewriting it, ascending keys are only appended
+                auto rest = MakeMerger<std::pair<InternalKey, Value>>({std::make_shared<StreamFromVector>(std::vector{*object}), main_scan});
+                InsertTables(levels, GetFilesSplitByKeys(levels, rest, lvl), lvl, max_tables, ind, runs.merged, *job);
+                break;
+            }
+            auto end_key = levels.GetTableMetadata(lvl, ind)->max_key;
+            std::vector<std::pair<InternalKey, Value>> merge_objects;
+            while (object.has_value() && object->first.user_key <= end_key) {
+                merge_objects.push_back(*object);
+                object = main_scan->Next();
+            }
+            if (merge_objects.empty()) {
+                ++ind;
+                continue;
+            }
+            auto vector_scan = std::make_shared<StreamFromVector>(merge_objects);
+            auto sstable_scan = sstable_factory_->FromFile(RateLimited(levels.GetTableFile(lvl, ind), options_.rate_limiter, IoSourceOf(lvl)))->MakeScan();
+            job->AddInput(lvl, *levels.GetTableMetadata(lvl, ind));
+            levels.EraseTable(lvl, ind);
+            InsertTables(levels, GetFilesSplitByKeys(levels, MakeMerger<std::pair<InternalKey, Value>>({vector_scan, sstable_scan}), lvl), lvl, max_tables, ind, runs.merged, *job);
+        }
+        return runs;
+    }
+
+    // Hands the level's waiting inputs to the scheduler, one compaction at a time per level. Compactions are
+    // ranked by the bytes waiting for the level over the capacity of the level above, the one out of L0
+    // goes first once tables pushed out of L0 make up half of l0_capacity. Called under mutex_.
+    void ScheduleCompactions() {
+        if (stopping_ || background_error_) {
+            return;
+        }
+        compacting_.resize(inputs_.size(), false);
+        for (size_t lvl = 0; lvl < inputs_.size(); ++lvl) {
+            if (inputs_[lvl].empty() || compacting_[lvl]) {
+                continue;
+            }
+            compacting_[lvl] = true;
+            if (lvl == 0) {
+                scheduler_->ScheduleFlush([this] { RunCompaction(0); });
+                continue;
+            }
+            uint64_t bytes = 0;
+            size_t tables = 0;
+            for (const auto& input : inputs_[lvl]) {
+                bytes += input.bytes;
+                tables += input.tables.size();
+            }
+            double score = static_cast<double>(bytes) / (LevelCapacity(lvl - 1) * options_.max_sstable_size);
+            if (lvl == 1 && 2 * tables >= options_.l0_capacity) {
+                score = std::numeric_limits<double>::infinity();
+            }
+            scheduler_->ScheduleCompaction(score, [this, lvl] { RunCompaction(lvl); });
+        }
+    }
+
+    // Merges the oldest input of the level on a copy of it, then installs the result under mutex_.
+    // Until then readers find the input where it waits.
+    void RunCompaction(size_t lvl) {
+        try {
+            LevelInput input;
+            std::unique_ptr<LevelEdit> edit;
+            {
+                std::lock_guard lock(mutex_);
+                if (stopping_) {
+                    return;
                 }
+                input = inputs_[lvl].front();
+                edit = std::make_unique<LevelEdit>(*levels_provider_, lvl);
+            }
+            std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources;
+            if (input.mem_table) {
+                sources.push_back(input.mem_table->MakeScan());
+            }
+            std::optional<CompactionJob> job;
+            auto runs = CompactLevel(*edit, lvl, std::move(sources), input.tables, input.mem_table ? input.bytes : 0, job);
+
+            std::lock_guard lock(mutex_);
+            edit->Apply(*levels_provider_);
+            ++levels_version_;
+            inputs_[lvl].pop_front();
+            if (lvl != 0) {
+                scheduler_->RemovePendingCompactionBytes(input.bytes);
+            }
+            // Readers take every input for a sorted run, so the two runs are queued apart
+            AddInput(lvl + 1, std::move(runs.passing));
+            AddInput(lvl + 1, std::move(runs.merged));
+            // Listeners hear of the job once readers find its outputs and no longer its inputs
+            if (job) {
+                job->Finish();
+            }
+            compacting_[lvl] = false;
+            ScheduleCompactions();
+        } catch (...) {
+            std::lock_guard lock(mutex_);
+            if (!background_error_) {
+                background_error_ = std::current_exception();
+            }
+        }
+        cv_.notify_all();
+    }
+
+    // Queues a run of tables pushed down to the level, sorted so that readers can go through it in order. Called under mutex_.
+    void AddInput(size_t lvl, std::vector<PushedTable> tables) {
+        if (tables.empty()) {
+            return;
+        }
+        std::sort(tables.begin(), tables.end(), [](const auto& lhs, const auto& rhs) { return lhs.meta.min_key < rhs.meta.min_key; });
+        uint64_t bytes = 0;
+        for (const auto& table : tables) {
+            bytes += table.meta.file_size;
+        }
+        if (inputs_.size() <= lvl) {
+            inputs_.resize(lvl + 1);
+        }
+        inputs_[lvl].push_back({nullptr, std::move(tables), bytes});
+        scheduler_->AddPendingCompactionBytes(bytes);
+    }
+
+    // Puts new tables on the level from position ind on, the ones that do not fit are pushed down
+    void InsertTables(ILevelsProvider& levels, const std::vector<std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>>>& files,
+                      size_t lvl, size_t max_tables, size_t& ind, std::vector<PushedTable>& pushed, CompactionJob& job) {
+        for (auto [sf_files, meta] : files) {
+            auto [file, filter_builder] = sf_files;
+            if (levels.NumTables(lvl) + 1 == max_tables) {
+                job.AddOutput(lvl + 1, *meta);
+                pushed.push_back({file, *meta, WriteFilter(filter_builder), TableFilterSpec(options_, lvl, levels.NumLevels())});
+                continue;
+            }
+            job.AddOutput(lvl, *meta);
+            levels.InsertTableFile(lvl, ind++, file, WriteFilter(filter_builder), meta);
+        }
+    }
+
+    // Null when filters are disabled
+    std::shared_ptr<storage::MemoryFile> WriteFilter(const std::shared_ptr<IFilterBuilder>& filter_builder) {
+        if (!filter_builder) {
+            return nullptr;
+        }
+        auto filter_file = std::make_shared<storage::MemoryFile>(dir_ + "/filter_" + std::to_string(filter_sequence_number_++));
+        auto serialized_filter = filter_builder->Serialize();
+        filter_file->Write(serialized_filter.data(), serialized_filter.size());
+        return filter_file;
+    }
+
+    // Filters depend on the level: a moved table keeps its filter if the level builds them the same way,
+    // otherwise it gets a new one built from its keys
+    std::shared_ptr<storage::MemoryFile> MakeMovedTableFilter(const ILevelsProvider& levels, const PushedTable& table, size_t level) {
+        if (options_.bloom_filter_size == 0) {
+            return nullptr;
+        }
+        if (table.filter && table.filter_spec == TableFilterSpec(options_, level, levels.NumLevels())) {
+            return table.filter;
+        }
+
+        auto filter_builder = MakeTableFilterBuilder(options_, level, levels.NumLevels());
+        auto scan = sstable_factory_->FromFile(RateLimited(table.file, options_.rate_limiter, IoSourceOf(level)))->MakeScan();
+        std::vector<std::pair<InternalKey, Value>> batch;
+        while (scan->NextBatch(batch, kStreamBatchSize)) {
+            for (const auto& object : batch) {
+                filter_builder->Add(object.first.user_key);
             }
+            batch.clear();
         }
+        return WriteFilter(filter_builder);
     }
 
-    std::vector<std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>>> GetFilesSplitByKeys(std::shared_ptr<IStream<std::pair<InternalKey, Value>>> scan, size_t max_tables) {
+    std::vector<std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>>> GetFilesSplitByKeys(const ILevelsProvider& levels, std::shared_ptr<IStream<std::pair<InternalKey, Value>>> scan, size_t level) {
         std::vector<std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>>> result;
         uint64_t sum_mem = sizeof(uint64_t);
         std::vector<std::pair<InternalKey, Value>> objects;
         uint64_t key_mem = 0;
         std::vector<std::pair<InternalKey, Value>> key_objects;
-        auto object = scan->Next();
-        while (object.has_value()) {
-            if (!key_objects.empty() && key_objects.back().first.user_key == object->first.user_key) {
-                key_mem += 3 * sizeof(uint64_t) + object->first.user_key.size() + object->second.size();
-                key_objects.push_back(*object);
-            } else {
-                if (sum_mem + key_mem > options_.max_sstable_size) {
-                    result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0 && max_tables-- > 0));
-                    objects.resize(0);
-                    sum_mem = sizeof(uint64_t);
-                }
-                sum_mem += key_mem;
-                for (auto& obj : key_objects) {
-                    objects.push_back(obj);
+        std::vector<std::pair<InternalKey, Value>> batch;
+        GrandparentOverlap grandparents(levels, level, options_.max_grandparent_overlap_bytes);
+        TrackedBytes buffered(builder_bytes_);
+        while (scan->NextBatch(batch, kStreamBatchSize)) {
+            for (auto& object : batch) {
+                if (!key_objects.empty() && key_objects.back().first.user_key == object.first.user_key) {
+                    key_mem += 3 * sizeof(uint64_t) + object.first.user_key.size() + object.second.size();
+                    key_objects.push_back(std::move(object));
+                } else {
+                    bool stop = !key_objects.empty() && grandparents.ShouldStopBefore(key_objects.front().first.user_key) && !objects.empty();
+                    if (sum_mem + key_mem > options_.max_sstable_size || stop) {
+                        result.push_back(MakeFileFromVector(levels, objects, options_.bloom_filter_size != 0, level));
+                        objects.resize(0);
+                        sum_mem = sizeof(uint64_t);
+                        grandparents.Reset();
+                    }
+                    sum_mem += key_mem;
+                    for (auto& obj : key_objects) {
+                        objects.push_back(std::move(obj));
+                    }
+                    key_objects.resize(0);
+                    key_mem = 3 * sizeof(uint64_t) + object.first.user_key.size() + object.second.size();
+                    key_objects.push_back(std::move(object));
                 }
-                key_objects.resize(0);
-                key_mem = 3 * sizeof(uint64_t) + object->first.user_key.size() + object->second.size();
-                key_objects.push_back(*object);
             }
-            object = scan->Next();
+            batch.clear();
+            buffered.Set(sum_mem + key_mem);
         }
         if (!key_objects.empty()) {
-            if (sum_mem + key_mem > options_.max_sstable_size) {
-                result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0 && max_tables-- > 0));
+            bool stop = grandparents.ShouldStopBefore(key_objects.front().first.user_key) && !objects.empty();
+            if (sum_mem + key_mem > options_.max_sstable_size || stop) {
+                result.push_back(MakeFileFromVector(levels, objects, options_.bloom_filter_size != 0, level));
                 objects.resize(0);
                 sum_mem = sizeof(uint64_t);
             }
@@ -346,102 +1032,231 @@ class GranularLSMImpl : public ILSM {
             }
         }
         if (!objects.empty()) {
-            result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0 && max_tables-- > 0));
+            result.push_back(MakeFileFromVector(levels, objects, options_.bloom_filter_size != 0, level));
         }
         return result;
     }
 
-    std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>> MakeFileFromVector(const std::vector<std::pair<InternalKey, Value>>& objects, bool generate_filter) {
-        std::shared_ptr<storage::IFile> file = std::make_shared<storage::BufferedMemoryFile>(dir_, sstable_sequence_number_++, buffer_pool_, options_.frame_size);
-        auto sstable_builder = sstable_factory_->NewFileBuilder(file);
+    std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>> MakeFileFromVector(const ILevelsProvider& levels, const std::vector<std::pair<InternalKey, Value>>& objects, bool generate_filter, size_t level) {
+        std::shared_ptr<storage::IFile> file = MakeTableFile(options_, dir_, sstable_sequence_number_++, buffer_pool_, read_bytes_);
+        auto sstable_builder = sstable_factory_->NewFileBuilder(RateLimited(file, options_.rate_limiter, IoSourceOf(level)));
         std::shared_ptr<IFilterBuilder> filter_builder = nullptr;
         if (generate_filter) {
-            filter_builder = MakeFilterBuilder(8 * options_.bloom_filter_size, options_.bloom_filter_hash_count);
+            filter_builder = MakeTableFilterBuilder(options_, level, levels.NumLevels());
         }
-        for (auto& object : objects) {
-            sstable_builder->Add(object.first, object.second);
-            if (generate_filter) {
+        sstable_builder->AddBatch(objects);
+        if (generate_filter) {
+            for (auto& object : objects) {
                 filter_builder->Add(object.first.user_key);
             }
         }
         sstable_builder->Finish();
         SSTableMetadata meta = {objects.front().first.user_key, objects.back().first.user_key, file->Size()};
+        CountEntries(objects, meta);
         return {{file, filter_builder}, meta};
     }
 
     std::optional<Value> Get(const UserKey& user_key, uint64_t sequence_number = std::numeric_limits<uint64_t>::max()) const {
         Value value;
-        auto type = mem_table_->Get(user_key, &value, sequence_number);
+        auto type = GetFromMemTable(*mem_table_, user_key, &value, sequence_number);
         if (type == IMemTable::GetKind::kFound) {
             return value;
         } else if (type == IMemTable::GetKind::kDeletion) {
             return std::nullopt;
         } else {
-            for (size_t lvl = 0; lvl < levels_provider_->NumLevels(); ++lvl) {
-                size_t l = 0, r = levels_provider_->NumTables(lvl);
-                while (r - l > 1) {
-                    size_t ind = (l + r) / 2;
-                    auto meta = levels_provider_->GetTableMetadata(lvl, ind - 1);
-                    if (meta.has_value() && meta->max_key < user_key) {
-                        l = ind;
-                    } else {
-                        r = ind;
-                    }
-                }
-                if (options_.bloom_filter_size != 0) {
-                    auto filter = MakeFilterDeserializer()->Deserialize(levels_provider_->GetTableBloomFilter(lvl, r - 1)->Read(0, options_.bloom_filter_size));
-                    if (!filter->MayContain(user_key)) {
-                        continue;
-                    }
-                }
-                auto sstable_reader = sstable_factory_->FromFile(levels_provider_->GetTableFile(lvl, r - 1));
-                Value value;
-                auto type = sstable_reader->Get(user_key, &value, sequence_number);
-                if (type == ISSTableReader::GetKind::kFound) {
+            // The tables are read outside the lock, a compaction installed meanwhile restarts the lookup
+            while (true) {
+                uint64_t levels_version;
+                auto probes = GetProbes(user_key, &levels_version);
+                auto probes_type = GetFromProbes(probes, levels_version, user_key, &value, sequence_number);
+                if (probes_type == ISSTableReader::GetKind::kFound) {
                     return value;
-                } else if (type == ISSTableReader::GetKind::kDeletion) {
+                } else if (probes_type.has_value()) {
                     return std::nullopt;
                 }
             }
-            return std::nullopt;
         }
     }
 
     std::shared_ptr<IStream<std::pair<UserKey, Value>>> Scan(const std::optional<UserKey>& start_key, const std::optional<UserKey>& end_key,
                                                              uint64_t sequence_number = std::numeric_limits<uint64_t>::max()) const {
-        return std::make_shared<GranularLSMStream>(mem_table_, levels_provider_, sstable_factory_, start_key, end_key, sequence_number);
+        PerfTimer timer(&PerfContext::scan_setup_nanos);
+        auto prefix = options_.bloom_filter_size ? RangePrefix(start_key, end_key, options_.range_filter_prefix_length) : std::nullopt;
+        std::lock_guard lock(mutex_);
+        PerfCount(&PerfContext::memtables_probed);
+        std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources(1, mem_table_->MakeScan());
+        for (const auto& inputs : inputs_) {
+            for (const auto& input : inputs) {
+                if (input.mem_table) {
+                    PerfCount(&PerfContext::memtables_probed);
+                    sources.push_back(input.mem_table->MakeScan());
+                    continue;
+                }
+                std::vector<std::shared_ptr<const storage::IFile>> files;
+                for (const auto& table : input.tables) {
+                    if ((!start_key.has_value() || table.meta.max_key >= *start_key) && (!end_key.has_value() || table.meta.min_key < *end_key)) {
+                        files.push_back(table.file);
+                    }
+                }
+                if (!files.empty()) {
+                    sources.push_back(std::make_shared<LevelLSMStream>(std::move(files), sstable_factory_));
+                }
+            }
+        }
+        return std::make_shared<GranularLSMStream>(std::move(sources), levels_provider_, sstable_factory_, *filter_deserializer_, start_key, end_key, prefix, sequence_number);
     }
 
     virtual uint64_t GetCurrentSequenceNumber() const { return sequence_number_; }
 
+    LsmStats GetStats() const {
+        StatsCollector stats(*buffer_pool_, builder_bytes_);
+        stats.AddMemTable(*mem_table_);
+        std::lock_guard lock(mutex_);
+        for (const auto& inputs : inputs_) {
+            for (const auto& input : inputs) {
+                if (input.mem_table) {
+                    stats.AddMemTable(*input.mem_table);
+                }
+                for (const auto& table : input.tables) {
+                    stats.AddTable(table.meta);
+                }
+            }
+        }
+        stats.AddLevels(*levels_provider_);
+        return stats.Finish();
+    }
+
     virtual ~GranularLSMImpl() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        scheduler_.reset();
         std::filesystem::remove_all(dir_);
     }
 
    private:
+    // Data waiting for a background compaction into a level: a full memtable for L0, tables pushed
+    // down from the level above for the others
+    struct LevelInput {
+        std::shared_ptr<IMemTable> mem_table;
+        std::vector<PushedTable> tables;
+        uint64_t bytes = 0;
+    };
+
+    // Where Get looks for a key: a memtable or a table waiting for a compaction, or the table of a level
+    // whose key range may hold the key. The file of the latter is taken only once its filter passes.
+    struct GetProbe {
+        std::shared_ptr<IMemTable> mem_table = nullptr;
+        std::shared_ptr<const storage::IFile> file = nullptr;
+        std::shared_ptr<const storage::IFile> filter = nullptr;
+        size_t level = 0;
+        size_t table_index = 0;
+    };
+
+    // Everything that may hold the key besides the active memtable, newest first. Memtables and files
+    // stay readable through the probes after a compaction replaces them.
+    std::vector<GetProbe> GetProbes(const UserKey& user_key, uint64_t* levels_version) const {
+        std::vector<GetProbe> probes;
+        std::lock_guard lock(mutex_);
+        *levels_version = levels_version_;
+        for (size_t lvl = 0; lvl < std::max(levels_provider_->NumLevels(), inputs_.size()); ++lvl) {
+            // Inputs waiting for a compaction into the level are newer than its tables, the last queued is the newest
+            if (lvl < inputs_.size()) {
+                for (auto input = inputs_[lvl].rbegin(); input != inputs_[lvl].rend(); ++input) {
+                    if (input->mem_table) {
+                        probes.push_back({input->mem_table});
+                        continue;
+                    }
+                    auto table = std::lower_bound(input->tables.begin(), input->tables.end(), user_key, [](const auto& table, const UserKey& key) { return table.meta.max_key < key; });
+                    if (table != input->tables.end() && table->meta.min_key <= user_key) {
+                        probes.push_back({nullptr, table->file});
+                    }
+                }
+            }
+            if (!levels_provider_->NumTables(lvl)) {
+                continue;
+            }
+            size_t l = 0, r = levels_provider_->NumTables(lvl);
+            while (r - l > 1) {
+                size_t ind = (l + r) / 2;
+                auto meta = levels_provider_->GetTableMetadata(lvl, ind - 1);
+                if (meta.has_value() && meta->max_key < user_key) {
+                    l = ind;
+                } else {
+                    r = ind;
+                }
+            }
+            probes.push_back({nullptr, nullptr, levels_provider_->GetTableBloomFilter(lvl, r - 1), lvl, r - 1});
+        }
+        return probes;
+    }
+
+    // Nullopt when a compaction changed the levels since the probes were taken
+    std::optional<ISSTableReader::GetKind> GetFromProbes(const std::vector<GetProbe>& probes, uint64_t levels_version, const UserKey& user_key, Value* value,
+                                                         uint64_t sequence_number) const {
+        for (const auto& probe : probes) {
+            ISSTableReader::GetKind type;
+            if (probe.mem_table) {
+                auto mem_type = GetFromMemTable(*probe.mem_table, user_key, value, sequence_number);
+                type = mem_type == IMemTable::GetKind::kFound      ? ISSTableReader::GetKind::kFound
+                       : mem_type == IMemTable::GetKind::kDeletion ? ISSTableReader::GetKind::kDeletion
+                                                                   : ISSTableReader::GetKind::kNotFound;
+            } else if (probe.file) {
+                type = GetFromTable(*sstable_factory_, probe.file, user_key, value, sequence_number);
+            } else {
+                PerfCount(&PerfContext::levels_probed);
+                bool filtered = options_.bloom_filter_size != 0;
+                if (filtered && !TableFilterMayContain(*filter_deserializer_, *probe.filter, user_key)) {
+                    continue;
+                }
+                std::shared_ptr<const storage::IFile> file;
+                {
+                    std::lock_guard lock(mutex_);
+                    if (levels_version_ != levels_version) {
+                        return std::nullopt;
+                    }
+                    file = levels_provider_->GetTableFile(probe.level, probe.table_index);
+                }
+                type = GetFromTable(*sstable_factory_, file, user_key, value, sequence_number);
+                if (filtered && type == ISSTableReader::GetKind::kNotFound) {
+                    PerfCount(&PerfContext::filter_false_positives);
+                }
+            }
+            if (type != ISSTableReader::GetKind::kNotFound) {
+                return type;
+            }
+        }
+        return ISSTableReader::GetKind::kNotFound;
+    }
+
     class GranularLSMStream : public IStream<std::pair<UserKey, Value>> {
        public:
-        GranularLSMStream(std::shared_ptr<IMemTable> mem_table, std::shared_ptr<ILevelsProvider> levels_provider, std::shared_ptr<ISSTableSerializer> sstable_factory,
-                          const std::optional<UserKey>& start_key, const std::optional<UserKey>& end_key, uint64_t sequence_number)
+        // Sources hold the memtables and the tables waiting for compactions
+        GranularLSMStream(std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources, std::shared_ptr<ILevelsProvider> levels_provider,
+                          std::shared_ptr<ISSTableSerializer> sstable_factory, const IFilterDeserializer& filter_deserializer, const std::optional<UserKey>& start_key,
+                          const std::optional<UserKey>& end_key, const std::optional<UserKey>& prefix, uint64_t sequence_number)
             : sequence_number_(sequence_number), start_key_(start_key), end_key_(end_key) {
-            std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources;
-            sources.push_back(mem_table->MakeScan());
             for (size_t lvl = 0; lvl < levels_provider->NumLevels(); ++lvl) {
-                if (levels_provider->NumTables(lvl)) {
-                    sources.push_back(std::make_shared<LevelLSMStream>(lvl, levels_provider, sstable_factory));
+                // Levels without a table that may hold keys in range are not opened at all
+                auto files = TableFilesInRange(*levels_provider, lvl, start_key, end_key, prefix, filter_deserializer);
+                if (!files.empty()) {
+                    PerfCount(&PerfContext::levels_probed);
+                    sources.push_back(std::make_shared<LevelLSMStream>(std::move(files), sstable_factory));
                 }
             }
             merge_scan_ = MakeMerger<std::pair<InternalKey, Value>>(sources);
         }
 
         std::optional<std::pair<UserKey, Value>> Next() {
+            PerfTimer timer(&PerfContext::scan_next_nanos);
             std::optional<std::pair<InternalKey, Value>> object;
             do {
                 do {
-                    object = merge_scan_->Next();
+                    object = NextMerged();
                     if (start_key_.has_value()) {
                         while (object.has_value() && object->first.user_key < *start_key_) {
-                            object = merge_scan_->Next();
+                            object = NextMerged();
                         }
                     }
                     if (!object.has_value() || (end_key_.has_value() && object->first.user_key >= *end_key_)) {
@@ -457,7 +1272,23 @@ class GranularLSMImpl : public ILSM {
         }
 
        private:
+        // Rows come from the merger in batches that grow from 16 rows, so short scans read little ahead
+        std::optional<std::pair<InternalKey, Value>> NextMerged() {
+            if (batch_position_ == batch_.size()) {
+                batch_.clear();
+                batch_position_ = 0;
+                if (merge_scan_->NextBatch(batch_, batch_size_) == 0) {
+                    return std::nullopt;
+                }
+                batch_size_ = std::min(2 * batch_size_, kStreamBatchSize);
+            }
+            return std::move(batch_[batch_position_++]);
+        }
+
         UserKey used_ = {};
+        std::vector<std::pair<InternalKey, Value>> batch_;
+        size_t batch_position_ = 0;
+        size_t batch_size_ = 16;
         std::shared_ptr<IMerger<std::pair<InternalKey, Value>>> merge_scan_;
         uint64_t sequence_number_;
         std::optional<UserKey> start_key_;
@@ -466,27 +1297,41 @@ class GranularLSMImpl : public ILSM {
 
     class LevelLSMStream : public IStream<std::pair<InternalKey, Value>> {
        public:
-        LevelLSMStream(size_t level, std::shared_ptr<ILevelsProvider> levels_provider, std::shared_ptr<ISSTableSerializer> sstable_factory)
-            : level_(level), levels_provider_(levels_provider), sstable_factory_(sstable_factory) {
-            current_stream_ = sstable_factory_->FromFile(levels_provider->GetTableFile(level_, ind_++))->MakeScan();
+        // Tables are opened one at a time, in order
+        LevelLSMStream(std::vector<std::shared_ptr<const storage::IFile>> files, std::shared_ptr<ISSTableSerializer> sstable_factory)
+            : files_(std::move(files)), sstable_factory_(sstable_factory) {
+            OpenNext();
         }
 
         std::optional<std::pair<InternalKey, Value>> Next() {
             auto object = current_stream_->Next();
             while (!object.has_value()) {
-                if (ind_ == levels_provider_->NumTables(level_)) {
+                if (ind_ == files_.size()) {
                     return std::nullopt;
                 }
-                current_stream_ = sstable_factory_->FromFile(levels_provider_->GetTableFile(level_, ind_++))->MakeScan();
+                OpenNext();
                 object = current_stream_->Next();
             }
             return object;
         }
 
+        size_t NextBatch(std::vector<std::pair<InternalKey, Value>>& out, size_t max) {
+            size_t count = current_stream_->NextBatch(out, max);
+            while (count == 0 && ind_ < files_.size()) {
+                OpenNext();
+                count = current_stream_->NextBatch(out, max);
+            }
+            return count;
+        }
+
        private:
-        size_t level_;
+        void OpenNext() {
+            PerfCount(&PerfContext::tables_opened);
+            current_stream_ = sstable_factory_->FromFile(files_[ind_++])->MakeScan();
+        }
+
+        std::vector<std::shared_ptr<const storage::IFile>> files_;
         size_t ind_ = 0;
-        std::shared_ptr<ILevelsProvider> levels_provider_;
         std::shared_ptr<ISSTableSerializer> sstable_factory_;
         std::shared_ptr<IStream<std::pair<InternalKey, Value>>> current_stream_;
     };
@@ -502,6 +1347,13 @@ class GranularLSMImpl : public ILSM {
             return data_[ind_++];
         }
 
+        size_t NextBatch(std::vector<std::pair<InternalKey, Value>>& out, size_t max) {
+            size_t count = std::min(max, data_.size() - ind_);
+            out.insert(out.end(), data_.begin() + ind_, data_.begin() + ind_ + count);
+            ind_ += count;
+            return count;
+        }
+
        private:
         size_t ind_ = 0;
         std::vector<std::pair<InternalKey, Value>> data_;
@@ -509,32 +1361,56 @@ class GranularLSMImpl : public ILSM {
 
    private:
     uint64_t sequence_number_ = 0;
-    uint64_t sstable_sequence_number_ = 0;
-    uint64_t filter_sequence_number_ = 0;
+    std::atomic<uint64_t> sstable_sequence_number_ = 0;
+    std::atomic<uint64_t> filter_sequence_number_ = 0;
+    std::atomic<uint64_t> next_job_id_ = 0;
+    // Rows buffered by the running GetFilesSplitByKeys calls
+    std::atomic<uint64_t> builder_bytes_ = 0;
     std::string dir_ = "granular_lsm";
     GranularLsmOptions options_;
     std::shared_ptr<IMemTable> mem_table_;
     std::shared_ptr<ILevelsProvider> levels_provider_;
     std::shared_ptr<ISSTableSerializer> sstable_factory_;
+    std::shared_ptr<IFilterDeserializer> filter_deserializer_ = MakeTableFilterDeserializer();
     std::shared_ptr<storage::IReadBufferPool> buffer_pool_;
+    uint64_t* read_bytes_;
+    // Guards levels_provider_ and the background compaction state below
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    // Inputs of every level in the order they were queued, L0 ones are the memtables being flushed
+    std::vector<std::deque<LevelInput>> inputs_ = std::vector<std::deque<LevelInput>>(1);
+    std::vector<bool> compacting_;
+    // Bumped whenever a background compaction changes the levels
+    uint64_t levels_version_ = 0;
+    std::exception_ptr background_error_;
+    bool stopping_ = false;
+    // Null when compactions run inline
+    std::unique_ptr<JobScheduler> scheduler_;
 };
 
 class LeveledLSMImpl : public ILSM {
    public:
     LeveledLSMImpl(const GranularLsmOptions& options, std::shared_ptr<ILevelsProvider> levels_provider, std::shared_ptr<ISSTableSerializer> sstable_factory, uint64_t* read_bytes)
-        : options_(options), levels_provider_(levels_provider), sstable_factory_(sstable_factory) {
+        : options_(options), levels_provider_(levels_provider), sstable_factory_(sstable_factory), read_bytes_(read_bytes) {
+        if (options_.compaction_threads != 0) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": background compactions are not supported, compaction_threads must be 0");
+        }
         mem_table_ = MakeMemTable(options_.max_level_skip_list);
         std::filesystem::create_directory(dir_);
-        buffer_pool_ = storage::MakeReadBufferPool(dir_, options_.buffer_pool_size, options_.frame_size, read_bytes);
+        buffer_pool_ = storage::MakeReadBufferPool(dir_, MakeBufferPoolOptions(options_), read_bytes);
     }
 
-    void Put(const UserKey& user_key, const Value& value) {
-        mem_table_->Add(++sequence_number_, user_key, value);
+    void Put(const UserKey& user_key, const Value& value) { Put(UserKey(user_key), Value(value)); }
+
+    void Put(UserKey&& user_key, Value&& value) {
+        mem_table_->Add(++sequence_number_, std::move(user_key), std::move(value));
         CheckMemTable();
     }
 
-    void Delete(const UserKey& user_key) {
-        mem_table_->Delete(++sequence_number_, user_key);
+    void Delete(const UserKey& user_key) { Delete(UserKey(user_key)); }
+
+    void Delete(UserKey&& user_key) {
+        mem_table_->Delete(++sequence_number_, std::move(user_key));
         CheckMemTable();
     }
 
@@ -542,11 +1418,32 @@ class LeveledLSMImpl : public ILSM {
         if (mem_table_->ApproximateMemoryUsage() > options_.memtable_bytes) {
             std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources(1, mem_table_->MakeScan());
             uint64_t sources_mem = mem_table_->ApproximateMemoryUsage();
+            uint64_t memtable_bytes = sources_mem;
+            // Tables merged into the sources, reported to the listeners with the job that merges them
+            std::vector<TableInfo> inputs;
+            // Tables of a level pushed down as a whole
+            std::vector<PushedTable> pushed;
             mem_table_ = MakeMemTable(options_.max_level_skip_list);
-            for (size_t level_index = 0, level_capacity = options_.l0_capacity; !sources.empty(); ++level_index, level_capacity *= options_.level_size_multiplier) {
+            for (size_t level_index = 0, level_capacity = options_.l0_capacity; !sources.empty() || !pushed.empty(); ++level_index, level_capacity *= options_.level_size_multiplier) {
+                // Pushed tables that fit and overlap none of the level's tables are moved there as they are (trivial move)
+                if (sources.empty() && levels_provider_->NumTables(level_index) + pushed.size() < level_capacity &&
+                    std::all_of(pushed.begin(), pushed.end(), [&](const auto& table) { return OverlapsNoTable(*levels_provider_, level_index, table.meta); })) {
+                    for (const auto& table : pushed) {
+                        levels_provider_->InsertTableFile(level_index, TablePosition(*levels_provider_, level_index, table.meta.min_key), table.file, MakeMovedTableFilter(table, level_index), table.meta);
+                    }
+                    pushed.clear();
+                    continue;
+                }
+                for (const auto& table : pushed) {
+                    sources_mem += table.file->Size();
+                    inputs.push_back({level_index, table.meta});
+                    sources.push_back(sstable_factory_->FromFile(RateLimited(table.file, options_.rate_limiter, IoSourceOf(level_index)))->MakeScan());
+                }
+                pushed.clear();
                 for (size_t table_index = 0; table_index < levels_provider_->NumTables(level_index); ++table_index) {
-                    sources.push_back(sstable_factory_->FromFile(levels_provider_->GetTableFile(level_index, table_index))->MakeScan());
+                    sources.push_back(sstable_factory_->FromFile(RateLimited(levels_provider_->GetTableFile(level_index, table_index), options_.rate_limiter, IoSourceOf(level_index)))->MakeScan());
                     sources_mem += levels_provider_->GetTableMetadata(level_index, table_index)->file_size;
+                    inputs.push_back({level_index, *levels_provider_->GetTableMetadata(level_index, table_index)});
                 }
                 while (levels_provider_->NumTables(level_index)) {
                     levels_provider_->EraseTable(level_index, levels_provider_->NumTables(level_index) - 1);
@@ -555,63 +1452,104 @@ class LeveledLSMImpl : public ILSM {
                 if (sources_mem > options_.max_sstable_size * (level_capacity - 1)) {
                     continue;
                 }
+                CompactionJob job(options_.listeners, next_job_id_++, level_index, memtable_bytes);
+                for (const auto& input : inputs) {
+                    job.AddInput(input.level, input.metadata);
+                }
+                inputs.clear();
+                memtable_bytes = 0;
                 auto sources_scan = MakeMerger(sources);
                 sources_mem = 0;
                 sources.resize(0);
 
-                auto files = GetFilesSplitByKeys(sources_scan, level_capacity - 1);
+                auto files = GetFilesSplitByKeys(sources_scan, level_index);
                 if (files.size() < level_capacity) {
                     for (auto [sst_and_filter, meta] : files) {
                         auto [file, filter_builder] = sst_and_filter;
-                        std::shared_ptr<storage::MemoryFile> filter_file = nullptr;
-                        if (options_.bloom_filter_size) {
-                            filter_file = std::make_shared<storage::MemoryFile>(dir_ + "/filter_" + std::to_string(filter_sequence_number_++));
-                            auto serialized_filter = filter_builder->Serialize();
-                            filter_file->Write(serialized_filter.data(), serialized_filter.size());
-                        }
-                        levels_provider_->InsertTableFile(level_index, levels_provider_->NumTables(level_index), file, filter_file, meta);
+                        job.AddOutput(level_index, *meta);
+                        levels_provider_->InsertTableFile(level_index, levels_provider_->NumTables(level_index), file, WriteFilter(filter_builder), meta);
                     }
                 } else {
                     for (auto [sst_and_filter, meta] : files) {
-                        auto [file, filter_builder] = sst_and_filter;
-                        sources_mem += file->Size();
-                        sources.push_back(sstable_factory_->FromFile(file)->MakeScan());
+                        job.AddOutput(level_index + 1, *meta);
+                        pushed.push_back({sst_and_filter.first, *meta, WriteFilter(sst_and_filter.second), TableFilterSpec(options_, level_index, levels_provider_->NumLevels())});
                     }
                 }
+                job.Finish();
+            }
+        }
+    }
+
+    // Null when filters are disabled
+    std::shared_ptr<storage::MemoryFile> WriteFilter(const std::shared_ptr<IFilterBuilder>& filter_builder) {
+        if (!filter_builder) {
+            return nullptr;
+        }
+        auto filter_file = std::make_shared<storage::MemoryFile>(dir_ + "/filter_" + std::to_string(filter_sequence_number_++));
+        auto serialized_filter = filter_builder->Serialize();
+        filter_file->Write(serialized_filter.data(), serialized_filter.size());
+        return filter_file;
+    }
+
+    // Filters depend on the level: a moved table keeps its filter if the level builds them the same way,
+    // otherwise it gets a new one built from its keys
+    std::shared_ptr<storage::MemoryFile> MakeMovedTableFilter(const PushedTable& table, size_t level) {
+        if (options_.bloom_filter_size == 0) {
+            return nullptr;
+        }
+        if (table.filter && table.filter_spec == TableFilterSpec(options_, level, levels_provider_->NumLevels())) {
+            return table.filter;
+        }
+        auto filter_builder = MakeTableFilterBuilder(options_, level, levels_provider_->NumLevels());
+        auto scan = sstable_factory_->FromFile(RateLimited(table.file, options_.rate_limiter, IoSourceOf(level)))->MakeScan();
+        std::vector<std::pair<InternalKey, Value>> batch;
+        while (scan->NextBatch(batch, kStreamBatchSize)) {
+            for (const auto& object : batch) {
+                filter_builder->Add(object.first.user_key);
             }
+            batch.clear();
         }
+        return WriteFilter(filter_builder);
     }
 
-    std::vector<std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>>> GetFilesSplitByKeys(std::shared_ptr<IStream<std::pair<InternalKey, Value>>> scan, size_t max_tables) {
+    std::vector<std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>>> GetFilesSplitByKeys(std::shared_ptr<IStream<std::pair<InternalKey, Value>>> scan, size_t level) {
         std::vector<std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>>> result;
         uint64_t sum_mem = sizeof(uint64_t);
         std::vector<std::pair<InternalKey, Value>> objects;
         uint64_t key_mem = 0;
         std::vector<std::pair<InternalKey, Value>> key_objects;
-        auto object = scan->Next();
-        while (object.has_value()) {
-            if (!key_objects.empty() && key_objects.back().first.user_key == object->first.user_key) {
-                key_mem += 3 * sizeof(uint64_t) + object->first.user_key.size() + object->second.size();
-                key_objects.push_back(*object);
-            } else {
-                if (sum_mem + key_mem > options_.max_sstable_size) {
-                    result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0 && (max_tables--) > 0));
-                    objects.resize(0);
-                    sum_mem = sizeof(uint64_t);
-                }
-                sum_mem += key_mem;
-                for (auto& obj : key_objects) {
-                    objects.push_back(obj);
+        std::vector<std::pair<InternalKey, Value>> batch;
+        GrandparentOverlap grandparents(*levels_provider_, level, options_.max_grandparent_overlap_bytes);
+        TrackedBytes buffered(builder_bytes_);
+        while (scan->NextBatch(batch, kStreamBatchSize)) {
+            for (auto& object : batch) {
+                if (!key_objects.empty() && key_objects.back().first.user_key == object.first.user_key) {
+                    key_mem += 3 * sizeof(uint64_t) + object.first.user_key.size() + object.second.size();
+                    key_objects.push_back(std::move(object));
+                } else {
+                    bool stop = !key_objects.empty() && grandparents.ShouldStopBefore(key_objects.front().first.user_key) && !objects.empty();
+                    if (sum_mem + key_mem > options_.max_sstable_size || stop) {
+                        result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0, level));
+                        objects.resize(0);
+                        sum_mem = sizeof(uint64_t);
+                        grandparents.Reset();
+                    }
+                    sum_mem += key_mem;
+                    for (auto& obj : key_objects) {
+                        objects.push_back(std::move(obj));
+                    }
+                    key_objects.resize(0);
+                    key_mem = 3 * sizeof(uint64_t) + object.first.user_key.size() + object.second.size();
+                    key_objects.push_back(std::move(object));
                 }
-                key_objects.resize(0);
-                key_mem = 3 * sizeof(uint64_t) + object->first.user_key.size() + object->second.size();
-                key_objects.push_back(*object);
             }
-            object = scan->Next();
+            batch.clear();
+            buffered.Set(sum_mem + key_mem);
         }
         if (!key_objects.empty()) {
-            if (sum_mem + key_mem > options_.max_sstable_size) {
-                result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0 && (max_tables--) > 0));
+            bool stop = grandparents.ShouldStopBefore(key_objects.front().first.user_key) && !objects.empty();
+            if (sum_mem + key_mem > options_.max_sstable_size || stop) {
+                result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0, level));
                 objects.resize(0);
                 sum_mem = sizeof(uint64_t);
             }
@@ -621,32 +1559,33 @@ class LeveledLSMImpl : public ILSM {
             }
         }
         if (!objects.empty()) {
-            result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0 && (max_tables--) > 0));
+            result.push_back(MakeFileFromVector(objects, options_.bloom_filter_size != 0, level));
         }
         return result;
     }
 
-    std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>> MakeFileFromVector(const std::vector<std::pair<InternalKey, Value>>& objects, bool generate_filter) {
-        std::shared_ptr<storage::IFile> file = std::make_shared<storage::BufferedMemoryFile>(dir_, sstable_sequence_number_++, buffer_pool_, options_.frame_size);
-        auto sstable_builder = sstable_factory_->NewFileBuilder(file);
+    std::pair<std::pair<std::shared_ptr<storage::IFile>, std::shared_ptr<IFilterBuilder>>, std::optional<SSTableMetadata>> MakeFileFromVector(const std::vector<std::pair<InternalKey, Value>>& objects, bool generate_filter, size_t level) {
+        std::shared_ptr<storage::IFile> file = MakeTableFile(options_, dir_, sstable_sequence_number_++, buffer_pool_, read_bytes_);
+        auto sstable_builder = sstable_factory_->NewFileBuilder(RateLimited(file, options_.rate_limiter, IoSourceOf(level)));
         std::shared_ptr<IFilterBuilder> filter_builder = nullptr;
         if (generate_filter) {
-            filter_builder = MakeFilterBuilder(8 * options_.bloom_filter_size, options_.bloom_filter_hash_count);
+            filter_builder = MakeTableFilterBuilder(options_, level, levels_provider_->NumLevels());
         }
-        for (auto& object : objects) {
-            sstable_builder->Add(object.first, object.second);
-            if (generate_filter) {
+        sstable_builder->AddBatch(objects);
+        if (generate_filter) {
+            for (auto& object : objects) {
                 filter_builder->Add(object.first.user_key);
             }
         }
         sstable_builder->Finish();
         SSTableMetadata meta = {objects.front().first.user_key, objects.back().first.user_key, file->Size()};
+        CountEntries(objects, meta);
         return {{file, filter_builder}, meta};
     }
 
     std::optional<Value> Get(const UserKey& user_key, uint64_t sequence_number = std::numeric_limits<uint64_t>::max()) const {
         Value value;
-        auto type = mem_table_->Get(user_key, &value, sequence_number);
+        auto type = GetFromMemTable(*mem_table_, user_key, &value, sequence_number);
         if (type == IMemTable::GetKind::kFound) {
             return value;
         } else if (type == IMemTable::GetKind::kDeletion) {
@@ -666,15 +1605,16 @@ class LeveledLSMImpl : public ILSM {
                         r = ind;
                     }
                 }
-                if (options_.bloom_filter_size != 0) {
-                    auto filter = MakeFilterDeserializer()->Deserialize(levels_provider_->GetTableBloomFilter(lvl, r - 1)->Read(0, options_.bloom_filter_size));
-                    if (!filter->MayContain(user_key)) {
-                        continue;
-                    }
+                PerfCount(&PerfContext::levels_probed);
+                bool filtered = options_.bloom_filter_size != 0;
+                if (filtered && !TableFilterMayContain(*filter_deserializer_, *levels_provider_->GetTableBloomFilter(lvl, r - 1), user_key)) {
+                    continue;
                 }
-                auto sstable_reader = sstable_factory_->FromFile(levels_provider_->GetTableFile(lvl, r - 1));
                 Value value;
-                auto type = sstable_reader->Get(user_key, &value, sequence_number);
+                auto type = GetFromTable(*sstable_factory_, levels_provider_->GetTableFile(lvl, r - 1), user_key, &value, sequence_number);
+                if (filtered && type == ISSTableReader::GetKind::kNotFound) {
+                    PerfCount(&PerfContext::filter_false_positives);
+                }
                 if (type == ISSTableReader::GetKind::kFound) {
                     return value;
                 } else if (type == ISSTableReader::GetKind::kDeletion) {
@@ -687,11 +1627,20 @@ class LeveledLSMImpl : public ILSM {
 
     std::shared_ptr<IStream<std::pair<UserKey, Value>>> Scan(const std::optional<UserKey>& start_key, const std::optional<UserKey>& end_key,
                                                              uint64_t sequence_number = std::numeric_limits<uint64_t>::max()) const {
-        return std::make_shared<LeveledLSMStream>(mem_table_, levels_provider_, sstable_factory_, start_key, end_key, sequence_number);
+        PerfTimer timer(&PerfContext::scan_setup_nanos);
+        auto prefix = options_.bloom_filter_size ? RangePrefix(start_key, end_key, options_.range_filter_prefix_length) : std::nullopt;
+        return std::make_shared<LeveledLSMStream>(mem_table_, levels_provider_, sstable_factory_, *filter_deserializer_, start_key, end_key, prefix, sequence_number);
     }
 
     virtual uint64_t GetCurrentSequenceNumber() const { return sequence_number_; }
 
+    LsmStats GetStats() const {
+        StatsCollector stats(*buffer_pool_, builder_bytes_);
+        stats.AddMemTable(*mem_table_);
+        stats.AddLevels(*levels_provider_);
+        return stats.Finish();
+    }
+
     virtual ~LeveledLSMImpl() {
         std::filesystem::remove_all(dir_);
     }
@@ -700,26 +1649,32 @@ class LeveledLSMImpl : public ILSM {
     class LeveledLSMStream : public IStream<std::pair<UserKey, Value>> {
        public:
         LeveledLSMStream(std::shared_ptr<IMemTable> mem_table, std::shared_ptr<ILevelsProvider> levels_provider, std::shared_ptr<ISSTableSerializer> sstable_factory,
-                          const std::optional<UserKey>& start_key, const std::optional<UserKey>& end_key, uint64_t sequence_number)
+                          const IFilterDeserializer& filter_deserializer, const std::optional<UserKey>& start_key, const std::optional<UserKey>& end_key,
+                          const std::optional<UserKey>& prefix, uint64_t sequence_number)
             : sequence_number_(sequence_number), start_key_(start_key), end_key_(end_key) {
             std::vector<std::shared_ptr<IStream<std::pair<InternalKey, Value>>>> sources;
+            PerfCount(&PerfContext::memtables_probed);
             sources.push_back(mem_table->MakeScan());
             for (size_t lvl = 0; lvl < levels_provider->NumLevels(); ++lvl) {
-                if (levels_provider->NumTables(lvl)) {
-                    sources.push_back(std::make_shared<LevelLSMStream>(lvl, levels_provider, sstable_factory));
+                // Levels without a table that may hold keys in range are not opened at all
+                auto files = TableFilesInRange(*levels_provider, lvl, start_key, end_key, prefix, filter_deserializer);
+                if (!files.empty()) {
+                    PerfCount(&PerfContext::levels_probed);
+                    sources.push_back(std::make_shared<LevelLSMStream>(std::move(files), sstable_factory));
                 }
             }
             merge_scan_ = MakeMerger<std::pair<InternalKey, Value>>(sources);
         }
 
         std::optional<std::pair<UserKey, Value>> Next() {
+            PerfTimer timer(&PerfContext::scan_next_nanos);
             std::optional<std::pair<InternalKey, Value>> object;
             do {
                 do {
-                    object = merge_scan_->Next();
+                    object = NextMerged();
                     if (start_key_.has_value()) {
                         while (object.has_value() && object->first.user_key < *start_key_) {
-                            object = merge_scan_->Next();
+                            object = NextMerged();
                         }
                     }
                     if (!object.has_value() || (end_key_.has_value() && object->first.user_key >= *end_key_)) {
@@ -735,7 +1690,23 @@ class LeveledLSMImpl : public ILSM {
         }
 
        private:
+        // Rows come from the merger in batches that grow from 16 rows, so short scans read little ahead
+        std::optional<std::pair<InternalKey, Value>> NextMerged() {
+            if (batch_position_ == batch_.size()) {
+                batch_.clear();
+                batch_position_ = 0;
+                if (merge_scan_->NextBatch(batch_, batch_size_) == 0) {
+                    return std::nullopt;
+                }
+                batch_size_ = std::min(2 * batch_size_, kStreamBatchSize);
+            }
+            return std::move(batch_[batch_position_++]);
+        }
+
         UserKey used_ = {};
+        std::vector<std::pair<InternalKey, Value>> batch_;
+        size_t batch_position_ = 0;
+        size_t batch_size_ = 16;
         std::shared_ptr<IMerger<std::pair<InternalKey, Value>>> merge_scan_;
         uint64_t sequence_number_;
         std::optional<UserKey> start_key_;
@@ -744,27 +1715,41 @@ class LeveledLSMImpl : public ILSM {
 
     class LevelLSMStream : public IStream<std::pair<InternalKey, Value>> {
        public:
-        LevelLSMStream(size_t level, std::shared_ptr<ILevelsProvider> levels_provider, std::shared_ptr<ISSTableSerializer> sstable_factory)
-            : level_(level), levels_provider_(levels_provider), sstable_factory_(sstable_factory) {
-            current_stream_ = sstable_factory_->FromFile(levels_provider->GetTableFile(level_, ind_++))->MakeScan();
+        // Tables are opened one at a time, in order
+        LevelLSMStream(std::vector<std::shared_ptr<const storage::IFile>> files, std::shared_ptr<ISSTableSerializer> sstable_factory)
+            : files_(std::move(files)), sstable_factory_(sstable_factory) {
+            OpenNext();
         }
 
         std::optional<std::pair<InternalKey, Value>> Next() {
             auto object = current_stream_->Next();
             while (!object.has_value()) {
-                if (ind_ == levels_provider_->NumTables(level_)) {
+                if (ind_ == files_.size()) {
                     return std::nullopt;
                 }
-                current_stream_ = sstable_factory_->FromFile(levels_provider_->GetTableFile(level_, ind_++))->MakeScan();
+                OpenNext();
                 object = current_stream_->Next();
             }
             return object;
         }
 
+        size_t NextBatch(std::vector<std::pair<InternalKey, Value>>& out, size_t max) {
+            size_t count = current_stream_->NextBatch(out, max);
+            while (count == 0 && ind_ < files_.size()) {
+                OpenNext();
+                count = current_stream_->NextBatch(out, max);
+            }
+            return count;
+        }
+
        private:
-        size_t level_;
+        void OpenNext() {
+            PerfCount(&PerfContext::tables_opened);
+            current_stream_ = sstable_factory_->FromFile(files_[ind_++])->MakeScan();
+        }
+
+        std::vector<std::shared_ptr<const storage::IFile>> files_;
         size_t ind_ = 0;
-        std::shared_ptr<ILevelsProvider> levels_provider_;
         std::shared_ptr<ISSTableSerializer> sstable_factory_;
         std::shared_ptr<IStream<std::pair<InternalKey, Value>>> current_stream_;
     };
@@ -780,6 +1765,13 @@ class LeveledLSMImpl : public ILSM {
             return data_[ind_++];
         }
 
+        size_t NextBatch(std::vector<std::pair<InternalKey, Value>>& out, size_t max) {
+            size_t count = std::min(max, data_.size() - ind_);
+            out.insert(out.end(), data_.begin() + ind_, data_.begin() + ind_ + count);
+            ind_ += count;
+            return count;
+        }
+
        private:
         size_t ind_ = 0;
         std::vector<std::pair<InternalKey, Value>> data_;
@@ -789,12 +1781,16 @@ class LeveledLSMImpl : public ILSM {
     uint64_t sequence_number_ = 0;
     uint64_t sstable_sequence_number_ = 0;
     uint64_t filter_sequence_number_ = 0;
+    uint64_t next_job_id_ = 0;
+    std::atomic<uint64_t> builder_bytes_ = 0;
     std::string dir_ = "leveled_lsm";
     GranularLsmOptions options_;
     std::shared_ptr<IMemTable> mem_table_;
     std::shared_ptr<ILevelsProvider> levels_provider_;
     std::shared_ptr<ISSTableSerializer> sstable_factory_;
+    std::shared_ptr<IFilterDeserializer> filter_deserializer_ = MakeTableFilterDeserializer();
     std::shared_ptr<storage::IReadBufferPool> buffer_pool_;
+    uint64_t* read_bytes_;
 };
 
 std::unique_ptr<ILSM> MakeLsm(const LsmOptions& options, std::shared_ptr<ILevelsProvider> levels_provider, std::shared_ptr<ISSTableSerializer> sstable_factory, uint64_t* read_bytes) {
@@ -4,14 +4,48 @@
 #include <lsm/common/types.h>
 #include <lsm/sstable.h>
 #include <lsm/storage/file.h>
+#include <lsm/storage/rate_limiter.h>
 
 #include <cstdint>
 #include <limits>
 #include <memory>
 #include <optional>
+#include <vector>
 
 namespace lsm {
 
+class IEventListener;
+
+struct LevelStats {
+    size_t tables = 0;
+    uint64_t bytes = 0;
+};
+
+// Where the memory of an LSM-tree goes and what its levels hold, a snapshot taken by GetStats
+struct LsmStats {
+    // Skip lists of the active memtable and of the full ones waiting for a flush
+    uint64_t memtable_bytes = 0;
+    // Buffer pool frames holding table pages, out of the capacity allocated up front
+    uint64_t buffer_pool_frame_bytes = 0;
+    uint64_t buffer_pool_capacity_bytes = 0;
+    // Compressed copies of evicted frames
+    uint64_t compressed_cache_bytes = 0;
+    // Table metadata with its min and max keys
+    uint64_t table_metadata_bytes = 0;
+    // Rows buffered by running flushes and compactions before they are written out as tables
+    uint64_t builder_bytes = 0;
+    // Table filters as stored in their files. Probes read and deserialize them anew, so they take no memory
+    // of their own and are left out of TotalMemoryBytes.
+    uint64_t filter_file_bytes = 0;
+    // Tables and their bytes per level, tables waiting for a background compaction not included
+    std::vector<LevelStats> levels;
+    // Entries of the memtables and tables less two for every tombstone, one for the tombstone and one for the
+    // value it deletes (RocksDB's estimate-num-keys). Overwritten keys are counted once per version.
+    uint64_t estimated_live_keys = 0;
+
+    uint64_t TotalMemoryBytes() const { return memtable_bytes + buffer_pool_capacity_bytes + compressed_cache_bytes + table_metadata_bytes + builder_bytes; }
+};
+
 // Minimal LSM-Tree interface (single-threaded).
 //
 // Semantics:
@@ -28,10 +62,13 @@ class ILSM {
     // Insert or overwrite the value for user_key. Subsequent Get should observe this
     // value unless a newer Delete/Put overrides it.
     virtual void Put(const UserKey& user_key, const Value& value) = 0;
+    // Moves the key and the value on into the memtable, for callers that build them only to hand them over
+    virtual void Put(UserKey&& user_key, Value&& value) = 0;
 
     // Write a deletion tombstone for user_key. Subsequent Get should return std::nullopt
     // until a newer Put for the same key appears.
     virtual void Delete(const UserKey& user_key) = 0;
+    virtual void Delete(UserKey&& user_key) = 0;
 
     // Lookup the latest live value for user_key. Returns std::nullopt if the key is absent
     // or its newest entry is a deletion tombstone.
@@ -52,6 +89,13 @@ class ILSM {
 
     virtual uint64_t GetCurrentSequenceNumber() const = 0;
 
+    // Blocks until background flushes and compactions have caught up with the writes so far, the
+    // active memtable is not flushed. A no-op for LSMs that compact inline in Put and Delete.
+    virtual void WaitForCompactions() {}
+
+    // Memory usage by component, table counts and sizes per level, estimated number of live keys
+    virtual LsmStats GetStats() const = 0;
+
     virtual ~ILSM() = default;
 };
 
@@ -60,6 +104,9 @@ struct SSTableMetadata {
     UserKey min_key;  // Smallest user key in this SSTable
     UserKey max_key;  // Largest user key in this SSTable
     uint64_t file_size = 0;
+    // Entries in the table, tombstones included, and the tombstones among them
+    uint64_t entries = 0;
+    uint64_t deletions = 0;
 
     // Returns true if this SSTable's key range overlaps with [start_key, end_key]
     bool Overlaps(const UserKey& start_key, const UserKey& end_key) const { return min_key <= end_key && max_key >= start_key; }
@@ -102,11 +149,29 @@ class ILevelsProvider {
 struct LsmOptions {
     uint64_t frame_size = 4096;
     uint64_t buffer_pool_size = 64ull * 1024 * 1024;
+    // Number of SSTable descriptors the buffer pool keeps open between reads
+    uint32_t max_open_files = 64;
+    // Background threads loading frames ahead of sequential reads, 0 keeps all reads synchronous
+    uint32_t io_threads = 0;
+    uint32_t readahead_frames = 16;
+    // Read SSTables with O_DIRECT so that buffer_pool_size bounds the read cache, frame_size must be a multiple of 512
+    bool direct_io = false;
+    // Independently locked buffer pool shards, 0 picks a count from buffer_pool_size
+    uint32_t buffer_pool_shards = 0;
+    // Back the buffer pool with transparent huge pages
+    bool huge_pages = false;
+    // Memory for compressed copies of frames evicted from the buffer pool, 0 disables it
+    uint64_t compressed_cache_size = 0;
     uint64_t memtable_bytes = 64ull * 1024 * 1024;
     uint32_t max_level_skip_list = 20;
     // Compaction trigger: start merging a level when it reaches this many files
     // (each level can contain at most 'compaction_trigger_files - 1' files)
     uint32_t compaction_trigger_files = 2;
+    // Map immutable SSTables into memory instead of reading them through the buffer pool
+    bool use_mmap = false;
+    // Flushes and compactions read and write tables through it, null leaves their I/O unlimited.
+    // Keep a pointer to change the limits at runtime and to read the throttling statistics.
+    std::shared_ptr<storage::IRateLimiter> rate_limiter = nullptr;
 };
 
 // Granular LSM-tree configuration: multiple size-bounded SSTables per level
@@ -115,6 +180,19 @@ struct LsmOptions {
 struct GranularLsmOptions {
     uint64_t frame_size = 4096;
     uint64_t buffer_pool_size = 64ull * 1024 * 1024;
+    // Number of SSTable descriptors the buffer pool keeps open between reads
+    uint32_t max_open_files = 64;
+    // Background threads loading frames ahead of sequential reads, 0 keeps all reads synchronous
+    uint32_t io_threads = 0;
+    uint32_t readahead_frames = 16;
+    // Read SSTables with O_DIRECT so that buffer_pool_size bounds the read cache, frame_size must be a multiple of 512
+    bool direct_io = false;
+    // Independently locked buffer pool shards, 0 picks a count from buffer_pool_size
+    uint32_t buffer_pool_shards = 0;
+    // Back the buffer pool with transparent huge pages
+    bool huge_pages = false;
+    // Memory for compressed copies of frames evicted from the buffer pool, 0 disables it
+    uint64_t compressed_cache_size = 0;
     uint64_t memtable_bytes = 64ull * 1024 * 1024;
     // Target SSTable size
     // Actual files may be up to max_sstable_size plus size of one key
@@ -126,8 +204,41 @@ struct GranularLsmOptions {
     uint32_t l0_capacity = 2;
     // Capacity growth factor per level
     uint32_t level_size_multiplier = 2;
+    // Upper bound on the filter of one table in bytes, 0 disables filters
     uint32_t bloom_filter_size = 4ull * 1024 * 1024;
-    uint32_t bloom_filter_hash_count = 23;
+    // Filters are sized from the table contents: this many bits for every distinct key
+    double bloom_bits_per_key = 10;
+    // Probes per key, 0 picks the count that minimizes false positives for bloom_bits_per_key
+    uint32_t bloom_filter_hash_count = 0;
+    // Keep bloom_bits_per_key as the average over the tree but shift bits from the largest level
+    // to the upper ones, minimizing wasted table reads per lookup (Monkey)
+    bool monkey_filters = false;
+    // Tables on this level and deeper get binary fuse filters instead of bloom filters: about 9 bits
+    // per key at 0.4% false positives, ignoring bloom_bits_per_key. Upper levels keep bloom filters,
+    // which are cheaper to build for tables that are rewritten soon.
+    uint32_t fuse_filter_min_level = std::numeric_limits<uint32_t>::max();
+    // Also add key prefixes of this length to table filters, letting Scan skip tables when both
+    // bounds share a prefix (a prefix bloom filter), 0 disables. Needs filters enabled.
+    uint32_t range_filter_prefix_length = 0;
+    // Cut an output table once it overlaps this many bytes of tables two levels below, so that
+    // pushing it down later merges a bounded amount of data (RocksDB uses 10 * max_sstable_size), 0 disables
+    uint64_t max_grandparent_overlap_bytes = 0;
+    // Threads merging tables into the levels in the background, 0 compacts inline in Put and Delete.
+    // Full memtables are then flushed by a thread of their own, compactions of different levels
+    // run concurrently. Granular LSM only, MakeLeveledLsm throws unless it is 0.
+    uint32_t compaction_threads = 0;
+    // Full memtables waiting for the background flush before Put and Delete stall
+    uint32_t max_immutable_memtables = 2;
+    // Put and Delete also stall while the tables pushed down but not yet merged into their level add up
+    // to this many bytes (RocksDB's soft_pending_compaction_bytes_limit), 0 never stalls on them
+    uint64_t pending_compaction_bytes_limit = 64ull * 1024 * 1024 * 1024;
+    // Map immutable SSTables into memory instead of reading them through the buffer pool
+    bool use_mmap = false;
+    // Flushes and compactions read and write tables through it, null leaves their I/O unlimited.
+    // Keep a pointer to change the limits at runtime and to read the throttling statistics.
+    std::shared_ptr<storage::IRateLimiter> rate_limiter = nullptr;
+    // Told about flushes, compactions, the tables they create and delete and write stalls, see lsm/event_listener.h
+    std::vector<std::shared_ptr<IEventListener>> listeners = {};
 };
 
 std::shared_ptr<ILevelsProvider> MakeLevelsProvider();
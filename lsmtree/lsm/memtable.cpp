@@ -19,16 +19,20 @@ class MemTableImpl : public IMemTable {
         random_generator_.seed(device());
     }
 
-    void Add(uint64_t sequence_number, const UserKey& user_key, const Value& value) {
+    void Add(uint64_t sequence_number, const UserKey& user_key, const Value& value) { Add(sequence_number, UserKey(user_key), Value(value)); }
+
+    void Add(uint64_t sequence_number, UserKey&& user_key, Value&& value) {
         auto node = std::make_shared<Node>();
-        node->key = {user_key, sequence_number, ValueType::kValue};
-        node->value = value;
+        node->key = {std::move(user_key), sequence_number, ValueType::kValue};
+        node->value = std::move(value);
         InsertNode(node);
     }
 
-    void Delete(uint64_t sequence_number, const UserKey& user_key) {
+    void Delete(uint64_t sequence_number, const UserKey& user_key) { Delete(sequence_number, UserKey(user_key)); }
+
+    void Delete(uint64_t sequence_number, UserKey&& user_key) {
         auto node = std::make_shared<Node>();
-        node->key = {user_key, sequence_number, ValueType::kDeletion};
+        node->key = {std::move(user_key), sequence_number, ValueType::kDeletion};
         node->value = {};
         InsertNode(node);
     }
@@ -61,6 +65,10 @@ class MemTableImpl : public IMemTable {
 
     uint64_t ApproximateMemoryUsage() const { return amu_; }
 
+    uint64_t NumEntries() const { return entries_; }
+
+    uint64_t NumDeletions() const { return deletions_; }
+
     virtual ~MemTableImpl() = default;
 
    private:
@@ -83,6 +91,14 @@ class MemTableImpl : public IMemTable {
             return result;
         }
 
+        size_t NextBatch(std::vector<std::pair<InternalKey, Value>>& out, size_t max) {
+            size_t count = 0;
+            for (; count < max && cur_; ++count, cur_ = cur_->links[0]) {
+                out.emplace_back(cur_->key, cur_->value);
+            }
+            return count;
+        }
+
        private:
         std::shared_ptr<Node> cur_;
     };
@@ -106,10 +122,14 @@ class MemTableImpl : public IMemTable {
             }
         }
         amu_ += node->key.user_key.size() + sizeof(node->key.sequence_number) + sizeof(node->key.type) + node->value.size() + node->links.size() * sizeof(Node*);
+        ++entries_;
+        deletions_ += node->key.type == ValueType::kDeletion;
     }
 
    private:
     uint64_t amu_ = 0;
+    uint64_t entries_ = 0;
+    uint64_t deletions_ = 0;
     uint64_t max_level_;
     std::shared_ptr<Node> head_;
     std::mt19937 random_generator_;
@@ -18,10 +18,13 @@ class IMemTable {
     // If Add is called without monotonically increasing sequence_number, behavior is undefined.
     // It is recommended to throw an exception/assert to simplify debugging.
     virtual void Add(uint64_t sequence_number, const UserKey& user_key, const Value& value) = 0;
+    // Moves the key and the value into the memtable instead of copying them
+    virtual void Add(uint64_t sequence_number, UserKey&& user_key, Value&& value) = 0;
 
     // Write a tombstone for user_key at the given sequence_number.
     // Tombstones are visible in scans (as internal-key entries) and affect Get semantics.
     virtual void Delete(uint64_t sequence_number, const UserKey& user_key) = 0;
+    virtual void Delete(uint64_t sequence_number, UserKey&& user_key) = 0;
 
     // Returns the latest entry kind for user_key within this MemTable.
     // kFound: out_value is set to the latest value
@@ -42,6 +45,10 @@ class IMemTable {
     // inserts (deletes are tombstones and also consume memory).
     virtual uint64_t ApproximateMemoryUsage() const = 0;
 
+    // Entries added so far, tombstones included, and the tombstones among them
+    virtual uint64_t NumEntries() const = 0;
+    virtual uint64_t NumDeletions() const = 0;
+
     virtual ~IMemTable() = default;
 };
 
@@ -1,5 +1,6 @@
 #include "lsm/sstable.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
@@ -8,6 +9,8 @@
 #include <optional>
 #include <vector>
 
+#include <lsm/common/perf_context.h>
+
 namespace lsm {
 namespace {
 
@@ -43,29 +46,30 @@ class FileSSTableReader final : public ISSTableReader {
    private:
     class SSTableViewer {
        public:
-        explicit SSTableViewer(std::shared_ptr<const storage::IFile> file) : file_(std::move(file)) { std::memcpy(&object_count_, file_->Read(0, sizeof(uint64_t)).data(), sizeof(uint64_t)); }
+        explicit SSTableViewer(std::shared_ptr<const storage::IFile> file) : file_(std::move(file)) { ReadInto(&object_count_, 0, sizeof(uint64_t)); }
 
-        std::pair<InternalKey, Value> GetObject(size_t ind) const {
+        // Scans pass ReadHint::kScan, so the rows they read once don't take the place of hot ones in the buffer pool
+        std::pair<InternalKey, Value> GetObject(size_t ind, storage::ReadHint hint = storage::ReadHint::kPoint) const {
             if (ind >= object_count_) {
                 throw "SSTablePage: out of bounds";
             }
             std::pair<uint64_t, uint64_t> offsets;
-            std::memcpy(&offsets, file_->Read((2 * ind + 1) * sizeof(uint64_t), 2 * sizeof(uint64_t)).data(), 2 * sizeof(uint64_t));
+            ReadInto(&offsets, (2 * ind + 1) * sizeof(uint64_t), 2 * sizeof(uint64_t), hint);
 
             std::pair<InternalKey, Value> object;
-            std::memcpy(&object.first.sequence_number, file_->Read(file_->Size() - offsets.first, sizeof(uint64_t)).data(), sizeof(uint64_t));
+            ReadInto(&object.first.sequence_number, file_->Size() - offsets.first, sizeof(uint64_t), hint);
 
-            object.first.user_key = file_->Read(file_->Size() - offsets.first + sizeof(uint64_t), offsets.first - offsets.second - sizeof(uint64_t));
+            object.first.user_key = Read(file_->Size() - offsets.first + sizeof(uint64_t), offsets.first - offsets.second - sizeof(uint64_t), hint);
 
             uint64_t bytes_value = offsets.second;
             if (ind) {
                 uint64_t ofs;
-                std::memcpy(&ofs, file_->Read((2 * ind - 1) * sizeof(uint64_t), sizeof(uint64_t)).data(), sizeof(uint64_t));
+                ReadInto(&ofs, (2 * ind - 1) * sizeof(uint64_t), sizeof(uint64_t), hint);
                 bytes_value -= ofs;
             }
             if (bytes_value) {
                 object.first.type = ValueType::kValue;
-                object.second = file_->Read(file_->Size() - offsets.second, bytes_value);
+                object.second = Read(file_->Size() - offsets.second, bytes_value, hint);
             } else {
                 object.first.type = ValueType::kDeletion;
             }
@@ -75,6 +79,22 @@ class FileSSTableReader final : public ISSTableReader {
         size_t GetObjectCount() const { return object_count_; }
 
        private:
+        // Fixed-size fields are copied straight out of the file view when it has one
+        void ReadInto(void* dst, uint64_t offset, uint64_t bytes, storage::ReadHint hint = storage::ReadHint::kPoint) const {
+            PerfCount(&PerfContext::bytes_read, bytes);
+            auto view = file_->ReadView(offset, bytes);
+            if (view.size() == bytes) {
+                std::memcpy(dst, view.data(), bytes);
+            } else {
+                std::memcpy(dst, file_->Read(offset, bytes, hint).data(), bytes);
+            }
+        }
+
+        std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes, storage::ReadHint hint) const {
+            PerfCount(&PerfContext::bytes_read, bytes);
+            return file_->Read(offset, bytes, hint);
+        }
+
         uint64_t object_count_;
         std::shared_ptr<const storage::IFile> file_;
     };
@@ -87,7 +107,15 @@ class FileSSTableReader final : public ISSTableReader {
             if (ind_ == page_->GetObjectCount()) {
                 return std::nullopt;
             }
-            return page_->GetObject(ind_++);
+            return page_->GetObject(ind_++, storage::ReadHint::kScan);
+        }
+
+        size_t NextBatch(std::vector<std::pair<InternalKey, Value>>& out, size_t max) {
+            size_t count = std::min<size_t>(max, page_->GetObjectCount() - ind_);
+            for (size_t end = ind_ + count; ind_ < end; ++ind_) {
+                out.push_back(page_->GetObject(ind_, storage::ReadHint::kScan));
+            }
+            return count;
         }
 
        private:
@@ -105,6 +133,8 @@ class FileSSTableBuilder final : public ISSTableBuilder {
 
     void Add(const InternalKey& k, const Value& v) override { objects_.push_back({k, v}); }
 
+    void AddBatch(const std::vector<std::pair<InternalKey, Value>>& objects) override { objects_.insert(objects_.end(), objects.begin(), objects.end()); }
+
     void Finish() override {
         uint64_t mem = (2 * objects_.size() + 1) * sizeof(uint64_t);
         for (auto& object : objects_) {
@@ -4,6 +4,7 @@
 #include <limits>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include <lsm/common/stream.h>
 #include <lsm/common/types.h>
@@ -22,6 +23,13 @@ class ISSTableBuilder {
     // internal_key order. If violated, implementation may assert, ignore, or produce a corrupted table.
     virtual void Add(const InternalKey& internal_key, const Value& value) = 0;
 
+    // Adds entries in order, the same as calling Add for each of them
+    virtual void AddBatch(const std::vector<std::pair<InternalKey, Value>>& entries) {
+        for (const auto& [internal_key, value] : entries) {
+            Add(internal_key, value);
+        }
+    }
+
     // Finalize table creation. Subsequent calls are undefined.
     virtual void Finish() = 0;
 
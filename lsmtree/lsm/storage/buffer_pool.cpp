@@ -1,11 +1,27 @@
 #include "lsm/storage/buffer_pool.h"
 
+#include <fcntl.h>
+#include <lsm/common/perf_context.h>
+#include <lsm/common/thread_pool.h>
+#include <lsm/storage/compression.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <cstdint>
 #include <cstring>
-#include <fstream>
+#include <future>
 #include <list>
 #include <memory>
-#include <stack>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -13,121 +29,869 @@
 
 namespace lsm::storage {
 
-class ReadFrameProvider : public IReadFrameProvider {
+namespace {
+
+// Frames are aligned for O_DIRECT reads whether or not direct I/O is enabled
+constexpr uint64_t kFrameAlignment = 4096;
+
+class ReadFrame : public IFrame {
    public:
-    ReadFrameProvider(const std::string& dir, uint64_t frame_size, uint64_t* read_bytes) : frame_size_(frame_size), read_bytes_(read_bytes), dir_(dir) {}
+    explicit ReadFrame(uint64_t size) : size_(size), storage_(static_cast<uint8_t*>(std::aligned_alloc(kFrameAlignment, (size + kFrameAlignment - 1) / kFrameAlignment * kFrameAlignment))) {
+        std::memset(storage_.get(), 0, size_);
+    }
+
+    uint8_t* Data() override { return storage_.get(); }
+    uint64_t Size() override { return size_; }
+
+    void MarkDirty() override {}
+
+   private:
+    struct Free {
+        void operator()(uint8_t* data) const { std::free(data); }
+    };
+
+    uint64_t size_;
+    std::unique_ptr<uint8_t, Free> storage_;
+};
 
-    void Start(uint32_t table_id) override {
-        file_ = std::make_unique<std::ifstream>(dir_ + "/sstable_" + std::to_string(table_id), std::ios::binary);
+// Filesystems without O_DIRECT support (tmpfs) reject the flag, those fall back to buffered reads
+int OpenTableFile(const std::string& path, bool direct_io) {
+    int fd = open(path.c_str(), O_RDONLY | (direct_io ? O_DIRECT : 0));
+    if (fd < 0 && direct_io && errno == EINVAL) {
+        fd = open(path.c_str(), O_RDONLY);
     }
+    return fd;
+}
 
-    std::shared_ptr<IFrame> GetFrame(FrameId id) override {
-        if (!file_) {
-            Start(id.table_id);
+constexpr uint64_t kMaxIovecs = IOV_MAX;
+
+// Reads consecutive frames starting at frame l with one preadv per kMaxIovecs frames.
+// The last frame of a table is usually short, the rest of it is zeroed.
+void ReadFrames(int fd, uint64_t l, const std::vector<std::shared_ptr<IFrame>>& frames, uint64_t frame_size) {
+    for (uint64_t first = 0; first < frames.size(); first += kMaxIovecs) {
+        uint64_t count = std::min<uint64_t>(kMaxIovecs, frames.size() - first);
+        std::vector<iovec> iovecs(count);
+        for (uint64_t ind = 0; ind < count; ++ind) {
+            iovecs[ind] = {frames[first + ind]->Data(), frame_size};
+        }
+        ssize_t read = preadv(fd, iovecs.data(), count, static_cast<off_t>((l + first) * frame_size));
+        if (read < 0) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to read frames [" + std::to_string(l + first) + ", " + std::to_string(l + first + count - 1) + "]");
+        }
+        for (uint64_t ind = read / frame_size; ind < count; ++ind) {
+            uint64_t filled = std::max<int64_t>(read - static_cast<int64_t>(ind * frame_size), 0);
+            std::memset(frames[first + ind]->Data() + filled, 0, frame_size - filled);
         }
-        std::vector<uint8_t> buffer(frame_size_);
-        file_->seekg(id.page_id * frame_size_);
-        file_->read(reinterpret_cast<char*>(buffer.data()), buffer.size());
-        *read_bytes_ += buffer.size();
-        return std::make_shared<ReadFrame>(buffer);
     }
+}
+
+void AddReadBytes(uint64_t* read_bytes, uint64_t bytes) { std::atomic_ref<uint64_t>(*read_bytes).fetch_add(bytes, std::memory_order_relaxed); }
 
-    void Finish() override {
-        if (file_ && file_->is_open()) {
-            file_->close();
-            file_ = nullptr;
+// Single page-aligned allocation that all pool frames are carved from
+class FrameArena {
+   public:
+    FrameArena(uint64_t frames, uint64_t frame_size, bool huge_pages) : frame_size_(frame_size) {
+        uint64_t alignment = huge_pages ? kHugePageSize : kFrameAlignment;
+        uint64_t size = (frames * frame_size + alignment - 1) / alignment * alignment;
+        memory_.reset(static_cast<uint8_t*>(std::aligned_alloc(alignment, size)));
+        if (!memory_) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to allocate " + std::to_string(size) + " bytes");
+        }
+        if (huge_pages) {
+            // Only a hint, kernels without transparent huge pages keep regular pages
+            madvise(memory_.get(), size, MADV_HUGEPAGE);
         }
     }
 
+    uint8_t* Slot(uint64_t index) { return memory_.get() + index * frame_size_; }
+
    private:
-    class ReadFrame : public IFrame {
-    public:
-        ReadFrame(std::vector<uint8_t> storage) : storage_(storage) {}
+    static constexpr uint64_t kHugePageSize = 2 * 1024 * 1024;
+
+    struct Free {
+        void operator()(uint8_t* data) const { std::free(data); }
+    };
+
+    uint64_t frame_size_;
+    std::unique_ptr<uint8_t, Free> memory_;
+};
 
-        uint8_t* Data() override { return reinterpret_cast<uint8_t*>(storage_.data()); }
-        uint64_t Size() override { return storage_.size(); }
+class ArenaFrame : public IFrame {
+   public:
+    ArenaFrame(std::shared_ptr<FrameArena> arena, uint64_t index, uint64_t size) : arena_(std::move(arena)), index_(index), size_(size) {}
+
+    uint8_t* Data() override { return arena_->Slot(index_); }
+    uint64_t Size() override { return size_; }
+
+    void MarkDirty() override {}
+
+    uint64_t Index() const { return index_; }
+
+   private:
+    std::shared_ptr<FrameArena> arena_;
+    uint64_t index_;
+    uint64_t size_;
+};
 
-        void MarkDirty() override {}
+}  // namespace
 
-    private:
-        std::vector<uint8_t> storage_;
+class ReadFrameProvider : public IReadFrameProvider {
+   public:
+    ReadFrameProvider(const std::string& dir, uint64_t frame_size, uint64_t* read_bytes, uint64_t max_open_files, bool direct_io)
+        : frame_size_(frame_size), read_bytes_(read_bytes), max_open_files_(std::max<uint64_t>(max_open_files, 1)), direct_io_(direct_io), dir_(dir) {}
+
+    std::shared_ptr<IFrame> GetFrame(FrameId id) override { return GetFrames(id.table_id, id.page_id, id.page_id)[0]; }
+
+    std::vector<std::shared_ptr<IFrame>> GetFrames(uint32_t table_id, uint32_t l, uint32_t r) override {
+        std::vector<std::shared_ptr<IFrame>> result;
+        result.reserve(r - l + 1);
+        for (uint32_t ind = l; ind <= r; ++ind) {
+            result.push_back(std::make_shared<ReadFrame>(frame_size_));
+        }
+        ReadInto(table_id, l, result);
+        return result;
+    }
+
+    void ReadInto(uint32_t table_id, uint32_t l, const std::vector<std::shared_ptr<IFrame>>& frames) override {
+        auto file = OpenTable(table_id);
+        ReadFrames(file->fd, l, frames, frame_size_);
+        AddReadBytes(read_bytes_, frames.size() * frame_size_);
+    }
+
+    uint32_t NumFrames(uint32_t table_id) override {
+        auto file = OpenTable(table_id);
+        struct stat st;
+        if (fstat(file->fd, &st) != 0) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to stat sstable_" + std::to_string(table_id));
+        }
+        return (st.st_size + frame_size_ - 1) / frame_size_;
+    }
+
+    void CloseTable(uint32_t table_id) override {
+        std::lock_guard lock(mutex_);
+        if (fd_iterators_.contains(table_id)) {
+            fd_list_.erase(fd_iterators_[table_id]);
+            fd_iterators_.erase(table_id);
+        }
+    }
+
+   private:
+    // Closed once it is both out of the LRU and not being read from
+    struct TableFile {
+        int fd;
+
+        ~TableFile() { close(fd); }
     };
 
+    std::shared_ptr<TableFile> OpenTable(uint32_t table_id) {
+        std::lock_guard lock(mutex_);
+        if (fd_iterators_.contains(table_id)) {
+            fd_list_.splice(fd_list_.begin(), fd_list_, fd_iterators_[table_id]);
+            return fd_list_.front().second;
+        }
+        int fd = OpenTableFile(dir_ + "/sstable_" + std::to_string(table_id), direct_io_);
+        if (fd < 0) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to open sstable_" + std::to_string(table_id));
+        }
+        if (fd_list_.size() == max_open_files_) {
+            fd_iterators_.erase(fd_list_.back().first);
+            fd_list_.pop_back();
+        }
+        fd_list_.push_front({table_id, std::make_shared<TableFile>(fd)});
+        fd_iterators_[table_id] = fd_list_.begin();
+        return fd_list_.front().second;
+    }
+
     uint64_t frame_size_;
     uint64_t* read_bytes_;
+    uint64_t max_open_files_;
+    bool direct_io_;
     std::string dir_;
-    std::unique_ptr<std::ifstream> file_ = nullptr;
+    std::mutex mutex_;
+    std::list<std::pair<uint32_t, std::shared_ptr<TableFile>>> fd_list_;
+    std::unordered_map<uint32_t, std::list<std::pair<uint32_t, std::shared_ptr<TableFile>>>::iterator> fd_iterators_;
 };
 
-std::shared_ptr<IReadFrameProvider> MakeReadFrameProvider(const std::string& dir, uint64_t frame_size, uint64_t* read_bytes) { return std::make_shared<ReadFrameProvider>(dir, frame_size, read_bytes); }
+std::shared_ptr<IReadFrameProvider> MakeReadFrameProvider(const std::string& dir, uint64_t frame_size, uint64_t* read_bytes, uint64_t max_open_files, bool direct_io) {
+    return std::make_shared<ReadFrameProvider>(dir, frame_size, read_bytes, max_open_files, direct_io);
+}
 
-class ReadBufferPool : public IReadBufferPool {
+// Serves background frame reads on a thread pool. Every read opens its own descriptor,
+// so workers never share state with the synchronous provider.
+class AsyncFrameReader {
    public:
-    explicit ReadBufferPool(std::shared_ptr<IReadFrameProvider> frame_provider, uint64_t entries_limit)
-        : frame_provider_(frame_provider), hot_limit_(entries_limit / 2), entries_limit_(entries_limit) {}
+    struct Result {
+        // Leading frames that were read, the rest lie past the end of the table
+        uint64_t frames_read = 0;
+        uint64_t read_bytes = 0;
+    };
 
-    std::shared_ptr<IFrame> GetFrame(FrameId id) override {
-        uint64_t uid;
-        std::memcpy(&uid, &id, sizeof(uid));
-        if (hot_iterators_.contains(uid)) {
-            return hot_iterators_[uid]->second;
-        } else if (cold_iterators_.contains(uid)) {
-            auto cold_frame = *cold_iterators_[uid];
-            cold_list_.erase(cold_iterators_[uid]);
-            cold_iterators_.erase(uid);
-            if (hot_list_.size() == hot_limit_) {
-                auto hot_frame = hot_list_.back();
-                hot_list_.pop_back();
-                hot_iterators_.erase(hot_frame.first);
-                cold_list_.push_front(hot_frame);
-                cold_iterators_[hot_frame.first] = cold_list_.begin();
-            }
-            hot_list_.push_front(cold_frame);
-            hot_iterators_[cold_frame.first] = hot_list_.begin();
-            return cold_frame.second;
-        } else {
-            auto new_frame = std::pair(uid, frame_provider_->GetFrame(id));
-            if (cold_list_.size() == entries_limit_ - hot_list_.size()) {
-                auto cold_frame = cold_list_.back();
-                cold_list_.pop_back();
-                cold_iterators_.erase(cold_frame.first);
-                std::stack<std::pair<uint64_t, std::shared_ptr<IFrame>>> return_back;
-                while (cold_frame.second.use_count() > 1) {
-                    return_back.push(cold_frame);
-                    cold_frame = cold_list_.back();
-                    cold_list_.pop_back();
-                    cold_iterators_.erase(cold_frame.first);
+    AsyncFrameReader(const std::string& dir, uint64_t frame_size, size_t threads, bool direct_io) : frame_size_(frame_size), direct_io_(direct_io), dir_(dir), workers_(threads) {}
+
+    // Fills frames starting at frame l, the caller keeps them alive until the result is ready
+    std::future<Result> Read(uint32_t table_id, uint32_t l, std::vector<std::shared_ptr<IFrame>> frames) {
+        return workers_.Submit([path = dir_ + "/sstable_" + std::to_string(table_id), frame_size = frame_size_, direct_io = direct_io_, l, frames = std::move(frames)]() mutable {
+            Result result;
+            int fd = OpenTableFile(path, direct_io);
+            if (fd < 0) {
+                return result;
+            }
+            struct stat stat_buffer;
+            if (fstat(fd, &stat_buffer) == 0 && stat_buffer.st_size > 0) {
+                uint64_t table_frames = (stat_buffer.st_size - 1) / frame_size + 1;
+                if (l < table_frames) {
+                    frames.resize(std::min<uint64_t>(frames.size(), table_frames - l));
+                    try {
+                        ReadFrames(fd, l, frames, frame_size);
+                        result = {frames.size(), frames.size() * frame_size};
+                    } catch (const std::runtime_error&) {
+                        result = {};
+                    }
                 }
-                while (!return_back.empty()) {
-                    cold_list_.push_back(return_back.top());
-                    cold_iterators_[return_back.top().first] = --cold_list_.end();
-                    return_back.pop();
+            }
+            close(fd);
+            return result;
+        });
+    }
+
+   private:
+    uint64_t frame_size_;
+    bool direct_io_;
+    std::string dir_;
+    ThreadPool workers_;
+};
+
+// Second tier of a shard: frames evicted from the ARC lists, compressed and kept in LRU order.
+// A hit moves the frame back to the first tier, so a frame is never held by both.
+class CompressedFrameCache {
+   public:
+    explicit CompressedFrameCache(uint64_t capacity) : capacity_(capacity) {}
+
+    bool Contains(uint64_t uid) const { return iterators_.contains(uid); }
+
+    // Looks the frame up for a first tier miss and counts the outcome
+    bool Probe(uint64_t uid) {
+        bool hit = Contains(uid);
+        ++(hit ? stats_.hits : stats_.misses);
+        return hit;
+    }
+
+    void Put(uint64_t uid, IFrame& frame) {
+        auto data = Compress(frame.Data(), frame.Size());
+        bool raw = data.size() >= frame.Size();
+        if (raw) {
+            data.assign(frame.Data(), frame.Data() + frame.Size());
+        }
+        if (data.size() > capacity_) {
+            return;
+        }
+        Erase(uid);
+        stats_.bytes += data.size();
+        ++stats_.frames;
+        entries_.push_front({uid, raw, std::move(data)});
+        iterators_[uid] = entries_.begin();
+        while (stats_.bytes > capacity_) {
+            Erase(entries_.back().uid);
+        }
+    }
+
+    // Restores the frame into out and drops it from the tier
+    bool Take(uint64_t uid, IFrame& out) {
+        if (!Contains(uid)) {
+            return false;
+        }
+        auto& entry = *iterators_[uid];
+        bool restored = false;
+        if (!entry.raw) {
+            restored = Decompress(entry.data.data(), entry.data.size(), out.Data(), out.Size());
+        } else if (entry.data.size() == out.Size()) {
+            std::memcpy(out.Data(), entry.data.data(), out.Size());
+            restored = true;
+        }
+        Erase(uid);
+        return restored;
+    }
+
+    const CompressedCacheStats& Stats() const { return stats_; }
+
+   private:
+    struct Entry {
+        uint64_t uid;
+        // Incompressible frames are kept as they are
+        bool raw;
+        std::vector<uint8_t> data;
+    };
+
+    void Erase(uint64_t uid) {
+        auto it = iterators_.find(uid);
+        if (it == iterators_.end()) {
+            return;
+        }
+        stats_.bytes -= it->second->data.size();
+        --stats_.frames;
+        entries_.erase(it->second);
+        iterators_.erase(it);
+    }
+
+    uint64_t capacity_;
+    CompressedCacheStats stats_;
+    std::list<Entry> entries_;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> iterators_;
+};
+
+// ARC-style frame cache (Megiddo & Modha). Frames seen once live in T1, frames hit again move to T2,
+// and the ghost lists B1/B2 remember recently evicted ids to adapt the T1 target size.
+// Scan reads never promote frames to T2 nor leave ghosts, so a long scan only recycles T1.
+//
+// Frames are handed out pinned: the returned handle keeps a pin until it is destroyed.
+// Pinned frames are taken out of the T1/T2 lists, so eviction never has to skip them.
+//
+// One cache is one shard of the pool: it owns a slice of the frame arena, an optional
+// compressed tier for evicted frames and its own lock.
+class ArcFrameCache : public std::enable_shared_from_this<ArcFrameCache> {
+   public:
+    ArcFrameCache(std::shared_ptr<FrameArena> arena, uint64_t first_slot, uint64_t capacity, uint64_t frame_size, uint64_t compressed_capacity)
+        : capacity_(capacity), frame_size_(frame_size), arena_(std::move(arena)) {
+        if (compressed_capacity) {
+            compressed_ = std::make_unique<CompressedFrameCache>(compressed_capacity);
+        }
+        free_slots_.reserve(capacity);
+        for (uint64_t ind = 0; ind < capacity; ++ind) {
+            free_slots_.push_back(first_slot + capacity - ind - 1);
+        }
+    }
+
+    bool Contains(uint64_t uid) {
+        std::lock_guard lock(mutex_);
+        return resident_.contains(uid) || (compressed_ && compressed_->Contains(uid));
+    }
+
+    // Returns a pinned handle to the cached frame, or nullptr on a miss.
+    // Frames found in the compressed tier are restored without I/O.
+    std::shared_ptr<IFrame> Lookup(uint64_t uid, ReadHint hint) {
+        std::lock_guard lock(mutex_);
+        if (auto frame = LookupLocked(uid, hint)) {
+            return frame;
+        }
+        if (!compressed_ || !compressed_->Probe(uid)) {
+            return nullptr;
+        }
+        auto frame = AllocateLocked(uid);
+        // Making room may have pushed the entry out of the compressed tier
+        if (!compressed_->Take(uid, *frame)) {
+            ReleaseLocked(frame);
+            return nullptr;
+        }
+        return InsertLocked(uid, std::move(frame), hint);
+    }
+
+    // Returns a frame to read uid into. It comes from the arena, evicting a frame when no slot is free,
+    // and from the heap only when every frame of the shard is pinned.
+    std::shared_ptr<IFrame> Allocate(uint64_t uid) {
+        std::lock_guard lock(mutex_);
+        return AllocateLocked(uid);
+    }
+
+    // Gives back an allocated frame that was not inserted
+    void Release(const std::shared_ptr<IFrame>& frame) {
+        std::lock_guard lock(mutex_);
+        ReleaseLocked(frame);
+    }
+
+    // Caches a frame read for uid and returns a pinned handle to it.
+    // If another reader cached uid first, the frame is released and the cached one is returned.
+    std::shared_ptr<IFrame> Insert(uint64_t uid, std::shared_ptr<IFrame> frame, ReadHint hint) {
+        std::lock_guard lock(mutex_);
+        return InsertLocked(uid, std::move(frame), hint);
+    }
+
+    CompressedCacheStats CompressedStats() {
+        std::lock_guard lock(mutex_);
+        return compressed_ ? compressed_->Stats() : CompressedCacheStats{};
+    }
+
+    uint64_t Capacity() const { return capacity_; }
+
+    uint64_t ResidentFrames() {
+        std::lock_guard lock(mutex_);
+        return resident_.size();
+    }
+
+   private:
+    enum List { kT1, kT2, kB1, kB2 };
+
+    struct Slot {
+        uint64_t uid;
+        std::shared_ptr<IFrame> frame;
+        List list;
+        // Only ever read by scans, evicted without leaving a ghost
+        bool scan;
+        uint32_t pins = 0;
+        std::list<uint64_t>::iterator position;
+    };
+
+    std::shared_ptr<IFrame> AllocateLocked(uint64_t uid) {
+        if (free_slots_.empty()) {
+            EvictOne(ghost_iterators_.contains(uid) && ghost_iterators_[uid].first == kB2);
+        }
+        if (free_slots_.empty()) {
+            return std::make_shared<ReadFrame>(frame_size_);
+        }
+        uint64_t slot = free_slots_.back();
+        free_slots_.pop_back();
+        return std::make_shared<ArenaFrame>(arena_, slot, frame_size_);
+    }
+
+    std::shared_ptr<IFrame> InsertLocked(uint64_t uid, std::shared_ptr<IFrame> frame, ReadHint hint) {
+        if (resident_.contains(uid)) {
+            ReleaseLocked(frame);
+            return LookupLocked(uid, hint);
+        }
+        bool point = hint == ReadHint::kPoint;
+        List list = kT1;
+        bool ghost_in_b2 = false;
+        if (ghost_iterators_.contains(uid)) {
+            auto [ghost_list, position] = ghost_iterators_[uid];
+            ghost_in_b2 = ghost_list == kB2;
+            if (point) {
+                // A recently evicted frame is requested again: grow the list that lost it
+                if (ghost_list == kB1) {
+                    target_t1_ = std::min(capacity_, target_t1_ + std::max<uint64_t>(b2_.size() / b1_.size(), 1));
+                } else {
+                    target_t1_ -= std::min(target_t1_, std::max<uint64_t>(b1_.size() / b2_.size(), 1));
                 }
+                list = kT2;
+            }
+            (ghost_list == kB1 ? b1_ : b2_).erase(position);
+            ghost_iterators_.erase(uid);
+        }
+        // Only heap frames take the shard over capacity
+        while (resident_.size() >= capacity_ && EvictOne(ghost_in_b2)) {
+        }
+
+        auto slot = std::make_shared<Slot>();
+        slot->uid = uid;
+        slot->frame = std::move(frame);
+        slot->list = list;
+        slot->scan = !point;
+        (list == kT1 ? t1_size_ : t2_size_) += 1;
+        auto& entries = list == kT1 ? t1_ : t2_;
+        entries.push_front(uid);
+        slot->position = entries.begin();
+        resident_[uid] = slot;
+        TrimGhosts();
+        return Pin(slot);
+    }
+
+    std::shared_ptr<IFrame> LookupLocked(uint64_t uid, ReadHint hint) {
+        auto it = resident_.find(uid);
+        if (it == resident_.end()) {
+            return nullptr;
+        }
+        auto slot = it->second;
+        // Pinning takes the slot out of its list, so it can be moved to T2 freely
+        auto frame = Pin(slot);
+        if (hint == ReadHint::kPoint) {
+            if (slot->list == kT1) {
+                --t1_size_;
+                ++t2_size_;
+                slot->list = kT2;
             }
-            cold_list_.push_front(new_frame);
-            cold_iterators_[new_frame.first] = cold_list_.begin();
-            return new_frame.second;
+            slot->scan = false;
         }
+        return frame;
     }
 
-    std::vector<std::shared_ptr<IFrame>> GetFrames(uint32_t table_id, uint32_t l, uint32_t r) override {
+    void ReleaseLocked(const std::shared_ptr<IFrame>& frame) {
+        if (auto arena_frame = dynamic_cast<ArenaFrame*>(frame.get())) {
+            free_slots_.push_back(arena_frame->Index());
+        }
+    }
+
+    std::shared_ptr<IFrame> Pin(const std::shared_ptr<Slot>& slot) {
+        if (slot->pins++ == 0) {
+            (slot->list == kT1 ? t1_ : t2_).erase(slot->position);
+        }
+        return std::shared_ptr<IFrame>(slot->frame.get(), [slot, cache = weak_from_this()](IFrame*) {
+            if (auto self = cache.lock()) {
+                self->Unpin(slot);
+            }
+        });
+    }
+
+    void Unpin(const std::shared_ptr<Slot>& slot) {
+        std::lock_guard lock(mutex_);
+        if (--slot->pins == 0) {
+            auto& list = slot->list == kT1 ? t1_ : t2_;
+            list.push_front(slot->uid);
+            slot->position = list.begin();
+        }
+    }
+
+    // Returns false when every resident frame is pinned
+    bool EvictOne(bool ghost_in_b2) {
+        bool from_t1 = !t1_.empty() && (t1_size_ > target_t1_ || (ghost_in_b2 && t1_size_ == target_t1_) || t2_.empty());
+        if (!from_t1 && t2_.empty()) {
+            return false;
+        }
+        auto& list = from_t1 ? t1_ : t2_;
+        auto slot = resident_[list.back()];
+        list.pop_back();
+        resident_.erase(slot->uid);
+        (from_t1 ? t1_size_ : t2_size_) -= 1;
+        if (compressed_ && !slot->scan) {
+            compressed_->Put(slot->uid, *slot->frame);
+        }
+        ReleaseLocked(slot->frame);
+        if (!slot->scan) {
+            auto& ghosts = from_t1 ? b1_ : b2_;
+            ghosts.push_front(slot->uid);
+            ghost_iterators_[slot->uid] = {from_t1 ? kB1 : kB2, ghosts.begin()};
+        }
+        return true;
+    }
+
+    // Keeps |T1| + |B1| <= c and |T1| + |T2| + |B1| + |B2| <= 2c
+    void TrimGhosts() {
+        while (!b1_.empty() && t1_size_ + b1_.size() > capacity_) {
+            ghost_iterators_.erase(b1_.back());
+            b1_.pop_back();
+        }
+        while (resident_.size() + b1_.size() + b2_.size() > 2 * capacity_ && !(b1_.empty() && b2_.empty())) {
+            auto& ghosts = b2_.empty() ? b1_ : b2_;
+            ghost_iterators_.erase(ghosts.back());
+            ghosts.pop_back();
+        }
+    }
+
+    std::mutex mutex_;
+    uint64_t capacity_;
+    uint64_t frame_size_;
+    std::shared_ptr<FrameArena> arena_;
+    // Arena slots of this shard that hold no frame
+    std::vector<uint64_t> free_slots_;
+    std::unique_ptr<CompressedFrameCache> compressed_;
+    // Adaptive target size of T1
+    uint64_t target_t1_ = 0;
+    // Resident frames per list, pinned ones included
+    uint64_t t1_size_ = 0;
+    uint64_t t2_size_ = 0;
+    // Unpinned frames in LRU order, most recent first
+    std::list<uint64_t> t1_, t2_;
+    std::list<uint64_t> b1_, b2_;
+    std::unordered_map<uint64_t, std::shared_ptr<Slot>> resident_;
+    std::unordered_map<uint64_t, std::pair<List, std::list<uint64_t>::iterator>> ghost_iterators_;
+};
+
+// Frames are spread over shards by a hash of their id, so concurrent readers mostly take different locks.
+// Pending background reads and readahead state are shared by all shards behind a separate lock.
+class ReadBufferPool : public IReadBufferPool {
+   public:
+    ReadBufferPool(std::shared_ptr<IReadFrameProvider> frame_provider, const ReadBufferPoolOptions& options, std::unique_ptr<AsyncFrameReader> async_reader, uint64_t* read_bytes)
+        : frame_provider_(frame_provider), async_reader_(std::move(async_reader)), frame_size_(options.frame_size), readahead_frames_(options.readahead_frames), read_bytes_(read_bytes) {
+        uint64_t entries = options.pool_size / options.frame_size;
+        uint64_t shards = options.shards ? options.shards : std::clamp<uint64_t>(entries / kFramesPerShard, 1, kMaxAutoShards);
+        shards = std::min(shards, std::max<uint64_t>(entries, 1));
+        entries = std::max(entries, shards);
+        auto arena = std::make_shared<FrameArena>(entries, options.frame_size, options.huge_pages);
+        for (uint64_t ind = 0, first_slot = 0; ind < shards; ++ind) {
+            uint64_t capacity = entries / shards + (ind < entries % shards);
+            shards_.push_back(std::make_shared<ArcFrameCache>(arena, first_slot, capacity, options.frame_size, options.compressed_cache_size / shards));
+            first_slot += capacity;
+        }
+    }
+
+    std::shared_ptr<IFrame> GetFrame(FrameId id, ReadHint hint) override {
+        CollectFinishedReads();
+        if (auto frame = Fetch(id, hint)) {
+            PerfCount(&PerfContext::frame_hits);
+            return frame;
+        }
+        PerfCount(&PerfContext::frame_misses);
+        auto& shard = Shard(ToUid(id));
+        auto frame = shard.Allocate(ToUid(id));
+        ReadInto(id.table_id, id.page_id, {frame});
+        return shard.Insert(ToUid(id), std::move(frame), hint);
+    }
+
+    // Runs of missing frames are read from the provider with one request each
+    std::vector<std::shared_ptr<IFrame>> GetFrames(uint32_t table_id, uint32_t l, uint32_t r, ReadHint hint) override {
+        CollectFinishedReads();
         std::vector<std::shared_ptr<IFrame>> result;
         result.reserve(r - l + 1);
+        for (uint32_t ind = l; ind <= r;) {
+            if (auto frame = Fetch({table_id, ind}, hint)) {
+                PerfCount(&PerfContext::frame_hits);
+                result.push_back(frame);
+                ++ind;
+                continue;
+            }
+            uint32_t last = ind;
+            while (last < r && !Contains(ToUid({table_id, last + 1}))) {
+                ++last;
+            }
+            PerfCount(&PerfContext::frame_misses, last - ind + 1);
+            auto frames = Allocate(table_id, ind, last);
+            ReadInto(table_id, ind, frames);
+            for (auto& frame : frames) {
+                uint64_t uid = ToUid({table_id, ind++});
+                result.push_back(Shard(uid).Insert(uid, std::move(frame), hint));
+            }
+        }
+        ReadAhead(table_id, l, r);
+        return result;
+    }
+
+    void Prefetch(uint32_t table_id, uint32_t l, uint32_t r) override {
+        if (!async_reader_) {
+            return;
+        }
+        CollectFinishedReads();
         for (uint32_t ind = l; ind <= r; ++ind) {
-            result.push_back(GetFrame({table_id, ind}));
+            if (Contains(ToUid({table_id, ind}))) {
+                continue;
+            }
+            uint32_t last = ind;
+            while (last < r && !Contains(ToUid({table_id, last + 1}))) {
+                ++last;
+            }
+            auto frames = Allocate(table_id, ind, last);
+            auto pending = std::make_shared<PendingRead>(PendingRead{table_id, ind, frames, async_reader_->Read(table_id, ind, frames)});
+            std::lock_guard lock(pending_mutex_);
+            pending_list_.push_back(pending);
+            for (; ind <= last; ++ind) {
+                pending_[ToUid({table_id, ind})] = pending;
+            }
+        }
+    }
+
+    void CloseTable(uint32_t table_id) override {
+        {
+            std::lock_guard lock(pending_mutex_);
+            readahead_.erase(table_id);
+        }
+        frame_provider_->CloseTable(table_id);
+    }
+
+    CompressedCacheStats GetCompressedCacheStats() override {
+        CompressedCacheStats result;
+        for (auto& shard : shards_) {
+            auto stats = shard->CompressedStats();
+            result.hits += stats.hits;
+            result.misses += stats.misses;
+            result.frames += stats.frames;
+            result.bytes += stats.bytes;
+        }
+        return result;
+    }
+
+    BufferPoolMemory GetMemoryUsage() override {
+        BufferPoolMemory result;
+        for (auto& shard : shards_) {
+            result.capacity_bytes += shard->Capacity() * frame_size_;
+            result.resident_bytes += shard->ResidentFrames() * frame_size_;
         }
-        frame_provider_->Finish();
         return result;
     }
 
    private:
-    std::list<std::pair<uint64_t, std::shared_ptr<IFrame>>> hot_list_, cold_list_;
-    std::unordered_map<uint64_t, std::_List_iterator<std::pair<uint64_t, std::shared_ptr<IFrame>>>> hot_iterators_, cold_iterators_;
+    struct PendingRead {
+        uint32_t table_id;
+        uint32_t l;
+        std::vector<std::shared_ptr<IFrame>> frames;
+        std::future<AsyncFrameReader::Result> result;
+    };
+
+    struct ReadAheadState {
+        uint32_t last_page;
+        // Frames read in a row without jumping around the table
+        uint32_t streak;
+        uint32_t prefetched_until;
+        // Frames of the table, 0 until the first readahead looks them up
+        uint32_t table_frames = 0;
+    };
+
+    // Sequential streak, in frames, after which a table is read ahead
+    static constexpr uint32_t kReadAheadTrigger = 4;
+    // Shard count when none is given: one shard per kFramesPerShard frames, at most kMaxAutoShards
+    static constexpr uint64_t kFramesPerShard = 256;
+    static constexpr uint64_t kMaxAutoShards = 16;
+
+    ArcFrameCache& Shard(uint64_t uid) {
+        // Fibonacci hashing, consecutive frames of a table land in different shards
+        return *shards_[((uid * 0x9E3779B97F4A7C15ull) >> 32) % shards_.size()];
+    }
+
+    std::vector<std::shared_ptr<IFrame>> Allocate(uint32_t table_id, uint32_t l, uint32_t r) {
+        std::vector<std::shared_ptr<IFrame>> frames;
+        frames.reserve(r - l + 1);
+        for (uint32_t ind = l; ind <= r; ++ind) {
+            uint64_t uid = ToUid({table_id, ind});
+            frames.push_back(Shard(uid).Allocate(uid));
+        }
+        return frames;
+    }
+
+    // Gives the allocated frames back to their shards if the read fails
+    void ReadInto(uint32_t table_id, uint32_t l, const std::vector<std::shared_ptr<IFrame>>& frames) {
+        PerfTimer timer(&PerfContext::frame_read_nanos);
+        try {
+            frame_provider_->ReadInto(table_id, l, frames);
+        } catch (...) {
+            for (uint32_t ind = 0; ind < frames.size(); ++ind) {
+                uint64_t uid = ToUid({table_id, l + ind});
+                Shard(uid).Release(frames[ind]);
+            }
+            throw;
+        }
+    }
+
+    // Returns the cached frame or waits for its pending read, nullptr if neither exists
+    std::shared_ptr<IFrame> Fetch(FrameId id, ReadHint hint) {
+        uint64_t uid = ToUid(id);
+        if (auto frame = Shard(uid).Lookup(uid, hint)) {
+            return frame;
+        }
+        std::shared_ptr<PendingRead> pending;
+        {
+            std::lock_guard lock(pending_mutex_);
+            if (!pending_.contains(uid)) {
+                return nullptr;
+            }
+            pending = pending_[uid];
+            pending_list_.remove(pending);
+            Forget(*pending);
+        }
+        Adopt(*pending);
+        return Shard(uid).Lookup(uid, hint);
+    }
+
+    void CollectFinishedReads() {
+        if (!async_reader_) {
+            return;
+        }
+        std::vector<std::shared_ptr<PendingRead>> finished;
+        {
+            std::lock_guard lock(pending_mutex_);
+            for (auto it = pending_list_.begin(); it != pending_list_.end();) {
+                if ((*it)->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                    Forget(**it);
+                    finished.push_back(*it);
+                    it = pending_list_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (auto& pending : finished) {
+            Adopt(*pending);
+        }
+    }
+
+    // Whoever takes a read out of pending_ adopts it, the others read the frames themselves
+    void Forget(const PendingRead& pending) {
+        for (uint32_t ind = 0; ind < pending.frames.size(); ++ind) {
+            pending_.erase(ToUid({pending.table_id, pending.l + ind}));
+        }
+    }
+
+    // Prefetched frames enter the cache as scan reads until someone looks them up
+    void Adopt(PendingRead& pending) {
+        auto result = pending.result.get();
+        AddReadBytes(read_bytes_, result.read_bytes);
+        for (uint32_t ind = 0; ind < pending.frames.size(); ++ind) {
+            uint64_t uid = ToUid({pending.table_id, pending.l + ind});
+            if (ind < result.frames_read) {
+                Shard(uid).Insert(uid, std::move(pending.frames[ind]), ReadHint::kScan);
+            } else {
+                Shard(uid).Release(pending.frames[ind]);
+            }
+        }
+    }
+
+    void ReadAhead(uint32_t table_id, uint32_t l, uint32_t r) {
+        if (!async_reader_ || readahead_frames_ == 0) {
+            return;
+        }
+        uint32_t prefetch_from;
+        uint32_t table_frames;
+        {
+            std::lock_guard lock(pending_mutex_);
+            auto [it, inserted] = readahead_.try_emplace(table_id, ReadAheadState{r, 0, r});
+            auto& state = it->second;
+            if (inserted) {
+                return;
+            }
+            if ((l == state.last_page || l == state.last_page + 1) && r >= state.last_page) {
+                state.streak += r - state.last_page;
+            } else {
+                state.streak = 0;
+                state.prefetched_until = r;
+            }
+            state.last_page = r;
+            if (state.streak < kReadAheadTrigger || state.prefetched_until >= r + readahead_frames_ / 2) {
+                return;
+            }
+            prefetch_from = std::max(state.prefetched_until, r) + 1;
+            state.prefetched_until = r + readahead_frames_;
+            table_frames = state.table_frames;
+        }
+        if (table_frames == 0) {
+            table_frames = frame_provider_->NumFrames(table_id);
+            std::lock_guard lock(pending_mutex_);
+            if (auto it = readahead_.find(table_id); it != readahead_.end()) {
+                it->second.table_frames = table_frames;
+            }
+        }
+        // Frames past the end of the table would only take slots from cached ones
+        if (prefetch_from < table_frames) {
+            Prefetch(table_id, prefetch_from, std::min(r + readahead_frames_, table_frames - 1));
+        }
+    }
+
+    static uint64_t ToUid(FrameId id) {
+        uint64_t uid;
+        std::memcpy(&uid, &id, sizeof(uid));
+        return uid;
+    }
+
+    bool Contains(uint64_t uid) {
+        if (Shard(uid).Contains(uid)) {
+            return true;
+        }
+        std::lock_guard lock(pending_mutex_);
+        return pending_.contains(uid);
+    }
+
     std::shared_ptr<IReadFrameProvider> frame_provider_;
-    uint64_t hot_limit_;
-    uint64_t entries_limit_;
+    std::vector<std::shared_ptr<ArcFrameCache>> shards_;
+    std::unique_ptr<AsyncFrameReader> async_reader_;
+    uint64_t frame_size_;
+    uint32_t readahead_frames_;
+    uint64_t* read_bytes_;
+    std::mutex pending_mutex_;
+    std::list<std::shared_ptr<PendingRead>> pending_list_;
+    std::unordered_map<uint64_t, std::shared_ptr<PendingRead>> pending_;
+    std::unordered_map<uint32_t, ReadAheadState> readahead_;
 };
 
-std::shared_ptr<IReadBufferPool> MakeReadBufferPool(std::string dir, uint64_t pool_size, uint64_t frame_size, uint64_t* read_bytes) { return std::make_shared<ReadBufferPool>(MakeReadFrameProvider(dir, frame_size, read_bytes), pool_size / frame_size); }
+std::shared_ptr<IReadBufferPool> MakeReadBufferPool(std::string dir, const ReadBufferPoolOptions& options, uint64_t* read_bytes) {
+    if (options.direct_io && options.frame_size % kDirectIoBlockSize != 0) {
+        throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": frame size " + std::to_string(options.frame_size) + " is not a multiple of " + std::to_string(kDirectIoBlockSize) +
+                                 " required by direct I/O");
+    }
+    std::unique_ptr<AsyncFrameReader> async_reader = nullptr;
+    if (options.io_threads) {
+        async_reader = std::make_unique<AsyncFrameReader>(dir, options.frame_size, options.io_threads, options.direct_io);
+    }
+    return std::make_shared<ReadBufferPool>(MakeReadFrameProvider(dir, options.frame_size, read_bytes, options.max_open_files, options.direct_io), options, std::move(async_reader), read_bytes);
+}
+
+std::shared_ptr<IReadBufferPool> MakeReadBufferPool(std::string dir, uint64_t pool_size, uint64_t frame_size, uint64_t* read_bytes) {
+    ReadBufferPoolOptions options;
+    options.pool_size = pool_size;
+    options.frame_size = frame_size;
+    return MakeReadBufferPool(std::move(dir), options, read_bytes);
+}
 
 }  // namespace lsm::storage
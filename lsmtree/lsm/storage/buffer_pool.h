@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace lsm::storage {
@@ -25,23 +26,83 @@ static_assert(sizeof(FrameId) == 8);
 
 class IReadFrameProvider {
    public:
-    virtual void Start(uint32_t) = 0;
     virtual std::shared_ptr<IFrame> GetFrame(FrameId) = 0;
-    virtual void Finish() = 0;
+    // Reads frames [l, r] of the table with a single request
+    virtual std::vector<std::shared_ptr<IFrame>> GetFrames(uint32_t table_id, uint32_t l, uint32_t r) = 0;
+    // Reads frames [l, l + frames.size()) of the table into the given frames with a single request
+    virtual void ReadInto(uint32_t table_id, uint32_t l, const std::vector<std::shared_ptr<IFrame>>& frames) = 0;
+    // Frames the table spans, the last one may be partial
+    virtual uint32_t NumFrames(uint32_t table_id) = 0;
+    // Drops any handle kept open for the table, called before its file is removed
+    virtual void CloseTable(uint32_t table_id) = 0;
 
     virtual ~IReadFrameProvider() = default;
 };
 
-std::shared_ptr<IReadFrameProvider> MakeReadFrameProvider(const std::string& dir, uint64_t frame_size, uint64_t* read_bytes);
+// Smallest unit of O_DIRECT reads, frame sizes must be a multiple of it
+constexpr uint64_t kDirectIoBlockSize = 512;
+
+// Keeps at most max_open_files descriptors open, the least recently used one is closed first
+std::shared_ptr<IReadFrameProvider> MakeReadFrameProvider(const std::string& dir, uint64_t frame_size, uint64_t* read_bytes, uint64_t max_open_files = 64, bool direct_io = false);
+
+struct CompressedCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Frames currently held and their compressed size
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+};
+
+struct BufferPoolMemory {
+    // The frame arena, allocated up front, and the frames of it holding table pages
+    uint64_t capacity_bytes = 0;
+    uint64_t resident_bytes = 0;
+};
 
+// Point reads are lookups that may repeat, scan reads come from iterators and compactions
+// and touch every frame once, so they must not push the hot set out of the pool
+enum class ReadHint { kPoint, kScan };
+
+// Replacement is ARC-like and scan resistant. Returned frames stay pinned in the pool
+// and are never evicted while a caller still holds them. Safe to use from several threads.
 class IReadBufferPool {
    public:
-    virtual std::shared_ptr<IFrame> GetFrame(FrameId id) = 0;
-    virtual std::vector<std::shared_ptr<IFrame>> GetFrames(uint32_t table_id, uint32_t l, uint32_t r) = 0;
+    virtual std::shared_ptr<IFrame> GetFrame(FrameId id, ReadHint hint = ReadHint::kPoint) = 0;
+    virtual std::vector<std::shared_ptr<IFrame>> GetFrames(uint32_t table_id, uint32_t l, uint32_t r, ReadHint hint = ReadHint::kPoint) = 0;
+    // Starts loading frames [l, r] of the table in the background and returns immediately.
+    // A later GetFrame(s) on these frames waits for the pending read instead of issuing a new one.
+    virtual void Prefetch(uint32_t table_id, uint32_t l, uint32_t r) = 0;
+    virtual void CloseTable(uint32_t table_id) = 0;
+    // Counters of the compressed tier, all zero when it is disabled
+    virtual CompressedCacheStats GetCompressedCacheStats() = 0;
+    virtual BufferPoolMemory GetMemoryUsage() = 0;
 
     virtual ~IReadBufferPool() = default;
 };
 
+struct ReadBufferPoolOptions {
+    uint64_t pool_size = 64ull * 1024 * 1024;
+    uint64_t frame_size = 4096;
+    // Number of SSTable descriptors kept open between reads
+    uint64_t max_open_files = 64;
+    // Threads serving Prefetch and sequential readahead, 0 keeps every read synchronous
+    uint32_t io_threads = 0;
+    // Frames requested ahead of a table that is being read sequentially
+    uint32_t readahead_frames = 16;
+    // Read tables with O_DIRECT, bypassing the page cache so that pool_size is the whole read cache.
+    // frame_size must be a multiple of the device block size.
+    bool direct_io = false;
+    // Independently locked parts of the pool, 0 picks a count from pool_size
+    uint32_t shards = 0;
+    // Ask for transparent huge pages for the frame arena
+    bool huge_pages = false;
+    // Bytes of compressed frames kept after eviction, a miss checks them before going to disk.
+    // 0 disables the tier.
+    uint64_t compressed_cache_size = 0;
+};
+
+std::shared_ptr<IReadBufferPool> MakeReadBufferPool(std::string dir, const ReadBufferPoolOptions& options, uint64_t* read_bytes = new uint64_t());
+
 std::shared_ptr<IReadBufferPool> MakeReadBufferPool(std::string dir, uint64_t pool_size, uint64_t frame_size = 4096, uint64_t* read_bytes = new uint64_t());
 
 }  // namespace lsm::storage
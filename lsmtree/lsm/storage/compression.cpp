@@ -0,0 +1,127 @@
+#include "lsm/storage/compression.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lsm::storage {
+
+namespace {
+
+constexpr uint64_t kMinMatch = 4;
+constexpr uint64_t kMaxOffset = 65535;
+constexpr uint64_t kHashBits = 12;
+// Length nibble value meaning that extension bytes follow
+constexpr uint64_t kLengthMask = 15;
+
+uint32_t Load32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t value) { return (value * 2654435761u) >> (32 - kHashBits); }
+
+void PutLength(std::vector<uint8_t>& out, uint64_t length) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(255);
+    }
+    out.push_back(length);
+}
+
+bool GetLength(const uint8_t* data, uint64_t size, uint64_t& pos, uint64_t& length) {
+    uint8_t byte;
+    do {
+        if (pos == size) {
+            return false;
+        }
+        byte = data[pos++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// A match_length of 0 marks the last sequence, which carries literals only
+void PutSequence(std::vector<uint8_t>& out, const uint8_t* literals, uint64_t literal_count, uint64_t offset, uint64_t match_length) {
+    uint64_t match_code = match_length ? match_length - kMinMatch : 0;
+    out.push_back((std::min(literal_count, kLengthMask) << 4) | std::min(match_code, kLengthMask));
+    if (literal_count >= kLengthMask) {
+        PutLength(out, literal_count - kLengthMask);
+    }
+    out.insert(out.end(), literals, literals + literal_count);
+    if (match_length == 0) {
+        return;
+    }
+    out.push_back(offset & 0xff);
+    out.push_back(offset >> 8);
+    if (match_code >= kLengthMask) {
+        PutLength(out, match_code - kLengthMask);
+    }
+}
+
+}  // namespace
+
+std::vector<uint8_t> Compress(const uint8_t* data, uint64_t size) {
+    std::vector<uint8_t> out;
+    out.reserve(size / 2 + 16);
+    std::vector<int64_t> last_seen(1ull << kHashBits, -1);
+    uint64_t anchor = 0;
+    for (uint64_t pos = 0; pos + kMinMatch <= size;) {
+        uint32_t sequence = Load32(data + pos);
+        int64_t candidate = last_seen[Hash(sequence)];
+        last_seen[Hash(sequence)] = pos;
+        if (candidate < 0 || pos - candidate > kMaxOffset || Load32(data + candidate) != sequence) {
+            ++pos;
+            continue;
+        }
+        uint64_t length = kMinMatch;
+        while (pos + length < size && data[candidate + length] == data[pos + length]) {
+            ++length;
+        }
+        PutSequence(out, data + anchor, pos - anchor, pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+    PutSequence(out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool Decompress(const uint8_t* data, uint64_t compressed_size, uint8_t* out, uint64_t size) {
+    uint64_t pos = 0, written = 0;
+    while (pos < compressed_size) {
+        uint8_t token = data[pos++];
+        uint64_t literal_count = token >> 4;
+        if (literal_count == kLengthMask && !GetLength(data, compressed_size, pos, literal_count)) {
+            return false;
+        }
+        if (literal_count > compressed_size - pos || literal_count > size - written) {
+            return false;
+        }
+        std::memcpy(out + written, data + pos, literal_count);
+        pos += literal_count;
+        written += literal_count;
+        if (pos == compressed_size) {
+            break;
+        }
+
+        if (compressed_size - pos < 2) {
+            return false;
+        }
+        uint64_t offset = data[pos] | (data[pos + 1] << 8);
+        pos += 2;
+        uint64_t match_length = token & kLengthMask;
+        if (match_length == kLengthMask && !GetLength(data, compressed_size, pos, match_length)) {
+            return false;
+        }
+        match_length += kMinMatch;
+        if (offset == 0 || offset > written || match_length > size - written) {
+            return false;
+        }
+        // Matches may overlap their own output, so copy byte by byte
+        for (uint64_t ind = 0; ind < match_length; ++ind, ++written) {
+            out[written] = out[written - offset];
+        }
+    }
+    return written == size;
+}
+
+}  // namespace lsm::storage
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace lsm::storage {
+
+// Byte-oriented LZ77 block compression in the spirit of LZ4: fast enough to run on every
+// buffer pool eviction, with no external dependency. Sequences are a token (literal and
+// match length nibbles), literals, a 16-bit match offset and length extension bytes.
+std::vector<uint8_t> Compress(const uint8_t* data, uint64_t size);
+
+// Decompresses exactly `size` bytes into `out`, returns false on malformed input
+bool Decompress(const uint8_t* data, uint64_t compressed_size, uint8_t* out, uint64_t size);
+
+}  // namespace lsm::storage
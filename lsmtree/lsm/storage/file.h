@@ -1,37 +1,53 @@
 #pragma once
 
+#include <fcntl.h>
 #include <lsm/storage/buffer_pool.h>
+#include <lsm/storage/rate_limiter.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace lsm::storage {
 
 class IFile {
    public:
-    virtual std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes) const = 0;
+    // The hint tells point lookups from scans, files that don't cache reads ignore it
+    virtual std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes, ReadHint hint = ReadHint::kPoint) const = 0;
     virtual void Write(const uint8_t* data, uint64_t size) = 0;
     virtual uint64_t Size() const = 0;
 
+    // Zero-copy read. Returns an empty span if the file can't expose its storage directly;
+    // callers must fall back to Read then. The view stays valid while the file is alive.
+    virtual std::span<const uint8_t> ReadView(uint64_t offset, uint64_t bytes) const { return {}; }
+
     virtual ~IFile() = default;
 };
 
 class BufferedMemoryFile : public IFile {
    public:
-    BufferedMemoryFile(const std::string& dir, uint64_t table_id, const std::shared_ptr<IReadBufferPool>& buffer_pool, uint64_t frame_size = 4096) : table_id_(table_id), frame_size_(frame_size), buffer_pool_(buffer_pool), dir_(dir) {}
+    BufferedMemoryFile(const std::string& dir, uint64_t table_id, const std::shared_ptr<IReadBufferPool>& buffer_pool, uint64_t frame_size = 4096, bool direct_io = false)
+        : table_id_(table_id), frame_size_(frame_size), direct_io_(direct_io), buffer_pool_(buffer_pool), dir_(dir) {}
 
-    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes) const override {
+    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes, ReadHint hint = ReadHint::kPoint) const override {
         if (offset + bytes > Size()) {
             throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to read " + std::to_string(bytes) + " bytes from offset " + std::to_string(offset) + " (file size is " +
                                      std::to_string(size_) + ")");
         }
         std::vector<uint8_t> result(bytes);
         uint64_t l = offset / frame_size_, r = (offset + bytes - 1) / frame_size_;
-        auto frames = buffer_pool_->GetFrames(table_id_, l, r);
+        auto frames = buffer_pool_->GetFrames(table_id_, l, r, hint);
         if (l == r) {
             std::memcpy(result.data(), frames[0]->Data() + offset % frame_size_, bytes);
         } else {
@@ -51,16 +67,34 @@ class BufferedMemoryFile : public IFile {
         file.write(reinterpret_cast<const char*>(data), size);
         file.close();
         size_ = size;
+        if (direct_io_) {
+            DropFromPageCache();
+        }
     }
 
     uint64_t Size() const override { return size_; }
 
-    ~BufferedMemoryFile() { std::filesystem::remove(dir_ + "/sstable_" + std::to_string(table_id_)); }
+    ~BufferedMemoryFile() {
+        buffer_pool_->CloseTable(table_id_);
+        std::filesystem::remove(dir_ + "/sstable_" + std::to_string(table_id_));
+    }
 
    private:
+    // With direct I/O the table is only ever read around the page cache, so keeping
+    // the freshly written pages there would just take memory from the buffer pool
+    void DropFromPageCache() const {
+        int fd = open((dir_ + "/sstable_" + std::to_string(table_id_)).c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+
     uint64_t size_ = 0;
     uint64_t table_id_;
     uint64_t frame_size_;
+    bool direct_io_;
     std::shared_ptr<IReadBufferPool> buffer_pool_;
     std::string dir_;
 };
@@ -69,7 +103,7 @@ class MemoryFile : public IFile {
    public:
     MemoryFile(const std::string& path, uint64_t* read_bytes = new uint64_t()) : read_bytes_(read_bytes), path_(path) {}
 
-    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes) const override {
+    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes, ReadHint hint = ReadHint::kPoint) const override {
         if (offset + bytes > Size()) {
             throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to read " + std::to_string(bytes) + " bytes from offset " + std::to_string(offset) + " (file size is " +
                                      std::to_string(size_) + ")");
@@ -78,7 +112,7 @@ class MemoryFile : public IFile {
         std::ifstream file(path_, std::ios::binary);
         file.seekg(offset);
         file.read(reinterpret_cast<char*>(result.data()), result.size());
-        *read_bytes_ += result.size();
+        std::atomic_ref<uint64_t>(*read_bytes_).fetch_add(result.size(), std::memory_order_relaxed);
         file.close();
         return result;
     }
@@ -100,9 +134,141 @@ class MemoryFile : public IFile {
     std::string path_;
 };
 
+// Immutable file that is mapped into memory once after Write.
+// Reads are served from the mapping, so they cost no syscalls once the pages are cached.
+class MmapFile : public IFile {
+   public:
+    MmapFile(const std::string& path, uint64_t* read_bytes = new uint64_t()) : read_bytes_(read_bytes), path_(path) {}
+
+    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes, ReadHint hint = ReadHint::kPoint) const override {
+        auto view = ReadView(offset, bytes);
+        return std::vector<uint8_t>(view.begin(), view.end());
+    }
+
+    std::span<const uint8_t> ReadView(uint64_t offset, uint64_t bytes) const override {
+        if (offset + bytes > Size()) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to read " + std::to_string(bytes) + " bytes from offset " + std::to_string(offset) + " (file size is " +
+                                     std::to_string(size_) + ")");
+        }
+        std::atomic_ref<uint64_t>(*read_bytes_).fetch_add(bytes, std::memory_order_relaxed);
+        return {data_ + offset, bytes};
+    }
+
+    void Write(const uint8_t* data, uint64_t size) override {
+        Unmap();
+        std::ofstream file(path_, std::ios::trunc | std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data), size);
+        file.close();
+        size_ = size;
+        if (size_ == 0) {
+            return;
+        }
+        int fd = open(path_.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to open " + path_);
+        }
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to map " + path_);
+        }
+        data_ = static_cast<uint8_t*>(mapping);
+        // Point lookups dominate, readahead around them would only fill the page cache
+        madvise(data_, size_, MADV_RANDOM);
+    }
+
+    uint64_t Size() const override { return size_; }
+
+    ~MmapFile() {
+        Unmap();
+        std::filesystem::remove(path_);
+    }
+
+   private:
+    void Unmap() {
+        if (data_) {
+            munmap(data_, size_);
+            data_ = nullptr;
+        }
+    }
+
+    uint64_t size_ = 0;
+    uint8_t* data_ = nullptr;
+    uint64_t* read_bytes_;
+    std::string path_;
+};
+
+// Draws the reads and writes of a file from a rate limiter. Tables are wrapped only while a flush or
+// compaction reads or writes them, foreground reads go to the table file directly. Every job wraps
+// the tables it uses on its own, so a wrapper is never shared between threads.
+class RateLimitedFile : public IFile {
+   public:
+    // Read-only, Write throws
+    RateLimitedFile(std::shared_ptr<const IFile> file, std::shared_ptr<IRateLimiter> rate_limiter, IoSource source)
+        : file_(std::move(file)), rate_limiter_(std::move(rate_limiter)), source_(source) {}
+
+    RateLimitedFile(std::shared_ptr<IFile> file, std::shared_ptr<IRateLimiter> rate_limiter, IoSource source)
+        : file_(file), writable_file_(file), rate_limiter_(std::move(rate_limiter)), source_(source) {}
+
+    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes, ReadHint hint = ReadHint::kPoint) const override {
+        Charge(offset, bytes);
+        return file_->Read(offset, bytes, hint);
+    }
+
+    // Callers fall back to Read on an empty view, so only views that are served are paid for
+    std::span<const uint8_t> ReadView(uint64_t offset, uint64_t bytes) const override {
+        auto view = file_->ReadView(offset, bytes);
+        if (!view.empty()) {
+            Charge(offset, bytes);
+        }
+        return view;
+    }
+
+    void Write(const uint8_t* data, uint64_t size) override {
+        if (!writable_file_) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": the file is read-only");
+        }
+        rate_limiter_->Request(source_, size);
+        writable_file_->Write(data, size);
+    }
+
+    uint64_t Size() const override { return file_->Size(); }
+
+   private:
+    static constexpr uint64_t kBlockSize = 4096;
+
+    // Reads are paid for by the block, the first time one of them touches it: a scan reading the
+    // table row by row asks the rate limiter once per block rather than once per row
+    void Charge(uint64_t offset, uint64_t bytes) const {
+        if (bytes == 0) {
+            return;
+        }
+        uint64_t first = offset / kBlockSize, last = (offset + bytes - 1) / kBlockSize;
+        if (charged_.size() <= last) {
+            charged_.resize(last + 1, false);
+        }
+        uint64_t charge = 0;
+        for (uint64_t block = first; block <= last; ++block) {
+            if (!charged_[block]) {
+                charged_[block] = true;
+                charge += std::min((block + 1) * kBlockSize, file_->Size()) - block * kBlockSize;
+            }
+        }
+        if (charge) {
+            rate_limiter_->Request(source_, charge);
+        }
+    }
+
+    std::shared_ptr<const IFile> file_;
+    std::shared_ptr<IFile> writable_file_;
+    std::shared_ptr<IRateLimiter> rate_limiter_;
+    IoSource source_;
+    mutable std::vector<bool> charged_;
+};
+
 class TestMemoryFile : public IFile {
    public:
-    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes) const override {
+    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes, ReadHint hint = ReadHint::kPoint) const override {
         if (offset + bytes > storage_.size()) {
             throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to read " + std::to_string(bytes) + " bytes from offset " + std::to_string(offset) + " (file size is " +
                                      std::to_string(storage_.size()) + ")");
@@ -112,6 +278,14 @@ class TestMemoryFile : public IFile {
         return result;
     }
 
+    std::span<const uint8_t> ReadView(uint64_t offset, uint64_t bytes) const override {
+        if (offset + bytes > storage_.size()) {
+            throw std::runtime_error(std::string(__PRETTY_FUNCTION__) + ": failed to read " + std::to_string(bytes) + " bytes from offset " + std::to_string(offset) + " (file size is " +
+                                     std::to_string(storage_.size()) + ")");
+        }
+        return {storage_.data() + offset, bytes};
+    }
+
     void Write(const uint8_t* data, uint64_t size) override {
         if (storage_.size() < size) {
             storage_.resize(size);
@@ -0,0 +1,115 @@
+#include <lsm/storage/rate_limiter.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace lsm::storage {
+
+namespace {
+
+constexpr double kBurstSeconds = 0.1;
+
+// Bytes requested and bytes paid for by the refill are counted from the start. A request is
+// served once the refill has caught up with it and everything requested before it.
+class TokenBucket {
+   public:
+    explicit TokenBucket(uint64_t bytes_per_second) : bytes_per_second_(bytes_per_second), refilled_(kBurstSeconds * bytes_per_second), last_refill_(Clock::now()) {}
+
+    void Request(uint64_t bytes) {
+        std::unique_lock lock(mutex_);
+        ++stats_.requests;
+        stats_.bytes += bytes;
+        Refill();
+        requested_ += bytes;
+        uint64_t position = requested_;
+        if (bytes_per_second_ == 0) {
+            refilled_ = requested_;
+            return;
+        }
+        if (refilled_ >= position) {
+            return;
+        }
+        ++stats_.throttled_requests;
+        auto start = Clock::now();
+        while (refilled_ < position) {
+            cv_.wait_for(lock, std::chrono::duration<double>((position - refilled_) / bytes_per_second_));
+            Refill();
+        }
+        stats_.throttled_micros += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    }
+
+    void SetBytesPerSecond(uint64_t bytes_per_second) {
+        {
+            std::lock_guard lock(mutex_);
+            Refill();
+            bytes_per_second_ = bytes_per_second;
+        }
+        cv_.notify_all();
+    }
+
+    uint64_t GetBytesPerSecond() const {
+        std::lock_guard lock(mutex_);
+        return bytes_per_second_;
+    }
+
+    RateLimiterStats GetStats() const {
+        std::lock_guard lock(mutex_);
+        return stats_;
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    // Without a limit every request is paid for at once
+    void Refill() {
+        auto now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_refill_).count();
+        last_refill_ = now;
+        if (bytes_per_second_ == 0) {
+            refilled_ = requested_;
+            return;
+        }
+        refilled_ = std::min(refilled_ + elapsed * bytes_per_second_, requested_ + kBurstSeconds * bytes_per_second_);
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t bytes_per_second_;
+    uint64_t requested_ = 0;
+    double refilled_;
+    Clock::time_point last_refill_;
+    RateLimiterStats stats_;
+};
+
+class RateLimiter : public IRateLimiter {
+   public:
+    RateLimiter(uint64_t flush_bytes_per_second, uint64_t compaction_bytes_per_second) : flush_(flush_bytes_per_second), compaction_(compaction_bytes_per_second) {}
+
+    void Request(IoSource source, uint64_t bytes) override { Bucket(source).Request(bytes); }
+
+    void SetBytesPerSecond(IoSource source, uint64_t bytes_per_second) override { Bucket(source).SetBytesPerSecond(bytes_per_second); }
+
+    uint64_t GetBytesPerSecond(IoSource source) const override { return Bucket(source).GetBytesPerSecond(); }
+
+    RateLimiterStats GetStats(IoSource source) const override { return Bucket(source).GetStats(); }
+
+   private:
+    TokenBucket& Bucket(IoSource source) { return source == IoSource::kFlush ? flush_ : compaction_; }
+
+    const TokenBucket& Bucket(IoSource source) const { return source == IoSource::kFlush ? flush_ : compaction_; }
+
+    TokenBucket flush_;
+    TokenBucket compaction_;
+};
+
+}  // namespace
+
+std::shared_ptr<IRateLimiter> MakeRateLimiter(uint64_t flush_bytes_per_second, uint64_t compaction_bytes_per_second) {
+    return std::make_shared<RateLimiter>(flush_bytes_per_second, compaction_bytes_per_second);
+}
+
+}  // namespace lsm::storage
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace lsm::storage {
+
+// Background I/O on behalf of which a rate limiter is asked for tokens
+enum class IoSource { kFlush, kCompaction };
+
+struct RateLimiterStats {
+    uint64_t requests = 0;
+    uint64_t bytes = 0;
+    // Requests that had to wait for tokens and the total time they waited
+    uint64_t throttled_requests = 0;
+    uint64_t throttled_micros = 0;
+};
+
+// Token buckets bounding the bytes per second flushes and compactions read and write, so that their
+// bursts leave disk bandwidth to foreground reads. Every source has a bucket of its own holding up to
+// 100ms worth of tokens. Requests are served in order and never split: a large one runs the bucket
+// into debt that the following ones wait out. Safe to use from several threads.
+class IRateLimiter {
+   public:
+    // Blocks until the source's bucket has paid for the bytes
+    virtual void Request(IoSource source, uint64_t bytes) = 0;
+    // Takes effect at once, also for requests already waiting. 0 removes the limit.
+    virtual void SetBytesPerSecond(IoSource source, uint64_t bytes_per_second) = 0;
+    virtual uint64_t GetBytesPerSecond(IoSource source) const = 0;
+    virtual RateLimiterStats GetStats(IoSource source) const = 0;
+
+    virtual ~IRateLimiter() = default;
+};
+
+// Limits of 0 leave the source unlimited, its requests are still counted
+std::shared_ptr<IRateLimiter> MakeRateLimiter(uint64_t flush_bytes_per_second, uint64_t compaction_bytes_per_second);
+
+}  // namespace lsm::storage
@@ -0,0 +1,212 @@
+#include </home/lim/HSE/Projects/IBIS/contrib/gtest/gtest.h>
+#include <lsm/bloom_filter/bloom_filter.h>
+#include <lsm/bloom_filter/filter_allocation.h>
+#include <lsm/common/hash.h>
+#include <lsm/utils/lsm_utils.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace lsm {
+namespace {
+
+TEST(Hash, SpreadsSimilarKeys) {
+    std::set<uint64_t> hashes;
+    for (uint32_t length = 0; length <= 100; ++length) {
+        std::vector<uint8_t> key(length, 'a');
+        hashes.insert(Hash64(key.data(), key.size()));
+        if (length) {
+            key.back() = 'b';
+            hashes.insert(Hash64(key.data(), key.size()));
+        }
+    }
+    EXPECT_EQ(hashes.size(), 201);
+
+    std::vector<uint8_t> key = {1, 2, 3};
+    EXPECT_EQ(Hash64(key.data(), key.size()), Hash64(key.data(), key.size()));
+    EXPECT_NE(Hash64(key.data(), key.size(), 1), Hash64(key.data(), key.size(), 2));
+}
+
+TEST(BlockedBloomFilter, NoFalseNegatives) {
+    std::mt19937 rng(1);
+    auto builder = MakeBlockedFilterBuilder(10 * 5000, 7);
+    std::vector<UserKey> keys;
+    for (int ind = 0; ind < 5000; ++ind) {
+        keys.push_back(GenerateRandomKey(rng, 1, 40));
+        builder->Add(keys.back());
+    }
+    builder->Add({});
+    auto filter = MakeBlockedFilterDeserializer()->Deserialize(builder->Serialize());
+    for (const auto& key : keys) {
+        ASSERT_TRUE(filter->MayContain(key));
+    }
+    EXPECT_TRUE(filter->MayContain({}));
+}
+
+TEST(BlockedBloomFilter, FalsePositiveRate) {
+    std::mt19937 rng(2);
+    const int keys_count = 20000;
+    auto builder = MakeBlockedFilterBuilder(10 * keys_count, 7);
+    for (int ind = 0; ind < keys_count; ++ind) {
+        builder->Add(GenerateRandomKey(rng, 16, 16));
+    }
+    auto filter = MakeBlockedFilterDeserializer()->Deserialize(builder->Serialize());
+    int positives = 0;
+    for (int ind = 0; ind < 100000; ++ind) {
+        positives += filter->MayContain(GenerateRandomKey(rng, 17, 17));
+    }
+    // About 1% for an ideal bloom filter at 10 bits per key, blocking costs a little on top
+    EXPECT_LT(positives, 2000);
+}
+
+TEST(BlockedBloomFilter, Serialization) {
+    auto builder = MakeBlockedFilterBuilder(1000, 5);
+    builder->Add({1, 2, 3});
+    auto data = builder->Serialize();
+    EXPECT_EQ(data.size(), 16 + 2 * 64);
+
+    // Trailing bytes are ignored, truncated filters are rejected
+    auto padded = data;
+    padded.resize(data.size() + 100);
+    EXPECT_TRUE(MakeBlockedFilterDeserializer()->Deserialize(padded)->MayContain({1, 2, 3}));
+    data.pop_back();
+    EXPECT_THROW(MakeBlockedFilterDeserializer()->Deserialize(data), std::runtime_error);
+    EXPECT_THROW(MakeBlockedFilterDeserializer()->Deserialize({1, 2}), std::runtime_error);
+}
+
+TEST(BlockedBloomFilter, SizedByBitsPerKey) {
+    std::mt19937 rng(3);
+    auto small = MakeBlockedFilterBuilderByBitsPerKey(10);
+    auto large = MakeBlockedFilterBuilderByBitsPerKey(10);
+    std::vector<UserKey> keys;
+    for (int ind = 0; ind < 10000; ++ind) {
+        keys.push_back(GenerateRandomKey(rng, 8, 16));
+        large->Add(keys.back());
+        // Versions of the same key come in a row and take no extra space
+        large->Add(keys.back());
+    }
+    small->Add(keys[0]);
+
+    auto small_data = small->Serialize();
+    auto large_data = large->Serialize();
+    EXPECT_EQ(small_data.size(), 16 + 64);
+    EXPECT_EQ(large_data.size(), 16 + (10 * 10000 + 511) / 512 * 64);
+
+    auto filter = MakeBlockedFilterDeserializer()->Deserialize(large_data);
+    for (const auto& key : keys) {
+        ASSERT_TRUE(filter->MayContain(key));
+    }
+    EXPECT_TRUE(MakeBlockedFilterDeserializer()->Deserialize(small_data)->MayContain(keys[0]));
+
+    auto capped = MakeBlockedFilterBuilderByBitsPerKey(10, 0, 1024);
+    for (const auto& key : keys) {
+        capped->Add(key);
+    }
+    EXPECT_EQ(capped->Serialize().size(), 16 + 2 * 64);
+}
+
+TEST(FilterAllocation, MonkeyKeepsBudget) {
+    std::vector<double> level_keys = {2, 4, 8, 16, 32};
+    auto bits = AllocateFilterBitsPerKey(level_keys, 10);
+    ASSERT_EQ(bits.size(), level_keys.size());
+    double total = 0;
+    for (size_t ind = 0; ind < bits.size(); ++ind) {
+        total += bits[ind] * level_keys[ind];
+        if (ind) {
+            EXPECT_LT(bits[ind], bits[ind - 1]);
+        }
+    }
+    EXPECT_NEAR(total, 10 * 62, 1e-6);
+
+    // Optimal false positive rates are proportional to level sizes
+    double first_rate = std::exp(-bits[0] * std::log(2) * std::log(2));
+    double last_rate = std::exp(-bits.back() * std::log(2) * std::log(2));
+    EXPECT_NEAR(last_rate / first_rate, 16, 1e-3);
+
+    auto equal = AllocateFilterBitsPerKey({5, 5, 5}, 8);
+    for (double value : equal) {
+        EXPECT_NEAR(value, 8, 1e-6);
+    }
+    EXPECT_EQ(AllocateFilterBitsPerKey({}, 8).size(), 0);
+}
+
+TEST(FilterAllocation, MonkeyDropsFiltersOfHugeLevels) {
+    // With a tiny budget the largest level gets no bits at all
+    auto bits = AllocateFilterBitsPerKey({1, 1000}, 0.01);
+    EXPECT_GT(bits[0], 0);
+    EXPECT_NEAR(bits[1], 0, 1e-6);
+    EXPECT_NEAR(bits[0] + 1000 * bits[1], 0.01 * 1001, 1e-6);
+}
+
+TEST(FuseFilter, NoFalseNegatives) {
+    std::mt19937 rng(4);
+    for (int keys_count : {0, 1, 2, 3, 10, 100, 1000, 50000}) {
+        auto builder = MakeFuseFilterBuilder();
+        std::vector<UserKey> keys;
+        for (int ind = 0; ind < keys_count; ++ind) {
+            keys.push_back(GenerateRandomKey(rng, 1, 40));
+            builder->Add(keys.back());
+        }
+        auto filter = MakeFuseFilterDeserializer()->Deserialize(builder->Serialize());
+        for (const auto& key : keys) {
+            ASSERT_TRUE(filter->MayContain(key)) << keys_count;
+        }
+    }
+}
+
+TEST(FuseFilter, SmallerAndMoreAccurateThanBloom) {
+    std::mt19937 rng(5);
+    const int keys_count = 100000;
+    auto fuse = MakeFuseFilterBuilder();
+    auto bloom = MakeBlockedFilterBuilderByBitsPerKey(10);
+    for (int ind = 0; ind < keys_count; ++ind) {
+        auto key = GenerateRandomKey(rng, 16, 16);
+        fuse->Add(key);
+        // Repeated keys are stored once
+        fuse->Add(key);
+        bloom->Add(key);
+    }
+    auto fuse_data = fuse->Serialize();
+    auto bloom_data = bloom->Serialize();
+    EXPECT_LT(fuse_data.size() * 8, 9.6 * keys_count);
+    EXPECT_LT(fuse_data.size(), bloom_data.size());
+
+    auto fuse_filter = MakeFuseFilterDeserializer()->Deserialize(fuse_data);
+    auto bloom_filter = MakeBlockedFilterDeserializer()->Deserialize(bloom_data);
+    int fuse_positives = 0, bloom_positives = 0;
+    for (int ind = 0; ind < 100000; ++ind) {
+        auto key = GenerateRandomKey(rng, 17, 17);
+        fuse_positives += fuse_filter->MayContain(key);
+        bloom_positives += bloom_filter->MayContain(key);
+    }
+    // 1/256 for 8-bit fingerprints
+    EXPECT_LT(fuse_positives, 550);
+    EXPECT_LT(fuse_positives, bloom_positives);
+}
+
+TEST(FuseFilter, Serialization) {
+    auto fuse = MakeFuseFilterBuilder();
+    auto bloom = MakeBlockedFilterBuilder(1000, 5);
+    fuse->Add({1, 2, 3});
+    bloom->Add({1, 2, 3});
+    auto fuse_data = fuse->Serialize();
+    auto bloom_data = bloom->Serialize();
+
+    // The table deserializer tells both kinds apart
+    EXPECT_TRUE(MakeTableFilterDeserializer()->Deserialize(fuse_data)->MayContain({1, 2, 3}));
+    EXPECT_TRUE(MakeTableFilterDeserializer()->Deserialize(bloom_data)->MayContain({1, 2, 3}));
+    EXPECT_THROW(MakeFuseFilterDeserializer()->Deserialize(bloom_data), std::runtime_error);
+    EXPECT_THROW(MakeBlockedFilterDeserializer()->Deserialize(fuse_data), std::runtime_error);
+
+    fuse_data.pop_back();
+    EXPECT_THROW(MakeFuseFilterDeserializer()->Deserialize(fuse_data), std::runtime_error);
+    EXPECT_THROW(MakeTableFilterDeserializer()->Deserialize(fuse_data), std::runtime_error);
+    EXPECT_THROW(MakeFuseFilterDeserializer()->Deserialize({}), std::runtime_error);
+}
+
+}  // namespace
+}  // namespace lsm
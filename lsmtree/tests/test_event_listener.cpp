@@ -0,0 +1,244 @@
+#include </home/lim/HSE/Projects/IBIS/contrib/gtest/gtest.h>
+#include <lsm/event_listener.h>
+#include <lsm/lsm.h>
+#include <lsm/sstable.h>
+#include <lsm/utils/lsm_utils.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace lsm {
+namespace {
+
+class RecordingListener : public IEventListener {
+   public:
+    void OnFlushBegin(const CompactionJobInfo& info) override { Begin(info); }
+    void OnFlushCompleted(const CompactionJobInfo& info) override { Complete(info, true); }
+    void OnCompactionBegin(const CompactionJobInfo& info) override { Begin(info); }
+    void OnCompactionCompleted(const CompactionJobInfo& info) override { Complete(info, false); }
+
+    void OnTableCreated(const TableInfo& info) override {
+        std::lock_guard lock(mutex_);
+        live_.insert(Key(info));
+    }
+
+    void OnTableDeleted(const TableInfo& info) override {
+        std::lock_guard lock(mutex_);
+        auto it = live_.find(Key(info));
+        ASSERT_NE(it, live_.end());
+        live_.erase(it);
+    }
+
+    void OnWriteStallBegin(const WriteStallInfo& info) override {
+        std::lock_guard lock(mutex_);
+        ++stalls_begun_;
+    }
+
+    void OnWriteStallEnd(const WriteStallInfo& info) override {
+        std::lock_guard lock(mutex_);
+        ++stalls_ended_;
+    }
+
+    // Tables created and not deleted, which the levels hold once no job is running
+    void ExpectLiveTables(const ILevelsProvider& levels) {
+        std::multiset<std::tuple<UserKey, UserKey, uint64_t>> tables;
+        for (size_t level = 0; level < levels.NumLevels(); ++level) {
+            for (size_t ind = 0; ind < levels.NumTables(level); ++ind) {
+                tables.insert(Key({level, *levels.GetTableMetadata(level, ind)}));
+            }
+        }
+        std::lock_guard lock(mutex_);
+        EXPECT_TRUE(running_.empty());
+        EXPECT_EQ(live_, tables);
+    }
+
+    std::mutex mutex_;
+    size_t flushes_ = 0;
+    size_t compactions_ = 0;
+    size_t max_output_level_ = 0;
+    size_t stalls_begun_ = 0;
+    size_t stalls_ended_ = 0;
+
+   private:
+    static std::tuple<UserKey, UserKey, uint64_t> Key(const TableInfo& info) { return {info.metadata.min_key, info.metadata.max_key, info.metadata.file_size}; }
+
+    void Begin(const CompactionJobInfo& info) {
+        std::lock_guard lock(mutex_);
+        EXPECT_TRUE(running_.insert(info.job_id).second);
+        EXPECT_TRUE(info.input_tables.empty() && info.output_tables.empty());
+    }
+
+    void Complete(const CompactionJobInfo& info, bool flush) {
+        std::lock_guard lock(mutex_);
+        EXPECT_EQ(running_.erase(info.job_id), 1);
+        EXPECT_EQ(info.memtable_bytes != 0, flush);
+        uint64_t bytes_read = info.memtable_bytes;
+        for (const auto& table : info.input_tables) {
+            bytes_read += table.metadata.file_size;
+        }
+        uint64_t bytes_written = 0;
+        for (const auto& table : info.output_tables) {
+            bytes_written += table.metadata.file_size;
+            EXPECT_GE(table.level, info.output_level);
+            EXPECT_TRUE(live_.contains(Key(table)));
+        }
+        EXPECT_EQ(info.bytes_read, bytes_read);
+        EXPECT_EQ(info.bytes_written, bytes_written);
+        EXPECT_GT(bytes_written, 0);
+        ++(flush ? flushes_ : compactions_);
+        max_output_level_ = std::max(max_output_level_, info.output_level);
+    }
+
+    std::set<uint64_t> running_;
+    std::multiset<std::tuple<UserKey, UserKey, uint64_t>> live_;
+};
+
+// Checks that the levels hold what a completed job wrote to them and no longer hold what it deleted.
+// Background jobs complete with the LSM-tree's lock held, so the levels can be read from the callbacks,
+// and the deletions of a job come right after its completion.
+class InstalledTablesListener : public IEventListener {
+   public:
+    explicit InstalledTablesListener(std::shared_ptr<const ILevelsProvider> levels) : levels_(std::move(levels)) {}
+
+    void OnFlushCompleted(const CompactionJobInfo& info) override { Complete(info); }
+    void OnCompactionCompleted(const CompactionJobInfo& info) override { Complete(info); }
+
+    // An output may match a deleted input, as when a lone table merged into an empty level is rewritten as it is
+    void OnTableDeleted(const TableInfo& info) override {
+        if (std::none_of(outputs_.begin(), outputs_.end(), [&](const TableInfo& output) { return Same(output, info); })) {
+            EXPECT_FALSE(Installed(info));
+        }
+        ++deleted_;
+    }
+
+    size_t completed_ = 0;
+    size_t deleted_ = 0;
+
+   private:
+    // Outputs pushed on down wait for a later compaction, they are not on a level yet
+    void Complete(const CompactionJobInfo& info) {
+        for (const auto& table : info.output_tables) {
+            if (table.level == info.output_level) {
+                EXPECT_TRUE(Installed(table));
+            }
+        }
+        outputs_ = info.output_tables;
+        ++completed_;
+    }
+
+    static bool Same(const TableInfo& lhs, const TableInfo& rhs) {
+        return lhs.level == rhs.level && lhs.metadata.min_key == rhs.metadata.min_key && lhs.metadata.max_key == rhs.metadata.max_key && lhs.metadata.file_size == rhs.metadata.file_size;
+    }
+
+    bool Installed(const TableInfo& info) const {
+        for (size_t ind = 0; ind < levels_->NumTables(info.level); ++ind) {
+            if (Same({info.level, *levels_->GetTableMetadata(info.level, ind)}, info)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::shared_ptr<const ILevelsProvider> levels_;
+    std::vector<TableInfo> outputs_;
+};
+
+void Fill(ILSM& lsm, int operations) {
+    std::mt19937 rng(42);
+    for (int i = 0; i < operations; ++i) {
+        lsm.Put(GenerateRandomKey(rng, 5, 7), GenerateRandomKey(rng, 10, 20));
+    }
+}
+
+GranularLsmOptions SmallTables(std::shared_ptr<IEventListener> listener) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.listeners = {listener};
+    return options;
+}
+
+TEST(EventListener, GranularJobs) {
+    auto listener = std::make_shared<RecordingListener>();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    auto lsm = MakeGranularLsm(SmallTables(listener), files_provider, MakeSSTableFileFactory());
+    Fill(*lsm, 3'000);
+
+    EXPECT_GT(listener->flushes_, 10);
+    EXPECT_GT(listener->compactions_, 0);
+    EXPECT_EQ(listener->stalls_begun_, 0);
+    listener->ExpectLiveTables(*files_provider);
+}
+
+TEST(EventListener, GranularBackgroundJobsAndStalls) {
+    auto listener = std::make_shared<RecordingListener>();
+    auto options = SmallTables(listener);
+    options.compaction_threads = 1;
+    options.max_immutable_memtables = 1;
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    auto lsm = MakeGranularLsm(options, files_provider, MakeSSTableFileFactory());
+    Fill(*lsm, 3'000);
+    lsm->WaitForCompactions();
+
+    EXPECT_GT(listener->flushes_, 10);
+    EXPECT_GT(listener->compactions_, 0);
+    EXPECT_GT(listener->stalls_begun_, 0);
+    EXPECT_EQ(listener->stalls_ended_, listener->stalls_begun_);
+    listener->ExpectLiveTables(*files_provider);
+}
+
+TEST(EventListener, GranularBackgroundJobsCompleteOnceInstalled) {
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    auto listener = std::make_shared<InstalledTablesListener>(files_provider);
+    auto options = SmallTables(listener);
+    options.compaction_threads = 2;
+    auto lsm = MakeGranularLsm(options, files_provider, MakeSSTableFileFactory());
+    Fill(*lsm, 3'000);
+    lsm->WaitForCompactions();
+
+    EXPECT_GT(listener->completed_, 10);
+    EXPECT_GT(listener->deleted_, 0);
+}
+
+TEST(EventListener, LeveledJobs) {
+    auto listener = std::make_shared<RecordingListener>();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    auto lsm = MakeLeveledLsm(SmallTables(listener), files_provider, MakeSSTableFileFactory());
+    Fill(*lsm, 3'000);
+
+    // The memtable is carried down with the tables of every full level, so most jobs are flushes
+    EXPECT_GT(listener->flushes_, 10);
+    EXPECT_GT(listener->max_output_level_, 1);
+    listener->ExpectLiveTables(*files_provider);
+}
+
+TEST(EventListener, ChromeTrace) {
+    std::string path = "test_event_listener_trace.json";
+    {
+        auto files_provider = std::make_shared<TestLevelsProvider>();
+        auto lsm = MakeGranularLsm(SmallTables(MakeChromeTraceListener(path)), files_provider, MakeSSTableFileFactory());
+        Fill(*lsm, 3'000);
+    }
+    std::ifstream file(path);
+    std::string trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_GE(trace.size(), 4);
+    EXPECT_EQ(trace.substr(0, 2), "[\n");
+    EXPECT_EQ(trace.substr(trace.size() - 3), "\n]\n");
+    EXPECT_NE(trace.find("{\"name\": \"flush\", \"ph\": \"X\""), std::string::npos);
+    EXPECT_NE(trace.find("{\"name\": \"compaction L1\", \"ph\": \"X\""), std::string::npos);
+    EXPECT_NE(trace.find("{\"name\": \"table deleted\", \"ph\": \"i\""), std::string::npos);
+    EXPECT_EQ(trace.find(",\n]"), std::string::npos);
+    std::filesystem::remove(path);
+}
+
+}  // namespace
+}  // namespace lsm
@@ -0,0 +1,74 @@
+#include </home/lim/HSE/Projects/IBIS/contrib/gtest/gtest.h>
+#include <lsm/common/job_scheduler.h>
+
+#include <future>
+#include <mutex>
+#include <vector>
+
+namespace lsm {
+namespace {
+
+TEST(JobScheduler, FlushesRunInOrder) {
+    JobScheduler scheduler(1, 1);
+    std::vector<int> order;
+    std::promise<void> done;
+    for (int i = 0; i < 100; ++i) {
+        scheduler.ScheduleFlush([&order, &done, i] {
+            order.push_back(i);
+            if (i == 99) {
+                done.set_value();
+            }
+        });
+    }
+    done.get_future().wait();
+    ASSERT_EQ(order.size(), 100);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(order[i], i);
+    }
+}
+
+TEST(JobScheduler, CompactionsByScore) {
+    JobScheduler scheduler(1, 1);
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> started;
+    // Keeps the only compaction thread busy until all the others are queued
+    scheduler.ScheduleCompaction(0, [&started, released] {
+        started.set_value();
+        released.wait();
+    });
+    started.get_future().wait();
+
+    std::mutex mutex;
+    std::vector<double> order;
+    std::promise<void> done;
+    for (double score : {1.0, 3.0, 2.0, 3.0}) {
+        scheduler.ScheduleCompaction(score, [&, score] {
+            std::lock_guard lock(mutex);
+            order.push_back(score);
+            if (order.size() == 4) {
+                done.set_value();
+            }
+        });
+    }
+    // Flushes do not queue behind compactions
+    std::promise<void> flushed;
+    scheduler.ScheduleFlush([&flushed] { flushed.set_value(); });
+    flushed.get_future().wait();
+
+    release.set_value();
+    done.get_future().wait();
+    EXPECT_EQ(order, (std::vector<double>{3.0, 3.0, 2.0, 1.0}));
+}
+
+TEST(JobScheduler, PendingCompactionBytes) {
+    JobScheduler scheduler(1, 1);
+    EXPECT_EQ(scheduler.PendingCompactionBytes(), 0);
+    scheduler.AddPendingCompactionBytes(100);
+    scheduler.AddPendingCompactionBytes(50);
+    scheduler.RemovePendingCompactionBytes(100);
+    EXPECT_EQ(scheduler.PendingCompactionBytes(), 50);
+}
+
+}  // namespace
+}  // namespace lsm
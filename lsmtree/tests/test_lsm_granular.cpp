@@ -1,11 +1,16 @@
 #include </home/lim/HSE/Projects/IBIS/contrib/gtest/gtest.h>
+#include <lsm/bloom_filter/bloom_filter.h>
+#include <lsm/common/perf_context.h>
 #include <lsm/common/types.h>
 #include <lsm/lsm.h>
 #include <lsm/sstable.h>
 #include <lsm/utils/lsm_utils.h>
 
+#include <chrono>
 #include <map>
 #include <random>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace lsm {
@@ -25,6 +30,33 @@ TEST(LSMGranular, PutGet) {
     EXPECT_EQ(lsm->Get(k1), v1);
 }
 
+TEST(LSMGranular, PutMovesKeyAndValue) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, MakeSSTableFileFactory());
+
+    std::mt19937 rng(42);
+    std::map<UserKey, Value> expected;
+    for (int i = 0; i < 1'000; ++i) {
+        UserKey key = GenerateRandomKey(rng, 5, 7);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        expected[key] = value;
+        lsm->Put(std::move(key), std::move(value));
+        EXPECT_TRUE(key.empty());
+        EXPECT_TRUE(value.empty());
+    }
+    UserKey deleted = expected.begin()->first;
+    lsm->Delete(std::move(deleted));
+    EXPECT_TRUE(deleted.empty());
+    EXPECT_EQ(lsm->Get(expected.begin()->first), std::nullopt);
+    expected.erase(expected.begin());
+    for (const auto& [key, value] : expected) {
+        ASSERT_EQ(lsm->Get(key), value);
+    }
+}
+
 TEST(LSMGranular, Delete) {
     std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
     auto files_provider = std::make_shared<TestLevelsProvider>();
@@ -165,7 +197,7 @@ TEST(LSMGranular, SearchComplexityByKeyAge) {
 
     std::vector<TestInfo> test_cases = {
         TestInfo{.key = keys[k_keys_count - 1], .reads_lower_bound = 0u, .reads_upper_bound = 1u},  // in memtable or in first level
-        TestInfo{.key = keys[k_keys_count - 256], .reads_lower_bound = 1, .reads_upper_bound = 6}, TestInfo{.key = keys[0], .reads_lower_bound = 2, .reads_upper_bound = 10}  // oldest key
+        TestInfo{.key = keys[k_keys_count - 256], .reads_lower_bound = 1, .reads_upper_bound = 6}, TestInfo{.key = keys[0], .reads_lower_bound = 1, .reads_upper_bound = 10}  // oldest key, filters may skip every other table
     };
 
     for (auto [key, min_expected_reads, max_expected_reads] : test_cases) {
@@ -435,6 +467,420 @@ TEST(LSMGranular, Structure) {
     }
 }
 
+TEST(LSMGranular, SequentialKeysAreMovedDown) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::vector<UserKey> keys;
+    uint64_t bytes_written_in_ideal_world = 0;
+    const int k_keys_count = 6'000;
+    for (int i = 0; i < k_keys_count; ++i) {
+        // Ascending keys: every table pushed down overlaps nothing below and is moved, not rewritten
+        std::string digits = std::to_string(1'000'000 + i);
+        keys.emplace_back(digits.begin(), digits.end());
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(keys.back(), value);
+        bytes_written_in_ideal_world += sizeof(InternalKey::sequence_number) + sizeof(InternalKey::type) + sizeof(uint32_t) + keys.back().size() + sizeof(uint32_t) + value.size();
+    }
+
+    double write_amplification = static_cast<double>(files_provider->TotalBytesInserted()) / bytes_written_in_ideal_world;
+    std::cerr << "write amplification = " << write_amplification << std::endl;
+    EXPECT_LT(write_amplification, 3);
+
+    for (const auto& key : keys) {
+        ASSERT_TRUE(lsm->Get(key).has_value());
+    }
+    for (uint32_t level = 0; level < files_provider->NumLevels(); ++level) {
+        for (uint32_t i = 0; i + 1 < files_provider->NumTables(level); ++i) {
+            EXPECT_LT(files_provider->GetTableMetadata(level, i)->max_key, files_provider->GetTableMetadata(level, i + 1)->min_key);
+        }
+    }
+}
+
+TEST(LSMGranular, MovedTablesKeepTheirFilters) {
+    // Bytes read by ascending-key ingest: moved tables are not rewritten, the remainders merged into a level are read back
+    auto ingest_read_bytes = [](bool monkey_filters) {
+        GranularLsmOptions options;
+        options.memtable_bytes = 8192;
+        options.max_sstable_size = 4096;
+        options.bloom_filter_size = 1024;
+        options.monkey_filters = monkey_filters;
+        // Nodes of one link make memtable sizes, and so the tables written, the same on every run
+        options.max_level_skip_list = 1;
+        auto files_provider = std::make_shared<TestLevelsProvider>();
+        uint64_t read_bytes = 0;
+        std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, MakeSSTableFileFactory(), &read_bytes);
+
+        std::mt19937 rng(42);
+        std::vector<UserKey> keys;
+        for (int i = 0; i < 6'000; ++i) {
+            std::string digits = std::to_string(1'000'000 + i);
+            keys.emplace_back(digits.begin(), digits.end());
+            lsm->Put(keys.back(), GenerateRandomKey(rng, 10, 20));
+        }
+        uint64_t result = read_bytes;
+        EXPECT_GE(files_provider->NumLevels(), 3);
+        for (const auto& key : keys) {
+            EXPECT_TRUE(lsm->Get(key).has_value());
+        }
+        return result;
+    };
+    // Monkey gives every level its own bits per key, so there each moved table is read to rebuild its filter.
+    // Otherwise the filters built with the tables are kept.
+    uint64_t kept = ingest_read_bytes(false);
+    uint64_t rebuilt = ingest_read_bytes(true);
+    EXPECT_LT(kept, rebuilt * 3 / 4);
+}
+
+TEST(LSMGranular, PerfContext) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::map<UserKey, Value> expected;
+    for (int i = 0; i < 2'000; ++i) {
+        UserKey key = GenerateRandomKey(rng, 5, 7);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected[key] = value;
+    }
+    ASSERT_GE(files_provider->NumLevels(), 2);
+
+    // Nothing is recorded while disabled
+    GetPerfContext().Reset();
+    lsm->Get(expected.begin()->first);
+    EXPECT_EQ(GetPerfContext().memtables_probed, 0);
+
+    SetPerfContextEnabled(true);
+    PerfContext total;
+    for (const auto& [key, value] : expected) {
+        GetPerfContext().Reset();
+        ASSERT_EQ(lsm->Get(key), value);
+        const auto& context = GetPerfContext();
+        EXPECT_EQ(context.memtables_probed, 1);
+        EXPECT_EQ(context.filter_checks, context.levels_probed);
+        EXPECT_EQ(context.tables_opened, context.filter_positives);
+        // Every table but the one holding the key was a false positive
+        if (context.tables_opened) {
+            EXPECT_EQ(context.filter_false_positives, context.tables_opened - 1);
+            EXPECT_GT(context.bytes_read, 0);
+            EXPECT_GT(context.table_nanos, 0);
+        }
+        total.levels_probed += context.levels_probed;
+        total.tables_opened += context.tables_opened;
+    }
+    EXPECT_GT(total.levels_probed, expected.size() / 2);
+    EXPECT_GT(total.tables_opened, expected.size() / 2);
+
+    GetPerfContext().Reset();
+    UserKey missing = {'#'};
+    EXPECT_EQ(lsm->Get(missing), std::nullopt);
+    EXPECT_EQ(GetPerfContext().filter_false_positives, GetPerfContext().filter_positives);
+
+    GetPerfContext().Reset();
+    auto scan = lsm->Scan(std::nullopt, std::nullopt);
+    EXPECT_EQ(GetPerfContext().levels_probed, files_provider->NumLevels());
+    size_t rows = 0;
+    while (scan->Next().has_value()) {
+        ++rows;
+    }
+    EXPECT_EQ(rows, expected.size());
+    size_t tables = 0;
+    for (size_t level = 0; level < files_provider->NumLevels(); ++level) {
+        tables += files_provider->NumTables(level);
+    }
+    EXPECT_EQ(GetPerfContext().tables_opened, tables);
+    EXPECT_GT(GetPerfContext().scan_setup_nanos, 0);
+    EXPECT_GT(GetPerfContext().scan_next_nanos, 0);
+    EXPECT_NE(GetPerfContext().ToString().find("tables_opened = " + std::to_string(tables)), std::string::npos);
+    SetPerfContextEnabled(false);
+}
+
+TEST(LSMGranular, Stats) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    auto lsm = MakeGranularLsm(options, files_provider, MakeSSTableFileFactory());
+    const uint64_t keys = 2'000;
+    for (uint64_t i = 0; i < keys; ++i) {
+        std::string key = "key" + std::to_string(i);
+        lsm->Put(UserKey(key.begin(), key.end()), Value(16, 'v'));
+    }
+    std::string key = "key";
+    lsm->Get(UserKey(key.begin(), key.end()));
+
+    auto stats = lsm->GetStats();
+    ASSERT_GE(files_provider->NumLevels(), 2);
+    ASSERT_EQ(stats.levels.size(), files_provider->NumLevels());
+    size_t tables = 0;
+    for (size_t level = 0; level < files_provider->NumLevels(); ++level) {
+        uint64_t bytes = 0;
+        for (size_t ind = 0; ind < files_provider->NumTables(level); ++ind) {
+            bytes += files_provider->GetTableMetadata(level, ind)->file_size;
+        }
+        EXPECT_EQ(stats.levels[level].tables, files_provider->NumTables(level));
+        EXPECT_EQ(stats.levels[level].bytes, bytes);
+        tables += files_provider->NumTables(level);
+    }
+    // Every key was written once
+    EXPECT_EQ(stats.estimated_live_keys, keys);
+    EXPECT_LE(stats.memtable_bytes, options.memtable_bytes);
+    EXPECT_GT(stats.filter_file_bytes, 0);
+    EXPECT_LE(stats.filter_file_bytes, tables * options.bloom_filter_size);
+    EXPECT_GE(stats.table_metadata_bytes, tables * sizeof(SSTableMetadata));
+    EXPECT_EQ(stats.builder_bytes, 0);
+    EXPECT_EQ(stats.buffer_pool_capacity_bytes, options.buffer_pool_size);
+    EXPECT_GT(stats.buffer_pool_frame_bytes, 0);
+    EXPECT_EQ(stats.TotalMemoryBytes(), stats.memtable_bytes + stats.buffer_pool_capacity_bytes + stats.compressed_cache_bytes + stats.table_metadata_bytes);
+
+    // A tombstone stands for itself and the value it deletes
+    for (uint64_t i = 0; i < 100; ++i) {
+        std::string key = "key" + std::to_string(i);
+        lsm->Delete(UserKey(key.begin(), key.end()));
+    }
+    stats = lsm->GetStats();
+    EXPECT_LE(stats.estimated_live_keys, keys - 100);
+    EXPECT_GE(stats.estimated_live_keys, keys - 200);
+}
+
+TEST(LSMGranular, GrandparentOverlapCutsTables) {
+    // Largest number of bytes two levels below that one table overlaps
+    auto max_grandparent_overlap = [](const TestLevelsProvider& levels) {
+        uint64_t result = 0;
+        for (size_t level = 0; level + 2 < levels.NumLevels(); ++level) {
+            for (size_t ind = 0; ind < levels.NumTables(level); ++ind) {
+                auto meta = levels.GetTableMetadata(level, ind);
+                uint64_t overlap = 0;
+                for (size_t below = 0; below < levels.NumTables(level + 2); ++below) {
+                    auto other = levels.GetTableMetadata(level + 2, below);
+                    if (other->max_key >= meta->min_key && other->min_key <= meta->max_key) {
+                        overlap += other->file_size;
+                    }
+                }
+                result = std::max(result, overlap);
+            }
+        }
+        return result;
+    };
+
+    uint64_t overlaps[2];
+    size_t tables[2];
+    for (int limited = 0; limited < 2; ++limited) {
+        GranularLsmOptions options;
+        options.memtable_bytes = 1024;
+        options.max_sstable_size = 4096;
+        options.level_size_multiplier = 4;
+        options.bloom_filter_size = 1024;
+        options.max_grandparent_overlap_bytes = limited ? 3 * options.max_sstable_size : 0;
+
+        std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+        auto files_provider = std::make_shared<TestLevelsProvider>();
+        std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+        std::mt19937 rng(42);
+        std::map<UserKey, Value> expected;
+        for (int i = 0; i < 8'000; ++i) {
+            UserKey key = GenerateRandomKey(rng, 5, 7);
+            Value value = GenerateRandomKey(rng, 10, 20);
+            lsm->Put(key, value);
+            expected[key] = value;
+        }
+        for (const auto& [key, value] : expected) {
+            ASSERT_EQ(lsm->Get(key), value);
+        }
+        overlaps[limited] = max_grandparent_overlap(*files_provider);
+        tables[limited] = 0;
+        for (size_t level = 0; level < files_provider->NumLevels(); ++level) {
+            tables[limited] += files_provider->NumTables(level);
+        }
+        std::cerr << "max grandparent overlap = " << overlaps[limited] << ", tables = " << tables[limited] << std::endl;
+    }
+    EXPECT_LT(overlaps[1], overlaps[0]);
+}
+
+TEST(LSMGranular, BackgroundCompaction) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.compaction_threads = 2;
+    options.max_immutable_memtables = 4;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::vector<UserKey> keys;
+    for (int i = 0; i < 1'000; ++i) {
+        keys.push_back(GenerateRandomKey(rng, 5, 7));
+    }
+    std::map<UserKey, Value> expected;
+    auto expect_scan = [&] {
+        auto scan = lsm->Scan(std::nullopt, std::nullopt);
+        std::vector<std::pair<UserKey, Value>> expected_scan(expected.begin(), expected.end());
+        ASSERT_EQ(CollectAll(*scan), expected_scan);
+    };
+
+    for (int i = 0; i < 4'000; ++i) {
+        UserKey key = keys[rng() % keys.size()];
+        if (rng() % 10 == 0) {
+            lsm->Delete(key);
+            expected.erase(key);
+        } else {
+            Value value = GenerateRandomKey(rng, 10, 20);
+            lsm->Put(key, value);
+            expected[key] = value;
+        }
+        // Reads race with the flushes and compactions still running behind the writes
+        UserKey probe = keys[rng() % keys.size()];
+        auto it = expected.find(probe);
+        ASSERT_EQ(lsm->Get(probe), it == expected.end() ? std::nullopt : std::optional<Value>(it->second)) << "i = " << i;
+        if (i % 1'000 == 0) {
+            expect_scan();
+        }
+    }
+
+    lsm->WaitForCompactions();
+    for (const auto& key : keys) {
+        auto it = expected.find(key);
+        ASSERT_EQ(lsm->Get(key), it == expected.end() ? std::nullopt : std::optional<Value>(it->second));
+    }
+    expect_scan();
+    EXPECT_GE(files_provider->NumLevels(), 3);
+    for (uint32_t level = 0, capacity = options.l0_capacity; level < files_provider->NumLevels(); ++level, capacity *= options.level_size_multiplier) {
+        EXPECT_LT(files_provider->NumTables(level), capacity) << "level = " << level;
+        for (uint32_t i = 0; i + 1 < files_provider->NumTables(level); ++i) {
+            EXPECT_LT(files_provider->GetTableMetadata(level, i)->max_key, files_provider->GetTableMetadata(level, i + 1)->min_key) << "level = " << level << ", i = " << i;
+        }
+    }
+}
+
+TEST(LSMGranular, BackgroundCompactionStallsWrites) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.compaction_threads = 1;
+    // Every write that fills the memtable waits for all flushes and compactions before it
+    options.max_immutable_memtables = 1;
+    options.pending_compaction_bytes_limit = 1;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::map<UserKey, Value> expected;
+    for (int i = 0; i < 3'000; ++i) {
+        UserKey key = GenerateRandomKey(rng, 5, 7);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected[key] = value;
+    }
+    lsm->WaitForCompactions();
+    for (const auto& [key, value] : expected) {
+        ASSERT_EQ(lsm->Get(key), value);
+    }
+}
+
+TEST(LSMGranular, BackgroundCompactionOfSequentialKeys) {
+    GranularLsmOptions options;
+    // Flushes make several tables, so that full levels pass some of them down next to the merged ones
+    options.memtable_bytes = 4096;
+    options.max_sstable_size = 1024;
+    options.bloom_filter_size = 1024;
+    options.compaction_threads = 2;
+    options.max_immutable_memtables = 4;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::map<UserKey, Value> expected;
+    for (int i = 0; i < 4'000; ++i) {
+        // Mostly ascending keys, tables of new keys pass through full levels. The overwrites of older keys
+        // are merged into the levels and pushed on around the passing tables.
+        std::string digits = std::to_string(1'000'000 + (rng() % 10 == 0 ? rng() % (i + 1) : i));
+        UserKey key(digits.begin(), digits.end());
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected[key] = value;
+        // Reads race with the compactions, a key written earlier may wait in any level's queue
+        auto probe = std::next(expected.begin(), rng() % expected.size());
+        ASSERT_EQ(lsm->Get(probe->first), probe->second) << "i = " << i;
+        if (i % 500 == 499) {
+            std::vector<std::pair<UserKey, Value>> expected_scan(expected.begin(), expected.end());
+            ASSERT_EQ(CollectAll(*lsm->Scan(std::nullopt, std::nullopt)), expected_scan) << "i = " << i;
+        }
+    }
+
+    lsm->WaitForCompactions();
+    for (const auto& [key, value] : expected) {
+        ASSERT_EQ(lsm->Get(key), value);
+    }
+    EXPECT_GE(files_provider->NumLevels(), 3);
+}
+
+TEST(LSMGranular, RateLimitedCompaction) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    // Far below the rate compactions run at unthrottled, so that they surely wait for tokens
+    options.rate_limiter = storage::MakeRateLimiter(0, 100'000);
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::map<UserKey, Value> expected;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 400; ++i) {
+        UserKey key = GenerateRandomKey(rng, 5, 7);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected[key] = value;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto flush = options.rate_limiter->GetStats(storage::IoSource::kFlush);
+    auto compaction = options.rate_limiter->GetStats(storage::IoSource::kCompaction);
+    std::cerr << "flush bytes = " << flush.bytes << ", compaction bytes = " << compaction.bytes << ", throttled for " << compaction.throttled_micros << "us" << std::endl;
+    EXPECT_GT(flush.bytes, 0);
+    EXPECT_EQ(flush.throttled_requests, 0);
+    // Several times the burst, which alone can't cover it
+    ASSERT_GT(compaction.bytes, 50'000);
+    EXPECT_GT(compaction.throttled_requests, 0);
+    // Less the 10KB burst the compaction bucket starts with
+    EXPECT_GE(seconds, (compaction.bytes - 10'000) / 1e5);
+
+    // Foreground reads are not drawn from the limiter
+    for (const auto& [key, value] : expected) {
+        ASSERT_EQ(lsm->Get(key), value);
+    }
+    EXPECT_EQ(options.rate_limiter->GetStats(storage::IoSource::kFlush).bytes, flush.bytes);
+    EXPECT_EQ(options.rate_limiter->GetStats(storage::IoSource::kCompaction).bytes, compaction.bytes);
+}
+
 TEST(LSMGranular, CompactionIsGranular) {
     GranularLsmOptions options;
     options.memtable_bytes = 1024;
@@ -471,5 +917,201 @@ TEST(LSMGranular, CompactionIsGranular) {
     }
 }
 
+TEST(LSMGranular, MmapTables) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.use_mmap = true;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::map<UserKey, Value> expected_state;
+
+    const int operations = 3'000;
+    for (int i = 0; i < operations; ++i) {
+        UserKey key = GenerateRandomKey(rng, 3, 4);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected_state[key] = value;
+    }
+    EXPECT_GE(files_provider->NumLevels(), 2);
+
+    for (const auto& [key, value] : expected_state) {
+        ASSERT_EQ(lsm->Get(key), value);
+    }
+
+    std::vector<std::pair<UserKey, Value>> expected(expected_state.begin(), expected_state.end());
+    auto scan = lsm->Scan(std::nullopt, std::nullopt);
+    ASSERT_EQ(CollectAll(*scan), expected);
+}
+
+TEST(LSMGranular, MonkeyFilters) {
+    // Same workload with and without Monkey, compared by filter bytes per table byte of each level:
+    // memtable sizes vary between runs, so table layouts do too
+    auto run = [](bool monkey_filters) {
+        GranularLsmOptions options;
+        options.memtable_bytes = 1024;
+        options.max_sstable_size = 4096;
+        options.bloom_filter_size = 1024;
+        options.monkey_filters = monkey_filters;
+
+        std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+        auto files_provider = std::make_shared<TestLevelsProvider>();
+        std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+        std::mt19937 rng(42);
+        std::map<UserKey, Value> expected_state;
+        for (int i = 0; i < 5'000; ++i) {
+            UserKey key = GenerateRandomKey(rng, 3, 4);
+            Value value = GenerateRandomKey(rng, 10, 20);
+            lsm->Put(key, value);
+            expected_state[key] = value;
+        }
+        for (const auto& [key, value] : expected_state) {
+            EXPECT_EQ(lsm->Get(key), value);
+        }
+
+        std::vector<double> filter_share;
+        for (size_t level = 0; level < files_provider->NumLevels(); ++level) {
+            double filter_bytes = 0, table_bytes = 0;
+            for (size_t table = 0; table < files_provider->NumTables(level); ++table) {
+                filter_bytes += files_provider->GetTableBloomFilter(level, table)->Size();
+                table_bytes += files_provider->GetTableMetadata(level, table)->file_size;
+            }
+            filter_share.push_back(table_bytes ? filter_bytes / table_bytes : 0);
+        }
+        return filter_share;
+    };
+    auto uniform = run(false);
+    auto monkey = run(true);
+    ASSERT_GE(uniform.size(), 5);
+    ASSERT_GE(monkey.size(), 5);
+    // Upper levels take bits from the nominally much larger deep ones. Deep levels are not compared:
+    // their tables are small and filters there are dominated by the one-block minimum.
+    EXPECT_GT(monkey[0], 1.5 * uniform[0]);
+    EXPECT_GT(monkey[1], 1.4 * uniform[1]);
+}
+
+TEST(LSMGranular, FuseFiltersOnDeepLevels) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.fuse_filter_min_level = 2;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(43);
+    std::map<UserKey, Value> expected_state;
+    for (int i = 0; i < 3'000; ++i) {
+        UserKey key = GenerateRandomKey(rng, 3, 4);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected_state[key] = value;
+    }
+    ASSERT_GE(files_provider->NumLevels(), 3);
+    for (const auto& [key, value] : expected_state) {
+        ASSERT_EQ(lsm->Get(key), value);
+    }
+    EXPECT_EQ(lsm->Get({0}), std::nullopt);
+
+    for (size_t level = 0; level < files_provider->NumLevels(); ++level) {
+        for (size_t table = 0; table < files_provider->NumTables(level); ++table) {
+            auto filter_file = files_provider->GetTableBloomFilter(level, table);
+            auto data = filter_file->Read(0, filter_file->Size());
+            if (level < options.fuse_filter_min_level) {
+                EXPECT_NO_THROW(MakeBlockedFilterDeserializer()->Deserialize(data));
+            } else {
+                EXPECT_NO_THROW(MakeFuseFilterDeserializer()->Deserialize(data));
+            }
+        }
+    }
+}
+
+TEST(LSMGranular, RangeFilterSkipsTables) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.range_filter_prefix_length = 2;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    // Keys start with one of 100 two-byte prefixes with an even second byte
+    std::mt19937 rng(44);
+    std::map<UserKey, Value> expected_state;
+    for (int i = 0; i < 3'000; ++i) {
+        UserKey key = GenerateRandomKey(rng, 4, 6);
+        key[0] %= 50;
+        key[1] = 2 * (key[1] % 2);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected_state[key] = value;
+    }
+
+    auto prefix_range = [](uint8_t first, uint8_t second) { return std::make_pair(UserKey{first, second}, UserKey{first, second, 255, 255, 255, 255, 255, 255}); };
+    for (uint8_t first = 0; first < 50; ++first) {
+        auto [start, end] = prefix_range(first, 2);
+        std::vector<std::pair<UserKey, Value>> expected(expected_state.lower_bound(start), expected_state.lower_bound(end));
+        ASSERT_EQ(CollectAll(*lsm->Scan(start, end)), expected);
+    }
+
+    // Ranges inside absent prefixes open almost no tables
+    files_provider->ResetVisitCounters();
+    for (uint8_t first = 0; first < 50; ++first) {
+        auto [start, end] = prefix_range(first, 1);
+        ASSERT_TRUE(CollectAll(*lsm->Scan(start, end)).empty());
+    }
+    EXPECT_LE(files_provider->TotalVisits(), 5);
+
+    // Without a shared prefix only key ranges are checked
+    files_provider->ResetVisitCounters();
+    std::vector<std::pair<UserKey, Value>> expected(expected_state.lower_bound({10}), expected_state.lower_bound({20}));
+    ASSERT_EQ(CollectAll(*lsm->Scan(UserKey{10}, UserKey{20})), expected);
+    EXPECT_GT(files_provider->TotalVisits(), 0);
+}
+
+TEST(LSMGranular, ScanWithReadAhead) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.frame_size = 64;
+    options.buffer_pool_size = 64 * 64;
+    options.io_threads = 2;
+    options.readahead_frames = 8;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeGranularLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::map<UserKey, Value> expected_state;
+
+    const int operations = 3'000;
+    for (int i = 0; i < operations; ++i) {
+        UserKey key = GenerateRandomKey(rng, 3, 4);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected_state[key] = value;
+    }
+
+    std::vector<std::pair<UserKey, Value>> expected(expected_state.begin(), expected_state.end());
+    auto scan = lsm->Scan(std::nullopt, std::nullopt);
+    ASSERT_EQ(CollectAll(*scan), expected);
+
+    for (const auto& [key, value] : expected_state) {
+        ASSERT_EQ(lsm->Get(key), value);
+    }
+}
+
 }  // namespace
 }  // namespace lsm
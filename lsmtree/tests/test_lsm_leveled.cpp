@@ -25,6 +25,12 @@ TEST(LSMLeveled, PutGet) {
     EXPECT_EQ(lsm->Get(k1), v1);
 }
 
+TEST(LSMLeveled, RejectsCompactionThreads) {
+    GranularLsmOptions options;
+    options.compaction_threads = 1;
+    EXPECT_THROW(MakeLeveledLsm(options, std::make_shared<TestLevelsProvider>(), MakeSSTableFileFactory()), std::runtime_error);
+}
+
 TEST(LSMLeveled, Delete) {
     std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
     auto files_provider = std::make_shared<TestLevelsProvider>();
@@ -165,7 +171,7 @@ TEST(LSMLeveled, SearchComplexityByKeyAge) {
 
     std::vector<TestInfo> test_cases = {
         TestInfo{.key = keys[k_keys_count - 1], .reads_lower_bound = 0u, .reads_upper_bound = 1u},  // in memtable or in first level
-        TestInfo{.key = keys[k_keys_count - 256], .reads_lower_bound = 1, .reads_upper_bound = 5}, TestInfo{.key = keys[0], .reads_lower_bound = 2, .reads_upper_bound = 10}  // oldest key
+        TestInfo{.key = keys[k_keys_count - 256], .reads_lower_bound = 1, .reads_upper_bound = 5}, TestInfo{.key = keys[0], .reads_lower_bound = 1, .reads_upper_bound = 10}  // oldest key, filters may skip every other table
     };
 
     for (auto [key, min_expected_reads, max_expected_reads] : test_cases) {
@@ -421,5 +427,83 @@ TEST(LSMLeveled, CompactionIsGranular) {
     }
 }
 
+TEST(LSMLeveled, RangeFilterSkipsTables) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.range_filter_prefix_length = 2;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeLeveledLsm(options, files_provider, sstable_factory);
+
+    // Keys start with one of 100 two-byte prefixes with an even second byte
+    std::mt19937 rng(44);
+    std::map<UserKey, Value> expected_state;
+    for (int i = 0; i < 3'000; ++i) {
+        UserKey key = GenerateRandomKey(rng, 4, 6);
+        key[0] %= 50;
+        key[1] = 2 * (key[1] % 2);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected_state[key] = value;
+    }
+
+    auto prefix_range = [](uint8_t first, uint8_t second) { return std::make_pair(UserKey{first, second}, UserKey{first, second, 255, 255, 255, 255, 255, 255}); };
+    for (uint8_t first = 0; first < 50; ++first) {
+        auto [start, end] = prefix_range(first, 2);
+        std::vector<std::pair<UserKey, Value>> expected(expected_state.lower_bound(start), expected_state.lower_bound(end));
+        ASSERT_EQ(CollectAll(*lsm->Scan(start, end)), expected);
+    }
+
+    // Ranges inside absent prefixes open almost no tables
+    files_provider->ResetVisitCounters();
+    for (uint8_t first = 0; first < 50; ++first) {
+        auto [start, end] = prefix_range(first, 1);
+        ASSERT_TRUE(CollectAll(*lsm->Scan(start, end)).empty());
+    }
+    EXPECT_LE(files_provider->TotalVisits(), 5);
+
+    // Without a shared prefix only key ranges are checked
+    files_provider->ResetVisitCounters();
+    std::vector<std::pair<UserKey, Value>> expected(expected_state.lower_bound({10}), expected_state.lower_bound({20}));
+    ASSERT_EQ(CollectAll(*lsm->Scan(UserKey{10}, UserKey{20})), expected);
+    EXPECT_GT(files_provider->TotalVisits(), 0);
+}
+
+TEST(LSMLeveled, DirectIo) {
+    GranularLsmOptions options;
+    options.memtable_bytes = 1024;
+    options.max_sstable_size = 4096;
+    options.bloom_filter_size = 1024;
+    options.frame_size = 512;
+    options.buffer_pool_size = 512 * 16;
+    options.direct_io = true;
+
+    std::shared_ptr<ISSTableSerializer> sstable_factory = MakeSSTableFileFactory();
+    auto files_provider = std::make_shared<TestLevelsProvider>();
+    std::shared_ptr<ILSM> lsm = MakeLeveledLsm(options, files_provider, sstable_factory);
+
+    std::mt19937 rng(42);
+    std::map<UserKey, Value> expected_state;
+
+    const int operations = 3'000;
+    for (int i = 0; i < operations; ++i) {
+        UserKey key = GenerateRandomKey(rng, 3, 4);
+        Value value = GenerateRandomKey(rng, 10, 20);
+        lsm->Put(key, value);
+        expected_state[key] = value;
+    }
+
+    for (const auto& [key, value] : expected_state) {
+        ASSERT_EQ(lsm->Get(key), value);
+    }
+
+    std::vector<std::pair<UserKey, Value>> expected(expected_state.begin(), expected_state.end());
+    auto scan = lsm->Scan(std::nullopt, std::nullopt);
+    ASSERT_EQ(CollectAll(*scan), expected);
+}
+
 }  // namespace
 }  // namespace lsm
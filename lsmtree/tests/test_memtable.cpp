@@ -4,6 +4,7 @@
 
 #include <cstdint>
 #include <optional>
+#include <utility>
 #include <vector>
 
 namespace lsm {
@@ -30,6 +31,27 @@ TEST(MemTable, PutGetDelete) {
     EXPECT_EQ(mt->Get(k, &out), IMemTable::GetKind::kDeletion);
 }
 
+TEST(MemTable, AddMovesKeyAndValue) {
+    auto mt = MakeMemTable(20);
+    UserKey k{1, 2, 3};
+    Value v(1024, 7);
+
+    UserKey moved_key = k;
+    Value moved_value = v;
+    mt->Add(1, std::move(moved_key), std::move(moved_value));
+    EXPECT_TRUE(moved_key.empty());
+    EXPECT_TRUE(moved_value.empty());
+    Value out;
+    EXPECT_EQ(mt->Get(k, &out), IMemTable::GetKind::kFound);
+    EXPECT_EQ(out, v);
+
+    moved_key = k;
+    mt->Delete(2, std::move(moved_key));
+    EXPECT_TRUE(moved_key.empty());
+    EXPECT_EQ(mt->Get(k, &out), IMemTable::GetKind::kDeletion);
+    EXPECT_GT(mt->ApproximateMemoryUsage(), v.size());
+}
+
 TEST(MemTable, Delete) {
     auto mt = MakeMemTable(20);
     UserKey k{1, 2, 3};
@@ -100,6 +122,28 @@ TEST(MemTable, Scan) {
 #endif
 }
 
+TEST(MemTable, ScanBatches) {
+    auto mt = MakeMemTable(20);
+    for (uint8_t key = 0; key < 100; ++key) {
+        mt->Add(key + 1, UserKey{key}, Value{key});
+    }
+
+    // Batches and single rows interleave, an exhausted scan returns empty batches
+    auto it = mt->MakeScan();
+    std::vector<std::pair<InternalKey, Value>> all;
+    EXPECT_EQ(it->NextBatch(all, 30), 30);
+    all.push_back(*it->Next());
+    EXPECT_EQ(it->NextBatch(all, 100), 69);
+    EXPECT_EQ(it->NextBatch(all, 100), 0);
+    EXPECT_FALSE(it->Next().has_value());
+
+    ASSERT_EQ(all.size(), 100);
+    for (uint8_t key = 0; key < 100; ++key) {
+        EXPECT_EQ(all[key].first.user_key, UserKey{key});
+        EXPECT_EQ(all[key].second, Value{key});
+    }
+}
+
 TEST(MemTable, ApproximateMemoryUsageMonotonic) {
     auto mt = MakeMemTable(20);
     UserKey k1{1};
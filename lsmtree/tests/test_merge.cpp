@@ -2,8 +2,10 @@
 #include <lsm/common/merge.h>
 #include <lsm/common/stream.h>
 
+#include <algorithm>
 #include <memory>
 #include <optional>
+#include <random>
 #include <vector>
 
 namespace lsm {
@@ -225,5 +227,53 @@ TEST(KWayMerge, WithLimit) {
     EXPECT_LE(s3->CallsCount(), 1);
 }
 
+TEST(KWayMerge, RandomStreamsKeepTiesInStreamOrder) {
+    // Elements are ordered by the first component only, the second one names the stream
+    auto by_first = [](const std::pair<int, int>& f, const std::pair<int, int>& s) { return f.first < s.first; };
+    std::mt19937 rng(7);
+    for (int num_streams : {1, 2, 5, 16, 37, 100}) {
+        std::vector<std::shared_ptr<IStream<std::pair<int, int>>>> streams;
+        std::vector<std::pair<int, int>> expected;
+        for (int i = 0; i < num_streams; ++i) {
+            std::vector<std::pair<int, int>> data(rng() % 50);
+            for (auto& element : data) {
+                element = {static_cast<int>(rng() % 100), i};
+            }
+            std::sort(data.begin(), data.end());
+            expected.insert(expected.end(), data.begin(), data.end());
+            streams.push_back(MakeVectorStream(std::move(data)));
+        }
+        std::stable_sort(expected.begin(), expected.end(), by_first);
+
+        auto merger = MakeMerger<std::pair<int, int>, decltype(by_first)>(streams, by_first);
+        EXPECT_EQ(CollectAll(*merger), expected) << num_streams;
+    }
+}
+
+TEST(KWayMerge, NextBatch) {
+    std::vector<std::shared_ptr<IStream<int>>> streams;
+    std::vector<int> expected;
+    for (int i = 0; i < 7; ++i) {
+        std::vector<int> data;
+        for (int j = 0; j < 100 * i; ++j) {
+            data.push_back(j * 7 + i);
+        }
+        expected.insert(expected.end(), data.begin(), data.end());
+        streams.push_back(MakeVectorStream<int>(std::move(data)));
+    }
+    std::sort(expected.begin(), expected.end());
+    auto merger = MakeMerger<int>(streams);
+
+    // Single rows and batches of any size interleave
+    std::vector<int> result;
+    for (size_t batch_size = 1; result.size() < expected.size(); batch_size = batch_size * 3 % 1000) {
+        result.push_back(*merger->Next());
+        merger->NextBatch(result, batch_size);
+    }
+    EXPECT_EQ(result, expected);
+    EXPECT_EQ(merger->NextBatch(result, 10), 0);
+    EXPECT_FALSE(merger->Next().has_value());
+}
+
 }  // namespace
 }  // namespace lsm
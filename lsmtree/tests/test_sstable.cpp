@@ -68,6 +68,34 @@ TEST(SSTable, Scan) {
     std::filesystem::remove_all("test");
 }
 
+TEST(SSTable, ScanBatches) {
+    auto factory = MakeSSTableFileFactory();
+
+    std::filesystem::create_directory("test");
+    auto buffer_pool = storage::MakeReadBufferPool("test", 16348);
+    auto file = std::make_shared<storage::BufferedMemoryFile>("test", 1, buffer_pool);
+
+    std::vector<std::pair<InternalKey, Value>> expected;
+    for (uint8_t key = 0; key < 200; ++key) {
+        expected.push_back({InternalKey{.user_key = {key}, .sequence_number = key, .type = key % 3 ? ValueType::kValue : ValueType::kDeletion}, key % 3 ? Value{key, key} : Value{}});
+    }
+    {
+        auto builder = factory->NewFileBuilder(file);
+        builder->Add(expected[0].first, expected[0].second);
+        builder->AddBatch(std::vector<std::pair<InternalKey, Value>>(expected.begin() + 1, expected.end()));
+        builder->Finish();
+    }
+
+    auto it = factory->FromFile(file)->MakeScan();
+    std::vector<std::pair<InternalKey, Value>> all;
+    all.push_back(*it->Next());
+    while (it->NextBatch(all, 64)) {
+    }
+    EXPECT_FALSE(it->Next().has_value());
+    EXPECT_EQ(all, expected);
+    std::filesystem::remove_all("test");
+}
+
 TEST(SSTable, Get) {
     auto factory = MakeSSTableFileFactory();
 
@@ -122,9 +150,10 @@ class TrackingFile : public storage::IFile {
    public:
     explicit TrackingFile(std::shared_ptr<storage::IFile> inner) : inner_(std::move(inner)) {}
 
-    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes) const override {
+    std::vector<uint8_t> Read(uint64_t offset, uint64_t bytes, storage::ReadHint hint = storage::ReadHint::kPoint) const override {
         reads.emplace_back(offset, bytes);
-        return inner_->Read(offset, bytes);
+        hints.push_back(hint);
+        return inner_->Read(offset, bytes, hint);
     }
 
     void Write(const uint8_t* data, uint64_t size) override {
@@ -135,6 +164,7 @@ class TrackingFile : public storage::IFile {
     uint64_t Size() const override { return inner_->Size(); }
 
     mutable std::vector<std::pair<uint64_t, uint64_t>> reads;
+    mutable std::vector<storage::ReadHint> hints;
     mutable std::vector<std::pair<uint64_t, uint64_t>> writes;
 
    private:
@@ -207,6 +237,41 @@ TEST(SSTable, ReaderUsesSmallReads) {
     std::filesystem::remove_all("test");
 }
 
+// Streams and lookups may share a reader, the hint is passed by every read rather than kept on the file
+TEST(SSTable, ScanReadsDontChangeLookups) {
+    std::filesystem::create_directory("test");
+    auto buffer_pool = storage::MakeReadBufferPool("test", 16348);
+    auto tracking_file = std::make_shared<TrackingFile>(std::make_shared<storage::BufferedMemoryFile>("test", 1, buffer_pool));
+    auto factory = MakeSSTableFileFactory();
+    {
+        auto builder = factory->NewFileBuilder(tracking_file);
+        for (uint8_t ind = 0; ind < 100; ++ind) {
+            builder->Add(InternalKey{.user_key = {ind}, .sequence_number = ind, .type = ValueType::kValue}, {ind, ind});
+        }
+        builder->Finish();
+    }
+    auto reader = factory->FromFile(tracking_file);
+    auto scan = reader->MakeScan();
+    ASSERT_TRUE(scan->Next().has_value());
+
+    tracking_file->hints.clear();
+    Value out;
+    ASSERT_EQ(reader->Get({42}, &out), ISSTableReader::GetKind::kFound);
+    EXPECT_EQ(out, (Value{42, 42}));
+    ASSERT_FALSE(tracking_file->hints.empty());
+    EXPECT_TRUE(std::all_of(tracking_file->hints.begin(), tracking_file->hints.end(), [](storage::ReadHint hint) { return hint == storage::ReadHint::kPoint; }));
+
+    tracking_file->hints.clear();
+    size_t rows = 1;
+    while (scan->Next()) {
+        ++rows;
+    }
+    EXPECT_EQ(rows, 100);
+    ASSERT_FALSE(tracking_file->hints.empty());
+    EXPECT_TRUE(std::all_of(tracking_file->hints.begin(), tracking_file->hints.end(), [](storage::ReadHint hint) { return hint == storage::ReadHint::kScan; }));
+    std::filesystem::remove_all("test");
+}
+
 TEST(SSTable, GetWithSequenceNumber) {
     auto factory = MakeSSTableFileFactory();
 
@@ -0,0 +1,495 @@
+#include </home/lim/HSE/Projects/IBIS/contrib/gtest/gtest.h>
+#include <lsm/common/perf_context.h>
+#include <lsm/storage/buffer_pool.h>
+#include <lsm/storage/compression.h>
+#include <lsm/storage/file.h>
+#include <lsm/storage/rate_limiter.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lsm {
+namespace {
+
+TEST(Storage, MmapFileReadAndView) {
+    std::filesystem::create_directory("test_storage");
+    uint64_t read_bytes = 0;
+    {
+        storage::MmapFile file("test_storage/mmap", &read_bytes);
+        std::vector<uint8_t> data(10'000);
+        std::iota(data.begin(), data.end(), 0);
+        file.Write(data.data(), data.size());
+        EXPECT_EQ(file.Size(), data.size());
+
+        auto read = file.Read(4090, 20);
+        EXPECT_EQ(read, std::vector<uint8_t>(data.begin() + 4090, data.begin() + 4110));
+
+        auto view = file.ReadView(100, 50);
+        ASSERT_EQ(view.size(), 50);
+        EXPECT_TRUE(std::equal(view.begin(), view.end(), data.begin() + 100));
+        EXPECT_EQ(file.ReadView(100, 50).data(), view.data());
+        EXPECT_EQ(read_bytes, 120);
+
+        EXPECT_EQ(file.Read(0, data.size(), storage::ReadHint::kScan), data);
+        EXPECT_THROW(file.ReadView(data.size() - 1, 2), std::runtime_error);
+    }
+    EXPECT_FALSE(std::filesystem::exists("test_storage/mmap"));
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, MmapFileRewrite) {
+    std::filesystem::create_directory("test_storage");
+    {
+        storage::MmapFile file("test_storage/mmap");
+        file.Write(nullptr, 0);
+        EXPECT_EQ(file.Size(), 0);
+
+        std::vector<uint8_t> data = {1, 2, 3};
+        file.Write(data.data(), data.size());
+        EXPECT_EQ(file.Read(0, 3), data);
+    }
+    std::filesystem::remove_all("test_storage");
+}
+
+void WriteTable(const std::string& dir, uint32_t table_id, const std::vector<uint8_t>& data) {
+    std::ofstream file(dir + "/sstable_" + std::to_string(table_id), std::ios::trunc | std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+TEST(Storage, FrameProviderReadsRuns) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> first(1000), second(1000);
+    std::iota(first.begin(), first.end(), 0);
+    std::iota(second.begin(), second.end(), 7);
+    WriteTable("test_storage", 0, first);
+    WriteTable("test_storage", 1, second);
+
+    uint64_t read_bytes = 0;
+    auto provider = storage::MakeReadFrameProvider("test_storage", 64, &read_bytes, 1);
+    for (int round = 0; round < 3; ++round) {
+        for (uint32_t table_id = 0; table_id < 2; ++table_id) {
+            const auto& data = table_id ? second : first;
+            auto frames = provider->GetFrames(table_id, 2, 15);
+            ASSERT_EQ(frames.size(), 14);
+            for (uint32_t ind = 0; ind < frames.size(); ++ind) {
+                for (uint32_t byte = 0; byte < 64; ++byte) {
+                    uint64_t offset = (ind + 2) * 64 + byte;
+                    ASSERT_EQ(frames[ind]->Data()[byte], offset < data.size() ? data[offset] : 0);
+                }
+            }
+        }
+    }
+    EXPECT_EQ(read_bytes, 6 * 14 * 64);
+
+    provider->CloseTable(0);
+    EXPECT_EQ(provider->GetFrame({0, 1})->Data()[0], first[64]);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolReadsOnlyMissingFrames) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(64 * 10);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 3, data);
+
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", 64 * 8, 64, &read_bytes);
+    buffer_pool->GetFrame({3, 4});
+    EXPECT_EQ(read_bytes, 64);
+
+    auto frames = buffer_pool->GetFrames(3, 2, 6);
+    ASSERT_EQ(frames.size(), 5);
+    for (uint32_t ind = 0; ind < frames.size(); ++ind) {
+        EXPECT_EQ(frames[ind]->Data()[0], data[(ind + 2) * 64]);
+    }
+    EXPECT_EQ(read_bytes, 5 * 64);
+
+    buffer_pool->GetFrames(3, 2, 6);
+    EXPECT_EQ(read_bytes, 5 * 64);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolPerfContext) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(64 * 10);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 3, data);
+
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", 64 * 8, 64, &read_bytes);
+    GetPerfContext().Reset();
+    buffer_pool->GetFrame({3, 4});
+    EXPECT_EQ(GetPerfContext().frame_misses, 0);
+
+    SetPerfContextEnabled(true);
+    buffer_pool->GetFrames(3, 2, 6);
+    EXPECT_EQ(GetPerfContext().frame_hits, 1);
+    EXPECT_EQ(GetPerfContext().frame_misses, 4);
+    EXPECT_GT(GetPerfContext().frame_read_nanos, 0);
+    buffer_pool->GetFrame({3, 2});
+    EXPECT_EQ(GetPerfContext().frame_hits, 2);
+
+    // Other threads have contexts of their own
+    std::thread([&buffer_pool] {
+        SetPerfContextEnabled(true);
+        buffer_pool->GetFrame({3, 8});
+        EXPECT_EQ(GetPerfContext().frame_misses, 1);
+    }).join();
+    EXPECT_EQ(GetPerfContext().frame_misses, 4);
+    SetPerfContextEnabled(false);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolPrefetch) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(64 * 10 - 5);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 0, data);
+
+    storage::ReadBufferPoolOptions options;
+    options.pool_size = 64 * 32;
+    options.frame_size = 64;
+    options.io_threads = 2;
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", options, &read_bytes);
+
+    buffer_pool->Prefetch(0, 0, 20);
+    auto frames = buffer_pool->GetFrames(0, 0, 9);
+    ASSERT_EQ(frames.size(), 10);
+    for (uint32_t ind = 0; ind < frames.size(); ++ind) {
+        EXPECT_EQ(frames[ind]->Data()[1], data[ind * 64 + 1]);
+    }
+    EXPECT_EQ(read_bytes, 10 * 64);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolSequentialReadAhead) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(64 * 100);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 0, data);
+
+    storage::ReadBufferPoolOptions options;
+    options.pool_size = 64 * 200;
+    options.frame_size = 64;
+    options.io_threads = 1;
+    options.readahead_frames = 8;
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", options, &read_bytes);
+
+    for (uint32_t ind = 0; ind < 100; ++ind) {
+        auto frames = buffer_pool->GetFrames(0, ind, ind);
+        ASSERT_EQ(frames[0]->Data()[0], data[ind * 64]);
+    }
+    // Each frame is read once, whether synchronously or ahead of time
+    EXPECT_EQ(read_bytes, 100 * 64);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolReadAheadStopsAtEndOfTable) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(64 * 12);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 0, data);
+
+    storage::ReadBufferPoolOptions options;
+    options.pool_size = 64 * 16;
+    options.frame_size = 64;
+    options.io_threads = 1;
+    options.readahead_frames = 8;
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", options, &read_bytes);
+
+    for (uint32_t ind = 0; ind < 12; ++ind) {
+        buffer_pool->GetFrames(0, ind, ind);
+    }
+    EXPECT_EQ(read_bytes, 12 * 64);
+    // Frames past the end would have evicted some of the table's ones to make room
+    for (uint32_t ind = 0; ind < 12; ++ind) {
+        auto frames = buffer_pool->GetFrames(0, ind, ind, storage::ReadHint::kScan);
+        ASSERT_EQ(frames[0]->Data()[0], data[ind * 64]);
+    }
+    EXPECT_EQ(read_bytes, 12 * 64);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolDirectIo) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(4096 * 3 + 100);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 0, data);
+
+    storage::ReadBufferPoolOptions options;
+    options.pool_size = 4096 * 8;
+    options.io_threads = 1;
+    options.direct_io = true;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", options);
+
+    buffer_pool->Prefetch(0, 2, 3);
+    auto frames = buffer_pool->GetFrames(0, 0, 3);
+    ASSERT_EQ(frames.size(), 4);
+    for (uint32_t ind = 0; ind < frames.size(); ++ind) {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(frames[ind]->Data()) % 4096, 0);
+        for (uint32_t byte = 0; byte < 4096; ++byte) {
+            uint64_t offset = ind * 4096 + byte;
+            ASSERT_EQ(frames[ind]->Data()[byte], offset < data.size() ? data[offset] : 0);
+        }
+    }
+
+    options.frame_size = 100;
+    EXPECT_THROW(storage::MakeReadBufferPool("test_storage", options), std::runtime_error);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolScanResistance) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(64 * 100);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 0, data);
+
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", 64 * 10, 64, &read_bytes);
+    for (int round = 0; round < 2; ++round) {
+        for (uint32_t ind = 0; ind < 4; ++ind) {
+            buffer_pool->GetFrame({0, ind});
+        }
+    }
+    EXPECT_EQ(read_bytes, 4 * 64);
+
+    for (uint32_t ind = 10; ind < 100; ++ind) {
+        buffer_pool->GetFrames(0, ind, ind, storage::ReadHint::kScan);
+    }
+    read_bytes = 0;
+    for (uint32_t ind = 0; ind < 4; ++ind) {
+        EXPECT_EQ(buffer_pool->GetFrame({0, ind})->Data()[0], data[ind * 64]);
+    }
+    EXPECT_EQ(read_bytes, 0);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolKeepsPinnedFrames) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(64 * 100);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 0, data);
+
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", 64 * 4, 64, &read_bytes);
+    auto pinned = buffer_pool->GetFrame({0, 0});
+    for (uint32_t ind = 1; ind < 100; ++ind) {
+        buffer_pool->GetFrame({0, ind});
+        buffer_pool->GetFrame({0, ind});
+    }
+    read_bytes = 0;
+    EXPECT_EQ(buffer_pool->GetFrame({0, 0})->Data(), pinned->Data());
+    EXPECT_EQ(read_bytes, 0);
+
+    // A released frame is evicted like any other
+    pinned.reset();
+    for (uint32_t ind = 1; ind < 100; ++ind) {
+        buffer_pool->GetFrame({0, ind});
+        buffer_pool->GetFrame({0, ind});
+    }
+    read_bytes = 0;
+    buffer_pool->GetFrame({0, 0});
+    EXPECT_EQ(read_bytes, 64);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolConcurrentReads) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(64 * 200 + 10);
+    std::iota(data.begin(), data.end(), 0);
+    WriteTable("test_storage", 0, data);
+
+    storage::ReadBufferPoolOptions options;
+    options.pool_size = 64 * 32;
+    options.frame_size = 64;
+    options.io_threads = 2;
+    options.shards = 4;
+    options.huge_pages = true;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", options);
+
+    std::vector<std::thread> readers;
+    std::vector<int> mismatches(8);
+    for (uint32_t reader = 0; reader < mismatches.size(); ++reader) {
+        readers.emplace_back([&, reader] {
+            std::mt19937 gen(reader);
+            for (int round = 0; round < 2000; ++round) {
+                uint32_t l = gen() % 200;
+                uint32_t r = std::min<uint32_t>(l + gen() % 8, 200);
+                auto hint = round % 2 ? storage::ReadHint::kScan : storage::ReadHint::kPoint;
+                auto frames = buffer_pool->GetFrames(0, l, r, hint);
+                for (uint32_t ind = 0; ind < frames.size(); ++ind) {
+                    for (uint32_t byte = 0; byte < 64; ++byte) {
+                        uint64_t offset = (l + ind) * 64 + byte;
+                        mismatches[reader] += frames[ind]->Data()[byte] != (offset < data.size() ? data[offset] : 0);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(std::accumulate(mismatches.begin(), mismatches.end(), 0), 0);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, CompressionRoundTrip) {
+    std::mt19937 gen(7);
+    std::vector<std::vector<uint8_t>> inputs = {{}, {1, 2, 3}, std::vector<uint8_t>(100'000, 42)};
+    std::vector<uint8_t> text;
+    for (int ind = 0; ind < 5000; ++ind) {
+        auto word = "key_" + std::to_string(gen() % 300) + ";";
+        text.insert(text.end(), word.begin(), word.end());
+    }
+    inputs.push_back(text);
+    std::vector<uint8_t> noise(70'000);
+    for (auto& byte : noise) {
+        byte = gen();
+    }
+    inputs.push_back(noise);
+
+    for (const auto& input : inputs) {
+        auto compressed = storage::Compress(input.data(), input.size());
+        std::vector<uint8_t> output(input.size());
+        ASSERT_TRUE(storage::Decompress(compressed.data(), compressed.size(), output.data(), output.size()));
+        EXPECT_EQ(output, input);
+        if (!output.empty()) {
+            EXPECT_FALSE(storage::Decompress(compressed.data(), compressed.size(), output.data(), output.size() - 1));
+        }
+    }
+    EXPECT_LT(storage::Compress(text.data(), text.size()).size(), text.size() / 2);
+}
+
+TEST(Storage, BufferPoolMemoryUsage) {
+    std::filesystem::create_directory("test_storage");
+    WriteTable("test_storage", 0, std::vector<uint8_t>(256 * 10, 7));
+
+    storage::ReadBufferPoolOptions options;
+    options.pool_size = 256 * 4;
+    options.frame_size = 256;
+    options.shards = 1;
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", options, &read_bytes);
+    auto memory = buffer_pool->GetMemoryUsage();
+    EXPECT_EQ(memory.capacity_bytes, 256 * 4);
+    EXPECT_EQ(memory.resident_bytes, 0);
+
+    buffer_pool->GetFrame({0, 0});
+    buffer_pool->GetFrame({0, 1});
+    EXPECT_EQ(buffer_pool->GetMemoryUsage().resident_bytes, 256 * 2);
+    for (uint32_t ind = 0; ind < 10; ++ind) {
+        buffer_pool->GetFrame({0, ind});
+    }
+    memory = buffer_pool->GetMemoryUsage();
+    EXPECT_EQ(memory.resident_bytes, 256 * 4);
+    EXPECT_EQ(memory.capacity_bytes, 256 * 4);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, BufferPoolCompressedTier) {
+    std::filesystem::create_directory("test_storage");
+    std::vector<uint8_t> data(256 * 40);
+    for (uint64_t ind = 0; ind < data.size(); ++ind) {
+        data[ind] = ind / 256 + (ind % 16 == 0);
+    }
+    WriteTable("test_storage", 0, data);
+
+    storage::ReadBufferPoolOptions options;
+    options.pool_size = 256 * 4;
+    options.frame_size = 256;
+    options.compressed_cache_size = 64 * 1024;
+    uint64_t read_bytes = 0;
+    auto buffer_pool = storage::MakeReadBufferPool("test_storage", options, &read_bytes);
+    for (uint32_t ind = 0; ind < 40; ++ind) {
+        buffer_pool->GetFrame({0, ind});
+    }
+    EXPECT_EQ(read_bytes, 40 * 256);
+    auto stats = buffer_pool->GetCompressedCacheStats();
+    EXPECT_EQ(stats.frames, 36);
+    EXPECT_LT(stats.bytes, 36 * 256 / 4);
+
+    for (uint32_t ind = 0; ind < 40; ++ind) {
+        auto frame = buffer_pool->GetFrame({0, ind});
+        ASSERT_TRUE(std::equal(frame->Data(), frame->Data() + 256, data.begin() + ind * 256));
+    }
+    EXPECT_EQ(read_bytes, 40 * 256);
+    stats = buffer_pool->GetCompressedCacheStats();
+    EXPECT_EQ(stats.hits, 40);
+    EXPECT_EQ(stats.misses, 40);
+    std::filesystem::remove_all("test_storage");
+}
+
+TEST(Storage, RateLimiterThrottles) {
+    auto rate_limiter = storage::MakeRateLimiter(0, 10'000'000);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 30; ++i) {
+        rate_limiter->Request(storage::IoSource::kCompaction, 100'000);
+        rate_limiter->Request(storage::IoSource::kFlush, 100'000);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // 3MB at 10MB/s, less the 1MB burst the bucket starts with
+    EXPECT_GE(seconds, 0.18);
+
+    auto compaction = rate_limiter->GetStats(storage::IoSource::kCompaction);
+    EXPECT_EQ(compaction.requests, 30);
+    EXPECT_EQ(compaction.bytes, 3'000'000);
+    EXPECT_GT(compaction.throttled_requests, 0);
+    EXPECT_GE(compaction.throttled_micros, 180'000);
+    auto flush = rate_limiter->GetStats(storage::IoSource::kFlush);
+    EXPECT_EQ(flush.bytes, 3'000'000);
+    EXPECT_EQ(flush.throttled_requests, 0);
+}
+
+TEST(Storage, RateLimiterChangesAtRuntime) {
+    auto rate_limiter = storage::MakeRateLimiter(1'000, 0);
+    // Would take 100 seconds at the initial rate
+    std::thread flush([&] { rate_limiter->Request(storage::IoSource::kFlush, 100'000); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    auto start = std::chrono::steady_clock::now();
+    rate_limiter->SetBytesPerSecond(storage::IoSource::kFlush, 0);
+    flush.join();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    EXPECT_EQ(rate_limiter->GetBytesPerSecond(storage::IoSource::kFlush), 0);
+    EXPECT_EQ(rate_limiter->GetStats(storage::IoSource::kFlush).throttled_requests, 1);
+}
+
+TEST(Storage, RateLimitedFile) {
+    auto rate_limiter = storage::MakeRateLimiter(0, 0);
+    auto file = std::make_shared<storage::TestMemoryFile>();
+    storage::RateLimitedFile writer(std::shared_ptr<storage::IFile>(file), rate_limiter, storage::IoSource::kFlush);
+    std::vector<uint8_t> data(10'000, 7);
+    writer.Write(data.data(), data.size());
+    EXPECT_EQ(file->Size(), data.size());
+
+    storage::RateLimitedFile reader(std::shared_ptr<const storage::IFile>(file), rate_limiter, storage::IoSource::kCompaction);
+    EXPECT_EQ(reader.Read(100, 200), std::vector<uint8_t>(200, 7));
+    EXPECT_EQ(reader.ReadView(0, 300).size(), 300);
+    EXPECT_THROW(reader.Write(data.data(), data.size()), std::runtime_error);
+    // The first block is paid for as a whole by the first read, rereading it is free
+    auto compaction = rate_limiter->GetStats(storage::IoSource::kCompaction);
+    EXPECT_EQ(compaction.requests, 1);
+    EXPECT_EQ(compaction.bytes, 4'096);
+
+    // Reading the rest row by row pays for the two remaining blocks, the last one partial, once each
+    for (uint64_t offset = 4'000; offset < data.size(); offset += 100) {
+        ASSERT_EQ(reader.Read(offset, 100), std::vector<uint8_t>(100, 7));
+    }
+    compaction = rate_limiter->GetStats(storage::IoSource::kCompaction);
+    EXPECT_EQ(compaction.requests, 3);
+    EXPECT_EQ(compaction.bytes, 10'000);
+    EXPECT_EQ(rate_limiter->GetStats(storage::IoSource::kFlush).bytes, 10'000);
+}
+
+}  // namespace
+}  // namespace lsm
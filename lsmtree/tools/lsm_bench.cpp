@@ -0,0 +1,259 @@
+#include <bench/ycsb.h>
+#include <lsm/event_listener.h>
+#include <lsm/lsm.h>
+#include <lsm/utils/lsm_utils.h>
+
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// Load generator for capacity tests: pre-loads an LSM, runs a YCSB-like operation mix for a
+// while and prints throughput and latency percentiles every interval, then an amplification report.
+//
+//   lsm_bench --lsm leveled --records 1000000 --workload A --duration 600 --threads 4
+
+namespace {
+
+namespace po = boost::program_options;
+using namespace lsm;
+
+ycsb::Variant ParseVariant(const std::string& name) {
+    if (name == "simple") {
+        return ycsb::Variant::kSimple;
+    }
+    if (name == "granular") {
+        return ycsb::Variant::kGranular;
+    }
+    if (name == "leveled") {
+        return ycsb::Variant::kLeveled;
+    }
+    throw std::invalid_argument("unknown LSM variant " + name + ", expected simple, granular or leveled");
+}
+
+ycsb::Distribution ParseDistribution(const std::string& name) {
+    if (name == "uniform") {
+        return ycsb::Distribution::kUniform;
+    }
+    if (name == "zipfian") {
+        return ycsb::Distribution::kZipfian;
+    }
+    if (name == "latest") {
+        return ycsb::Distribution::kLatest;
+    }
+    throw std::invalid_argument("unknown key distribution " + name + ", expected uniform, zipfian or latest");
+}
+
+ycsb::Workload ParseWorkload(const std::string& name) {
+    for (const auto& workload : ycsb::kWorkloads) {
+        if (name == workload.name) {
+            return workload;
+        }
+    }
+    throw std::invalid_argument("unknown workload " + name + ", expected A to F");
+}
+
+void PrintLatency(const ycsb::LatencyHistogram& latency) {
+    std::printf("p50 %.1fus p99 %.1fus p999 %.1fus", latency.Percentile(0.5) / 1e3, latency.Percentile(0.99) / 1e3, latency.Percentile(0.999) / 1e3);
+}
+
+void PrintAmplification(const ycsb::Database& db) {
+    const auto& levels = *db.levels_provider;
+    std::printf("bytes written to tables %lu, logical %lu, write amplification %.2f\n", levels.TotalBytesInserted(), db.logical_bytes_written.load(), ycsb::WriteAmplification(db));
+    std::printf("bytes read from tables %lu, logical %lu, read amplification %.2f\n", db.read_bytes, db.logical_bytes_read.load(), ycsb::ReadAmplification(db));
+    std::printf("space amplification %.2f, table lookups %lu\n", ycsb::SpaceAmplification(db), levels.TotalVisits());
+    for (size_t level = 0; level < levels.NumLevels(); ++level) {
+        uint64_t bytes = 0;
+        for (size_t table = 0; table < levels.NumTables(level); ++table) {
+            auto meta = levels.GetTableMetadata(level, table);
+            bytes += meta.has_value() ? meta->file_size : 0;
+        }
+        std::printf("level %zu: %zu tables, %lu bytes\n", level, levels.NumTables(level), bytes);
+    }
+}
+
+void PrintMemoryUsage(const ILSM& lsm) {
+    auto stats = lsm.GetStats();
+    std::printf("memory: memtables %lu, buffer pool %lu of %lu, compressed cache %lu, table metadata %lu, builders %lu bytes\n", stats.memtable_bytes, stats.buffer_pool_frame_bytes,
+                stats.buffer_pool_capacity_bytes, stats.compressed_cache_bytes, stats.table_metadata_bytes, stats.builder_bytes);
+    std::printf("filter files %lu bytes\n", stats.filter_file_bytes);
+    std::printf("estimated live keys %lu\n", stats.estimated_live_keys);
+}
+
+void PrintRateLimiterStats(const storage::IRateLimiter& rate_limiter) {
+    for (auto [source, name] : {std::pair{storage::IoSource::kFlush, "flush"}, std::pair{storage::IoSource::kCompaction, "compaction"}}) {
+        auto stats = rate_limiter.GetStats(source);
+        std::printf("%s I/O: %lu bytes in %lu requests, %lu throttled for %.1fs in total\n", name, stats.bytes, stats.requests, stats.throttled_requests, stats.throttled_micros / 1e6);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        std::string variant_name, workload_name, distribution_name, trace_file;
+        double read = -1, update = -1, insert = -1, scan = -1, read_modify_write = -1;
+        uint32_t max_scan_length = 0, threads = 1;
+        uint64_t records = 0, flush_bytes_per_second = 0, compaction_bytes_per_second = 0;
+        double duration = 0, interval = 0;
+        ycsb::Database db;
+        LsmOptions simple_options;
+        GranularLsmOptions options;
+
+        po::options_description general("General");
+        general.add_options()
+            ("help", "Display options")
+            ("lsm", po::value(&variant_name)->default_value("leveled"), "LSM variant: simple, granular or leveled")
+            ("records", po::value(&records)->default_value(100000), "Records inserted before the run, 0 skips the pre-load")
+            ("duration", po::value(&duration)->default_value(60), "Seconds to run the operation mix for")
+            ("threads", po::value(&threads)->default_value(1), "Client threads, LSM calls are serialized between them")
+            ("interval", po::value(&interval)->default_value(1), "Seconds between progress reports")
+            ; // NOLINT
+
+        po::options_description mix("Operation mix");
+        mix.add_options()
+            ("workload", po::value(&workload_name)->default_value("A"), "YCSB workload A to F the mix starts from")
+            ("read", po::value(&read), "Fraction of point reads")
+            ("update", po::value(&update), "Fraction of updates of existing records")
+            ("insert", po::value(&insert), "Fraction of inserts of new records")
+            ("scan", po::value(&scan), "Fraction of scans")
+            ("rmw", po::value(&read_modify_write), "Fraction of read-modify-writes")
+            ("distribution", po::value(&distribution_name), "Key distribution: uniform, zipfian or latest")
+            ("max-scan-length", po::value(&max_scan_length), "Scan lengths are uniform in [1, max-scan-length]")
+            ("min-key-size", po::value(&db.min_key_size)->default_value(0), "Smallest key, 0 for both sizes keeps natural 24-byte keys")
+            ("max-key-size", po::value(&db.max_key_size)->default_value(0), "Largest key")
+            ("min-value-size", po::value(&db.min_value_size)->default_value(100), "Smallest value")
+            ("max-value-size", po::value(&db.max_value_size)->default_value(100), "Largest value")
+            ; // NOLINT
+
+        po::options_description lsm("LSM options, shared ones apply to every variant");
+        lsm.add_options()
+            ("memtable-bytes", po::value(&options.memtable_bytes)->default_value(options.memtable_bytes), "")
+            ("max-level-skip-list", po::value(&options.max_level_skip_list)->default_value(options.max_level_skip_list), "")
+            ("frame-size", po::value(&options.frame_size)->default_value(options.frame_size), "")
+            ("buffer-pool-size", po::value(&options.buffer_pool_size)->default_value(options.buffer_pool_size), "")
+            ("buffer-pool-shards", po::value(&options.buffer_pool_shards)->default_value(options.buffer_pool_shards), "")
+            ("max-open-files", po::value(&options.max_open_files)->default_value(options.max_open_files), "")
+            ("io-threads", po::value(&options.io_threads)->default_value(options.io_threads), "")
+            ("readahead-frames", po::value(&options.readahead_frames)->default_value(options.readahead_frames), "")
+            ("compressed-cache-size", po::value(&options.compressed_cache_size)->default_value(options.compressed_cache_size), "")
+            ("direct-io", po::bool_switch(&options.direct_io), "")
+            ("huge-pages", po::bool_switch(&options.huge_pages), "")
+            ("use-mmap", po::bool_switch(&options.use_mmap), "")
+            ("flush-bytes-per-second", po::value(&flush_bytes_per_second)->default_value(0), "Flush I/O rate limit, 0 for none")
+            ("compaction-bytes-per-second", po::value(&compaction_bytes_per_second)->default_value(0), "Compaction I/O rate limit, 0 for none")
+            ("compaction-trigger-files", po::value(&simple_options.compaction_trigger_files)->default_value(simple_options.compaction_trigger_files), "simple only")
+            ("max-sstable-size", po::value(&options.max_sstable_size)->default_value(options.max_sstable_size), "granular and leveled")
+            ("l0-capacity", po::value(&options.l0_capacity)->default_value(options.l0_capacity), "granular and leveled")
+            ("level-size-multiplier", po::value(&options.level_size_multiplier)->default_value(options.level_size_multiplier), "granular and leveled")
+            ("bloom-filter-size", po::value(&options.bloom_filter_size)->default_value(options.bloom_filter_size), "granular and leveled")
+            ("bloom-bits-per-key", po::value(&options.bloom_bits_per_key)->default_value(options.bloom_bits_per_key), "granular and leveled")
+            ("bloom-filter-hash-count", po::value(&options.bloom_filter_hash_count)->default_value(options.bloom_filter_hash_count), "granular and leveled")
+            ("monkey-filters", po::bool_switch(&options.monkey_filters), "granular and leveled")
+            ("fuse-filter-min-level", po::value(&options.fuse_filter_min_level)->default_value(options.fuse_filter_min_level), "granular and leveled")
+            ("range-filter-prefix-length", po::value(&options.range_filter_prefix_length)->default_value(options.range_filter_prefix_length), "granular and leveled")
+            ("compaction-threads", po::value(&options.compaction_threads)->default_value(options.compaction_threads), "granular only, 0 compacts inline")
+            ("max-immutable-memtables", po::value(&options.max_immutable_memtables)->default_value(options.max_immutable_memtables), "granular only")
+            ("pending-compaction-bytes-limit", po::value(&options.pending_compaction_bytes_limit)->default_value(options.pending_compaction_bytes_limit), "granular only")
+            ("trace-file", po::value(&trace_file), "granular and leveled: write flushes, compactions and write stalls there as a Chrome trace")
+            ; // NOLINT
+
+        po::options_description desc("lsm_bench");
+        desc.add(general).add(mix).add(lsm);
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << "\n";
+            return 0;
+        }
+        po::notify(vm);
+
+        auto workload = ParseWorkload(workload_name);
+        if (read >= 0 || update >= 0 || insert >= 0 || scan >= 0 || read_modify_write >= 0) {
+            // An explicit mix replaces the workload's one, fractions left out are 0
+            workload.read = std::max(read, 0.0);
+            workload.update = std::max(update, 0.0);
+            workload.insert = std::max(insert, 0.0);
+            workload.scan = std::max(scan, 0.0);
+            workload.read_modify_write = std::max(read_modify_write, 0.0);
+            double total = workload.read + workload.update + workload.insert + workload.scan + workload.read_modify_write;
+            if (total <= 0) {
+                throw std::invalid_argument("the operation mix is empty");
+            }
+            workload.read /= total;
+            workload.update /= total;
+            workload.insert /= total;
+            workload.scan /= total;
+            workload.read_modify_write /= total;
+        }
+        if (vm.count("distribution")) {
+            workload.distribution = ParseDistribution(distribution_name);
+        }
+        if (max_scan_length > 0) {
+            workload.max_scan_length = max_scan_length;
+        }
+        if (db.min_key_size > db.max_key_size || db.min_value_size > db.max_value_size) {
+            throw std::invalid_argument("a size range has its minimum above its maximum");
+        }
+        if (records == 0 && workload.insert < 1) {
+            // Reads and updates need existing records to pick from
+            records = 1;
+        }
+
+        simple_options.memtable_bytes = options.memtable_bytes;
+        simple_options.max_level_skip_list = options.max_level_skip_list;
+        simple_options.frame_size = options.frame_size;
+        simple_options.buffer_pool_size = options.buffer_pool_size;
+        simple_options.buffer_pool_shards = options.buffer_pool_shards;
+        simple_options.max_open_files = options.max_open_files;
+        simple_options.io_threads = options.io_threads;
+        simple_options.readahead_frames = options.readahead_frames;
+        simple_options.compressed_cache_size = options.compressed_cache_size;
+        simple_options.direct_io = options.direct_io;
+        simple_options.huge_pages = options.huge_pages;
+        simple_options.use_mmap = options.use_mmap;
+        if (flush_bytes_per_second != 0 || compaction_bytes_per_second != 0) {
+            options.rate_limiter = storage::MakeRateLimiter(flush_bytes_per_second, compaction_bytes_per_second);
+            simple_options.rate_limiter = options.rate_limiter;
+        }
+        if (!trace_file.empty()) {
+            options.listeners.push_back(MakeChromeTraceListener(trace_file));
+        }
+        ycsb::Open(db, ParseVariant(variant_name), simple_options, options);
+
+        auto load_start = std::chrono::steady_clock::now();
+        ycsb::Load(db, records);
+        double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+        std::printf("loaded %lu records in %.1fs\n", records, load_seconds);
+
+        double elapsed = 0;
+        auto result = ycsb::RunFor(db, workload, std::chrono::duration<double>(duration), threads, std::chrono::duration<double>(interval), [&](const ycsb::RunResult& current) {
+            elapsed += current.seconds;
+            std::printf("%8.1fs %10.0f ops/s ", elapsed, current.operations / current.seconds);
+            PrintLatency(current.latency);
+            std::printf("\n");
+            std::fflush(stdout);
+        });
+
+        std::printf("total: %lu operations in %.1fs, %.0f ops/s ", result.operations, result.seconds, result.operations / result.seconds);
+        PrintLatency(result.latency);
+        std::printf("\n");
+        // Background compactions change the levels the report goes through
+        db.lsm->WaitForCompactions();
+        PrintAmplification(db);
+        PrintMemoryUsage(*db.lsm);
+        if (options.rate_limiter) {
+            PrintRateLimiterStats(*options.rate_limiter);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "lsm_bench: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}